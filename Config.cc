@@ -22,6 +22,7 @@ namespace Config
   // Multi threading and Clone engine configuration
   int   numThreadsFinder = 1;
   int   numThreadsEvents = 1;
+  bool  concurrentIterations = false;
   
 #if defined(__MIC__) || defined(__AVX512F__)
   int   numThreadsSimulation = 60;
@@ -34,6 +35,9 @@ namespace Config
   /*MM: moving out to IterationParams*/
   //int   nlayers_per_seed = 3; // can be overriden from Geom plugin; a very confusing variable :)
   int   numSeedsPerTask = 32;
+  bool  costPartitioning    = true;
+  bool  costModelHitDensity = false;
+  bool  logRegionTaskTimes  = false;
   
   // number of hits per task for finding seeds
   int   numHitsPerTask = 32;
@@ -48,6 +52,7 @@ namespace Config
 
   seedOpts  seedInput    = simSeeds;
   cleanOpts seedCleaning = noCleaning; 
+  bool      seedCleaningBruteForce = false;
 
   bool             finding_requires_propagation_to_hit_pos;
   PropagationFlags finding_inter_layer_pflags;
@@ -56,10 +61,18 @@ namespace Config
   PropagationFlags forward_fit_pflags;
   PropagationFlags seed_fit_pflags;
   PropagationFlags pca_prop_pflags;
+  bool             closedFormPropR = false;
+  bool             chi2MultiHit = false;
 
 #ifdef CONFIG_PhiQArrays
   bool  usePhiQArrays = true;
 #endif
+  bool  useSimdHitScan = true;
+  bool  useSpiralHitScan = false;
+  int   hitScanCap = 0;
+  bool  useRadixHitSort = false;
+  bool  foldExtrasIntoTopK = false;
+  bool  emulate_compact_cand_state = false;
 
   bool  useCMSGeom = false;
   bool  readCmsswTracks = false;
@@ -90,6 +103,7 @@ namespace Config
   float maxdEta = 0.05;
   float minFracHitsShared = 0.75;
   float maxdRSquared = 0.000001; //corresponds to maxdR of 0.001
+  bool  findDuplicatesBruteForce = false;
 
   bool mtvLikeValidation = false;
   bool mtvRequireSeeds = false;
@@ -19,7 +19,8 @@ enum PropagationFlagsEnum
   PF_none              = 0,
 
   PF_use_param_b_field = 0x1,
-  PF_apply_material    = 0x2
+  PF_apply_material    = 0x2,
+  PF_closed_form_r     = 0x4
 };
 
 struct PropagationFlags
@@ -30,6 +31,7 @@ struct PropagationFlags
     {
       bool use_param_b_field  : 1;
       bool apply_material     : 1;
+      bool closed_form_r      : 1; // solve helix-cylinder intersection directly instead of Niter steps
       // Could add: bool use_trig_approx  -- now Config::useTrigApprox = true
       // Could add: int  n_iter : 8       -- now Config::Niter = 5
     };
@@ -42,7 +44,8 @@ struct PropagationFlags
 
   PropagationFlags(int pfe) :
     use_param_b_field       ( pfe & PF_use_param_b_field),
-    apply_material          ( pfe & PF_apply_material)
+    apply_material          ( pfe & PF_apply_material),
+    closed_form_r           ( pfe & PF_closed_form_r)
   {}
 };
 
@@ -164,7 +167,8 @@ namespace Config
   extern float RlgridME[Config::nBinsZME][Config::nBinsRME];
   extern float XigridME[Config::nBinsZME][Config::nBinsRME];
 
-  // This will become layer dependent (in bits). To be consistent with min_dphi.
+  // Default number of phi bins in LayerOfHits, layers can override it with
+  // LayerInfo::m_phi_bins. To be consistent with min_dphi.
   static constexpr int m_nphi = 128;
 
   // config on Event
@@ -239,6 +243,12 @@ namespace Config
   extern PropagationFlags forward_fit_pflags;
   extern PropagationFlags seed_fit_pflags;
   extern PropagationFlags pca_prop_pflags;
+  // Set PF_closed_form_r in all of the above after the Geom plugin has run.
+  extern bool             closedFormPropR;
+  // Compute chi2 of all hit candidates of a track in one call, with the
+  // position at each hit obtained from the track state at the first order
+  // (clone engine only). Default is one exact propagation + chi2 per hit.
+  extern bool             chi2MultiHit;
 
   // Config for Bfield. Note: for now the same for CMS-2017 and CylCowWLids.
   constexpr float Bfield = 3.8112;
@@ -259,6 +269,24 @@ namespace Config
 #else
   constexpr bool usePhiQArrays = true;
 #endif
+  // Test hits of a window in SIMD chunks over coalesced phi-bin ranges,
+  // otherwise loop over bins and hits one by one. Results are identical.
+  extern bool useSimdHitScan;
+  // Visit bins outward from the predicted position and keep the closest hits.
+  extern bool useSpiralHitScan;
+  // Max number of hits taken from a window, <= 0 means MkFinder::MPlexHitIdxMax.
+  extern int  hitScanCap;
+  // Sort hits into LayerOfHits bins with RadixSort instead of a counting sort
+  // over the q-phi bins. Resulting hit order is identical.
+  extern bool useRadixHitSort;
+  // In CandCloner, select the best candidates of a seed from the new hits and
+  // the candidates passing through a missed layer ("extras") in one top-K
+  // selection. Short (-2) hits then do not take one of the slots.
+  extern bool foldExtrasIntoTopK;
+  // Round TrackCand covariances as if stored in compact form (CompactSym66 in
+  // Track.h) whenever they are written. Compares physics performance of
+  // COMPACT_CAND_STATE builds without changing the layout; no effect there.
+  extern bool emulate_compact_cand_state;
 
   // Config for seeding as well... needed bfield
   constexpr float maxCurvR = (100 * minSimPt) / (sol * Bfield); // in cm
@@ -329,6 +357,8 @@ namespace Config
   extern float maxdEta;
   extern float minFracHitsShared;
   extern float maxdRSquared;
+  // Check all track pairs instead of eta-phi neighbours and tracks sharing hits.
+  extern bool findDuplicatesBruteForce;
 
   // config on seed cleaning
   constexpr float track1GeVradius = 87.6; // = 1/(c*B)
@@ -362,10 +392,22 @@ namespace Config
   extern int    numThreadsFinder;
   extern int    numThreadsSimulation;
   extern int    numThreadsEvents;
+  // Run the iterations of runBtbCe_MultiIter() as concurrent tasks, each with
+  // its own builder. Output should be the same as when running them in
+  // sequence; off by default until this is checked on real events.
+  extern bool   concurrentIterations;
 
   extern int    finderReportBestOutOfN;
 
   extern int    numSeedsPerTask;
+  // Split the seeds of all eta regions into tasks of about equal estimated cost
+  // (seeds times layers to cross) and run them largest first. When off, each
+  // region is split into blocks of an adaptive number of seeds.
+  extern bool   costPartitioning;
+  // Weight layers in the cost estimate by their hit occupancy.
+  extern bool   costModelHitDensity;
+  // Print per-region task counts, estimated costs and task times.
+  extern bool   logRegionTaskTimes;
 
   // number of layer1 hits for finding seeds per task
   extern int    numHitsPerTask;
@@ -373,6 +415,9 @@ namespace Config
   // seed options
   extern seedOpts  seedInput;
   extern cleanOpts seedCleaning;
+  // Compare all pairs of seeds in seed cleaning instead of neighbours in an
+  // eta-phi grid. Results are identical.
+  extern bool seedCleaningBruteForce;
   
   extern bool   useCMSGeom;
   extern bool   readCmsswTracks;
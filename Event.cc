@@ -1,4 +1,5 @@
 #include "Event.h"
+#include "HitCompression.h"
 #include "TrackerInfo.h"
 
 #include "mkFit/SteeringParams.h"
@@ -8,10 +9,17 @@
 
 #ifdef TBB
 #include "tbb/parallel_for.h"
+#include "tbb/enumerable_thread_specific.h"
 #endif
 
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <memory>
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 namespace
 {
   std::unique_ptr<mkfit::Validation> dummyValidation( mkfit::Validation::make_validation("dummy") );
@@ -45,6 +53,7 @@ void Event::Reset(int evtID)
 
   for (auto&& l : layerHits_) { l.clear(); }
   for (auto&& l : layerHitMasks_) { l.clear(); }
+  layerHitSpans_.clear();
 
   simHitsInfo_.clear();
   simTrackStates_.clear();
@@ -132,6 +141,8 @@ void Event::write_out(DataFile &data_file)
   int evsize = sizeof(int);
   fwrite(&evsize, sizeof(int), 1, fp); // this will be overwritten at the end
 
+  if (data_file.HasEventIndex()) data_file.f_ev_offsets.push_back(start);
+
   evsize += write_tracks(fp, simTracks_);
 
   if (data_file.HasSimTrackStates()) {
@@ -144,14 +155,28 @@ void Event::write_out(DataFile &data_file)
   int nl = layerHits_.size();
   fwrite(&nl, sizeof(int), 1, fp);
   evsize += sizeof(int);
-  for (int il = 0; il<nl; ++il) {
-    int nh = layerHits_[il].size();
-    fwrite(&nh, sizeof(int), 1, fp);
-    fwrite(&layerHits_[il][0], sizeof(Hit), nh, fp);
-    evsize += sizeof(int) + nh*sizeof(Hit);
+  if (data_file.HasCompressedHits()) {
+    // Masks, if present, are stored in the same per-layer block.
+    std::vector<char> buf;
+    for (int il = 0; il<nl; ++il) {
+      int nh = layerHits_[il].size();
+      const uint64_t *masks = data_file.HasHitIterMasks() ? layerHitMasks_[il].data() : nullptr;
+      buf.clear();
+      compress_hits(layerHits_[il].data(), masks, nh, buf);
+      fwrite(&nh, sizeof(int), 1, fp);
+      fwrite(buf.data(), 1, buf.size(), fp);
+      evsize += sizeof(int) + buf.size();
+    }
+  } else {
+    for (int il = 0; il<nl; ++il) {
+      int nh = layerHits_[il].size();
+      fwrite(&nh, sizeof(int), 1, fp);
+      fwrite(&layerHits_[il][0], sizeof(Hit), nh, fp);
+      evsize += sizeof(int) + nh*sizeof(Hit);
+    }
   }
 
-  if (data_file.HasHitIterMasks()) {
+  if (data_file.HasHitIterMasks() && ! data_file.HasCompressedHits()) {
     //sizes are the same as in layerHits_
     for (int il = 0; il<nl; ++il) {
       int nh = layerHitMasks_[il].size();
@@ -208,84 +233,112 @@ void Event::write_out(DataFile &data_file)
 
 void Event::read_in(DataFile &data_file, FILE *in_fp)
 {
-  FILE *fp = in_fp ? in_fp : data_file.f_fp;
-
-  data_file.AdvancePosToNextEvent(fp);
-
-  int nt = read_tracks(fp, simTracks_);
-  Config::nTracks = nt;
-
-  if (data_file.HasSimTrackStates())
+  if (data_file.IsMapped())
   {
-    int nts;
-    fread(&nts, sizeof(int), 1, fp);
-    simTrackStates_.resize(nts);
-    fread(&simTrackStates_[0], sizeof(TrackState), nts, fp);
+    read_in_mapped(data_file);
   }
-
-  int nl;
-  fread(&nl, sizeof(int), 1, fp);
-  layerHits_.resize(nl);
-  layerHitMasks_.resize(nl);
-  for (int il = 0; il<nl; ++il) {
-    int nh;
-    fread(&nh, sizeof(int), 1, fp);
-    layerHits_[il].resize(nh);
-    layerHitMasks_[il].resize(nh, 0);//init to 0 by default
-    fread(&layerHits_[il][0], sizeof(Hit), nh, fp);
-  }
-
-  if (data_file.HasHitIterMasks())
+  else
   {
-    for (int il = 0; il<nl; ++il) {
-      int nh = layerHits_[il].size();
-      fread(&layerHitMasks_[il][0], sizeof(uint64_t), nh, fp);
-    }
-  }
+    FILE *fp = in_fp ? in_fp : data_file.f_fp;
 
-  int nm;
-  fread(&nm, sizeof(int), 1, fp);
-  simHitsInfo_.resize(nm);
-  fread(&simHitsInfo_[0], sizeof(MCHitInfo), nm, fp);
+    data_file.AdvancePosToNextEvent(fp);
 
-  if (data_file.HasSeeds()) {
-    int ns = read_tracks(fp, seedTracks_, Config::seedInput != cmsswSeeds);
-    (void) ns;
+    read_tracks(fp, simTracks_);
 
-#ifdef DUMP_SEEDS
-    printf("Read %i seedtracks (neg value means actual reading was skipped)\n", ns);
-    for (int it = 0; it < ns; it++)
+    if (data_file.HasSimTrackStates())
     {
-      const Track& ss = seedTracks_[it];
-      printf("  %3i q=%+i pT=%7.3f eta=% 7.3f nHits=%i label=%4i algo=%2i\n",
-             it,ss.charge(),ss.pT(),ss.momEta(),ss.nFoundHits(),ss.label(),(int)ss.algorithm());
-#ifdef DUMP_SEED_HITS
-      for (int ih = 0; ih < seedTracks_[it].nTotalHits(); ++ih)
-      {
-        int lyr = seedTracks_[it].getHitLyr(ih);
-        int idx = seedTracks_[it].getHitIdx(ih);
-        if (idx >= 0)
+      int nts;
+      fread(&nts, sizeof(int), 1, fp);
+      simTrackStates_.resize(nts);
+      fread(&simTrackStates_[0], sizeof(TrackState), nts, fp);
+    }
+
+    int nl;
+    fread(&nl, sizeof(int), 1, fp);
+    layerHits_.resize(nl);
+    layerHitMasks_.resize(nl);
+    if (data_file.HasCompressedHits())
+    {
+      std::vector<char> buf;
+      for (int il = 0; il<nl; ++il) {
+        int nh, packed_size;
+        fread(&nh, sizeof(int), 1, fp);
+        fread(&packed_size, sizeof(int), 1, fp);
+        buf.resize(sizeof(int));
+        memcpy(buf.data(), &packed_size, sizeof(int));
+        buf.resize(compressed_block_size(buf.data()));
+        if (fread(&buf[sizeof(int)], 1, buf.size() - sizeof(int), fp) != buf.size() - sizeof(int))
         {
-          const Hit &hit = layerHits_[lyr][idx];
-          printf("    hit %2d lyr=%3d idx=%4d pos r=%7.3f z=% 8.3f   mc_hit=%3d mc_trk=%3d\n",
-                 ih, lyr, idx, layerHits_[lyr][idx].r(), layerHits_[lyr][idx].z(),
-                 hit.mcHitID(), hit.mcTrackID(simHitsInfo_));
+          fprintf(stderr, "Truncated compressed hit block for layer %d.\n", il);
+          exit(1);
         }
-        else
-          printf("    hit %2d idx=%i\n",ih,seedTracks_[it].getHitIdx(ih));
+        read_compressed_layer(data_file, il, nh, buf.data());
+      }
+    }
+    else
+    {
+      for (int il = 0; il<nl; ++il) {
+        int nh;
+        fread(&nh, sizeof(int), 1, fp);
+        layerHits_[il].resize(nh);
+        layerHitMasks_[il].resize(nh, 0);//init to 0 by default
+        fread(&layerHits_[il][0], sizeof(Hit), nh, fp);
+      }
+    }
 
+    if (data_file.HasHitIterMasks() && ! data_file.HasCompressedHits())
+    {
+      for (int il = 0; il<nl; ++il) {
+        int nh = layerHits_[il].size();
+        fread(&layerHitMasks_[il][0], sizeof(uint64_t), nh, fp);
       }
-#endif
     }
-#endif
+
+    int nm;
+    fread(&nm, sizeof(int), 1, fp);
+    simHitsInfo_.resize(nm);
+    fread(&simHitsInfo_[0], sizeof(MCHitInfo), nm, fp);
+
+    if (data_file.HasSeeds()) {
+      read_tracks(fp, seedTracks_, Config::seedInput != cmsswSeeds);
+    }
+
+    if (data_file.HasCmsswTracks())
+    {
+      read_tracks(fp, cmsswTracks_, ! Config::readCmsswTracks);
+    }
   }
 
-  int nert = -99999;
-  if (data_file.HasCmsswTracks())
+  int nt = simTracks_.size();
+  Config::nTracks = nt;
+
+#ifdef DUMP_SEEDS
+  int ns = seedTracks_.size();
+  printf("Read %i seedtracks\n", ns);
+  for (int it = 0; it < ns; it++)
   {
-    nert = read_tracks(fp, cmsswTracks_, ! Config::readCmsswTracks);
-    (void) nert;
+    const Track& ss = seedTracks_[it];
+    printf("  %3i q=%+i pT=%7.3f eta=% 7.3f nHits=%i label=%4i algo=%2i\n",
+           it,ss.charge(),ss.pT(),ss.momEta(),ss.nFoundHits(),ss.label(),(int)ss.algorithm());
+#ifdef DUMP_SEED_HITS
+    for (int ih = 0; ih < seedTracks_[it].nTotalHits(); ++ih)
+    {
+      int lyr = seedTracks_[it].getHitLyr(ih);
+      int idx = seedTracks_[it].getHitIdx(ih);
+      if (idx >= 0)
+      {
+        const Hit &hit = layer_hits(lyr)[idx];
+        printf("    hit %2d lyr=%3d idx=%4d pos r=%7.3f z=% 8.3f   mc_hit=%3d mc_trk=%3d\n",
+               ih, lyr, idx, hit.r(), hit.z(),
+               hit.mcHitID(), hit.mcTrackID(simHitsInfo_));
+      }
+      else
+        printf("    hit %2d idx=%i\n",ih,seedTracks_[it].getHitIdx(ih));
+
+    }
+#endif
   }
+#endif
 
   /*
     // HACK TO ONLY SELECT ONE PROBLEMATIC TRACK.
@@ -313,9 +366,9 @@ void Event::read_in(DataFile &data_file, FILE *in_fp)
       int idx = t.getHitIdx(ih);
       if (idx >= 0)
       {
-        const Hit &hit = layerHits_[lyr][idx];
+        const Hit &hit = layer_hits(lyr)[idx];
 	printf("    hit %2d lyr=%2d idx=%3d pos r=%7.3f x=% 8.3f y=% 8.3f z=% 8.3f   mc_hit=%3d mc_trk=%3d\n",
-               ih, lyr, idx, layerHits_[lyr][idx].r(), layerHits_[lyr][idx].x(), layerHits_[lyr][idx].y(), layerHits_[lyr][idx].z(),
+               ih, lyr, idx, hit.r(), hit.x(), hit.y(), hit.z(),
                hit.mcHitID(), hit.mcTrackID(simHitsInfo_));
       }
       else
@@ -325,17 +378,19 @@ void Event::read_in(DataFile &data_file, FILE *in_fp)
   }
 #endif
 #ifdef DUMP_LAYER_HITS
+  int nl = layerHits_.size();
   printf("Read %i layers\n",nl);
   int total_hits = 0;
   for (int il = 0; il < nl; il++)
   {
-    if (layerHits_[il].empty()) continue;
+    const HitSpan hits = layer_hits(il);
+    if (hits.empty()) continue;
 
-    printf("Read %i hits in layer %i\n", (int) layerHits_[il].size(), il);
-    total_hits += layerHits_[il].size();
-    for (int ih = 0; ih < (int) layerHits_[il].size(); ih++)
+    printf("Read %i hits in layer %i\n", hits.size(), il);
+    total_hits += hits.size();
+    for (int ih = 0; ih < hits.size(); ih++)
     {
-      const Hit &hit = layerHits_[il][ih];
+      const Hit &hit = hits[ih];
       printf("  mcHitID=%5d r=%10g x=%10g y=%10g z=%10g  sx=%10.4g sy=%10.4e sz=%10.4e\n",
              hit.mcHitID(), hit.r(), hit.x(), hit.y(), hit.z(),
              std::sqrt(hit.exx()), std::sqrt(hit.eyy()), std::sqrt(hit.ezz()));
@@ -344,6 +399,7 @@ void Event::read_in(DataFile &data_file, FILE *in_fp)
   printf("Total hits in all layers = %d\n", total_hits);
 #endif
 #ifdef DUMP_REC_TRACKS
+  int nert = cmsswTracks_.size();
   printf("Read %i rectracks\n", nert);
   for (int it = 0; it < nert; it++)
   {
@@ -357,7 +413,7 @@ void Event::read_in(DataFile &data_file, FILE *in_fp)
       int idx = t.getHitIdx(ih);
       if (idx >= 0)
       {
-        const Hit &hit = layerHits_[lyr][idx];
+        const Hit &hit = layer_hits(lyr)[idx];
         printf("    hit %2d lyr=%2d idx=%3d pos r=%7.3f z=% 8.3f   mc_hit=%3d mc_trk=%3d\n",
                ih, lyr, idx, hit.r(), hit.z(),
                hit.mcHitID(), hit.mcTrackID(simHitsInfo_));
@@ -379,6 +435,143 @@ void Event::read_in(DataFile &data_file, FILE *in_fp)
 
 //------------------------------------------------------------------------------
 
+namespace
+{
+  template<typename T>
+  T map_get(const char *&ptr)
+  {
+    T val;
+    memcpy(&val, ptr, sizeof(T));
+    ptr += sizeof(T);
+    return val;
+  }
+
+  template<typename T>
+  void map_read(const char *&ptr, std::vector<T> &vec, int n)
+  {
+    vec.resize(n);
+    memcpy((void*) vec.data(), ptr, n * sizeof(T));
+    ptr += n * sizeof(T);
+  }
+}
+
+bool Event::requires_hit_vectors()
+{
+  // Everything but LoadHits() and seed / track hit-index mapping accesses
+  // layerHits_ directly. Hits on file are modified by the kludge.
+
+  return Config::sim_val || Config::sim_val_for_cmssw || Config::cmssw_val || Config::fit_val ||
+         Config::quality_val || Config::dumpForPlots || Config::cmssw_export ||
+         Config::kludgeCmsHitErrors || Config::seedInput != cmsswSeeds;
+}
+
+const char* Event::read_compressed_layer(const DataFile &data_file, int il, int nh, const char *block)
+{
+  // Returns pointer past the compressed block.
+
+  layerHits_[il].resize(nh);
+  layerHitMasks_[il].resize(nh, 0);
+
+  return decompress_hits(block, layerHits_[il].data(),
+                         data_file.HasHitIterMasks() ? layerHitMasks_[il].data() : nullptr, nh);
+}
+
+void Event::read_in_mapped(DataFile &data_file)
+{
+  // Same layout as the FILE based path in read_in(). Hits are handed out as
+  // spans into the mapping unless something downstream needs owning vectors.
+
+  static_assert(alignof(Hit) <= sizeof(int), "Hits in mapped file must be at least int-aligned.");
+
+  const bool copy_hits = requires_hit_vectors();
+
+  const char *ptr = data_file.ClaimNextEvent();
+
+  read_tracks(ptr, simTracks_);
+
+  if (data_file.HasSimTrackStates())
+  {
+    int nts = map_get<int>(ptr);
+    if (Config::readSimTrackStates)
+      map_read(ptr, simTrackStates_, nts);
+    else
+      ptr += nts * sizeof(TrackState);
+  }
+
+  int nl = map_get<int>(ptr);
+  layerHits_.resize(nl);
+  layerHitMasks_.resize(nl);
+  if (data_file.HasCompressedHits())
+  {
+    // Compressed hits always get decoded into layerHits_.
+    for (int il = 0; il < nl; ++il)
+    {
+      int nh = map_get<int>(ptr);
+      ptr = read_compressed_layer(data_file, il, nh, ptr);
+    }
+  }
+  else
+  {
+    layerHitSpans_.resize(nl);
+    for (int il = 0; il < nl; ++il)
+    {
+      int nh = map_get<int>(ptr);
+      layerHitSpans_[il] = HitSpan(reinterpret_cast<const Hit*>(ptr), nh);
+      if (copy_hits)
+        map_read(ptr, layerHits_[il], nh);
+      else
+        ptr += nh * sizeof(Hit);
+    }
+
+    if (data_file.HasHitIterMasks())
+    {
+      for (int il = 0; il < nl; ++il)
+        map_read(ptr, layerHitMasks_[il], layerHitSpans_[il].size());
+    }
+    else
+    {
+      for (int il = 0; il < nl; ++il)
+        layerHitMasks_[il].resize(layerHitSpans_[il].size(), 0);
+    }
+
+    if (copy_hits)
+    {
+      // Views must follow the owning vectors, kludge_cms_hit_errors() modifies them.
+      layerHitSpans_.clear();
+    }
+  }
+
+  int nm = map_get<int>(ptr);
+  if (copy_hits)
+    map_read(ptr, simHitsInfo_, nm);
+  else
+    ptr += nm * sizeof(MCHitInfo);
+
+  if (data_file.HasSeeds())
+  {
+    read_tracks(ptr, seedTracks_, Config::seedInput != cmsswSeeds);
+  }
+
+  if (data_file.HasCmsswTracks())
+  {
+    read_tracks(ptr, cmsswTracks_, ! Config::readCmsswTracks);
+  }
+}
+
+//------------------------------------------------------------------------------
+
+namespace
+{
+  void report_truncated_tracks(int n_truncated)
+  {
+    if (n_truncated > 0)
+    {
+      printf("WARNING Event::read_tracks %d tracks with more than %d hits truncated to fit inline hit storage.\n",
+             n_truncated, Config::nMaxTrkHits);
+    }
+  }
+}
+
 int Event::write_tracks(FILE *fp, const TrackVec& tracks)
 {
   // Returns total number of bytes written.
@@ -387,10 +580,22 @@ int Event::write_tracks(FILE *fp, const TrackVec& tracks)
   fwrite(&n_tracks, sizeof(int), 1, fp);
 
   auto start = ftell(fp);
-  int data_size = 2 * sizeof(int) + n_tracks * sizeof(Track);
+  int data_size = 2 * sizeof(int) + n_tracks * sizeof(TrackFileRecord);
   fwrite(&data_size, sizeof(int), 1, fp);
 
-  fwrite(tracks.data(), sizeof(Track), n_tracks, fp);
+  if (sizeof(Track) == sizeof(TrackFileRecord))
+  {
+    fwrite(tracks.data(), sizeof(Track), n_tracks, fp);
+  }
+  else
+  {
+    char rec[sizeof(TrackFileRecord)] = {};
+    for (int i = 0; i < n_tracks; ++i)
+    {
+      memcpy(rec, (const void*) static_cast<const TrackBase*>(&tracks[i]), sizeof(TrackBase));
+      fwrite(rec, sizeof(rec), 1, fp);
+    }
+  }
 
   for (int i = 0; i < n_tracks; ++i)
   {
@@ -422,18 +627,85 @@ int Event::read_tracks(FILE *fp, TrackVec& tracks, bool skip_reading)
   {
     tracks.resize(n_tracks);
 
-    fread(tracks.data(), sizeof(Track), n_tracks, fp);
+    if (sizeof(Track) == sizeof(TrackFileRecord))
+    {
+      fread(tracks.data(), sizeof(Track), n_tracks, fp);
+    }
+    else
+    {
+      char rec[sizeof(TrackFileRecord)];
+      for (int i = 0; i < n_tracks; ++i)
+      {
+        fread(rec, sizeof(rec), 1, fp);
+        memcpy((void*) static_cast<TrackBase*>(&tracks[i]), rec, sizeof(TrackBase));
+      }
+    }
 
+    int n_truncated = 0;
     for (int i = 0; i < n_tracks; ++i)
     {
-      tracks[i].resizeHitsForInput();
+      const int n_hots = tracks[i].nTotalHits();
+      const bool fits  = tracks[i].resizeHitsForInput();
       fread(tracks[i].BeginHitsOnTrack_nc(), sizeof(HitOnTrack), tracks[i].nTotalHits(), fp);
+      if ( ! fits)
+      {
+        fseek(fp, (n_hots - tracks[i].nTotalHits()) * sizeof(HitOnTrack), SEEK_CUR);
+        tracks[i].countAndSetNFoundHits();
+        ++n_truncated;
+      }
     }
+    report_truncated_tracks(n_truncated);
   }
 
   return n_tracks;
 }
 
+int Event::read_tracks(const char *&ptr, TrackVec& tracks, bool skip_reading)
+{
+  // Mapped-file version of the above, advances ptr past the track section.
+
+  int n_tracks  = map_get<int>(ptr);
+  int data_size = map_get<int>(ptr);
+
+  if (skip_reading)
+  {
+    ptr += data_size - 2 * sizeof(int);
+    return -n_tracks;
+  }
+
+  tracks.resize(n_tracks);
+
+  if (sizeof(Track) == sizeof(TrackFileRecord))
+  {
+    memcpy((void*) tracks.data(), ptr, n_tracks * sizeof(Track));
+  }
+  else
+  {
+    for (int i = 0; i < n_tracks; ++i)
+    {
+      memcpy((void*) static_cast<TrackBase*>(&tracks[i]), ptr + i * sizeof(TrackFileRecord), sizeof(TrackBase));
+    }
+  }
+  ptr += n_tracks * sizeof(TrackFileRecord);
+
+  int n_truncated = 0;
+  for (int i = 0; i < n_tracks; ++i)
+  {
+    const int n_hots = tracks[i].nTotalHits();
+    const bool fits  = tracks[i].resizeHitsForInput();
+    memcpy(tracks[i].BeginHitsOnTrack_nc(), ptr, tracks[i].nTotalHits() * sizeof(HitOnTrack));
+    ptr += n_hots * sizeof(HitOnTrack);
+    if ( ! fits)
+    {
+      tracks[i].countAndSetNFoundHits();
+      ++n_truncated;
+    }
+  }
+  report_truncated_tracks(n_truncated);
+
+  return n_tracks;
+}
+
 //------------------------------------------------------------------------------
 
 void Event::setInputFromCMSSW(std::vector<HitVec> hits, TrackVec seeds)
@@ -562,185 +834,381 @@ void Event::print_tracks(const TrackVec& tracks, bool print_hits) const
   }
 }
 
-int Event::clean_cms_seedtracks(TrackVec *seed_ptr)
-{
-  const float etamax_brl = Config::c_etamax_brl;
-  const float dpt_brl_0  = Config::c_dpt_brl_0;
-  const float dpt_ec_0   = Config::c_dpt_ec_0;
-  const float ptmax_0    = Config::c_ptmax_0;
-  const float dpt_1      = Config::c_dpt_1;
-  const float ptmax_1    = Config::c_ptmax_1;
-  const float dpt_2      = Config::c_dpt_2;
-  const float ptmax_2    = Config::c_ptmax_2;
-  const float dpt_3      = Config::c_dpt_3;
-  const float dzmax_brl  = Config::c_dzmax_brl;
-  const float drmax_brl  = Config::c_drmax_brl;
-  const float ptmin_hpt  = Config::c_ptmin_hpt;
-  const float dzmax_hpt  = Config::c_dzmax_hpt;
-  const float drmax_hpt  = Config::c_drmax_hpt;
-  const float dzmax_els  = Config::c_dzmax_els;
-  const float drmax_els  = Config::c_drmax_els;
+//==============================================================================
+// Seed cleaning
+//==============================================================================
 
-  const float dzmax2_brl = dzmax_brl*dzmax_brl;
-  const float drmax2_brl = drmax_brl*drmax_brl;
-  const float dzmax2_hpt = dzmax_hpt*dzmax_hpt;
-  const float drmax2_hpt = drmax_hpt*drmax_hpt;
-  const float dzmax2_els = dzmax_els*dzmax_els;
-  const float drmax2_els = drmax_els*drmax_els;
+// Seed ts, unless it was itself removed, removes every later seed tss that
+// has the same charge and compatible pT, and lies within the dR-dz window of
+// ts. Thresholds depend on ts only and are precomputed per seed.
+//
+// The loop over all pairs is replaced by a grid in (charge, eta, phi): tss
+// can only be within the window if |deta| < drmax and phi at the seed position
+// differs by less than drmax plus the maximum phi bending between the two
+// seed positions. Seed data is copied in cell order so that the candidates
+// from each cell are a contiguous slice, tested with one SIMD loop. Pairs from
+// neighbouring cells are tested in parallel and the matches are then applied
+// in seed order, which gives exactly the same result.
 
-  TrackVec &seeds = (seed_ptr != nullptr) ? *seed_ptr : seedTracks_;
-  const int ns = seeds.size();
+namespace
+{
+  struct SeedCleaningData
+  {
+    const int n;
+
+    std::vector<int>    charge;
+    std::vector<float>  oldPhi;
+    std::vector<float>  pos2;
+    std::vector<float>  eta;
+    std::vector<float>  cotTheta;
+    std::vector<float>  invptq;
+    std::vector<float>  pt;
+    std::vector<float>  x;
+    std::vector<float>  y;
+    std::vector<float>  z;
+
+    // Thresholds of seed as the reference one, see match().
+    std::vector<float>  dptmax;
+    std::vector<float>  dzmax2;
+    std::vector<float>  drmax2;
+
+    SeedCleaningData(const TrackVec &seeds) :
+      n(seeds.size()),
+      charge(n), oldPhi(n), pos2(n), eta(n), cotTheta(n), invptq(n), pt(n), x(n), y(n), z(n),
+      dptmax(n), dzmax2(n), drmax2(n)
+    {
+      for (int ts = 0; ts < n; ts++)
+      {
+        const Track & tk = seeds[ts];
+        charge[ts] = tk.charge();
+        oldPhi[ts] = tk.momPhi();
+        pos2[ts] = std::pow(tk.x(), 2) + std::pow(tk.y(), 2);
+        eta[ts] = tk.momEta();
+        const float theta = std::atan2(tk.pT(),tk.pz());
+        cotTheta[ts] = 1.f/std::tan(theta);
+        invptq[ts] = tk.charge()*tk.invpT();
+        pt[ts] = tk.pT();
+        x[ts] = tk.x();
+        y[ts] = tk.y();
+        z[ts] = tk.z();
+
+        ////// Require pT consistency between seeds. If dpT is large, do not remove seed-track.
+        ////// Adaptive thresholds, based on pT of reference seed-track (choice is a compromise between efficiency and duplicate rate):
+        ////// - 2.5% if track is barrel and w/ pT<2 GeV
+        ////// - 1.25% if track is non-barrel and w/ pT<2 GeV
+        ////// - 10% if track w/ 2<pT<5 GeV
+        ////// - 20% if track w/ 5<pT<10 GeV
+        ////// - 25% if track w/ pT>10 GeV
+        const float Pt1  = pt[ts];
+        const float Eta1 = eta[ts];
+        if      (Pt1<Config::c_ptmax_0 && std::abs(Eta1)<Config::c_etamax_brl) dptmax[ts] = Config::c_dpt_brl_0*(Pt1);
+        else if (Pt1<Config::c_ptmax_0 && std::abs(Eta1)>Config::c_etamax_brl) dptmax[ts] = Config::c_dpt_ec_0*(Pt1);
+        else if (Pt1>Config::c_ptmax_0 && Pt1<Config::c_ptmax_1)               dptmax[ts] = Config::c_dpt_1*(Pt1);
+        else if (Pt1>Config::c_ptmax_1 && Pt1<Config::c_ptmax_2)               dptmax[ts] = Config::c_dpt_2*(Pt1);
+        else if (Pt1>Config::c_ptmax_2)                                        dptmax[ts] = Config::c_dpt_3*(Pt1);
+        else                                                                   dptmax[ts] = std::numeric_limits<float>::infinity();
+      }
+    }
 
-  TrackVec cleanSeedTracks;
-  cleanSeedTracks.reserve(ns);
-  std::vector<bool> writetrack(ns, true);
-
-  const float invR1GeV = 1.f/Config::track1GeVradius;
-
-  std::vector<int>    nHits(ns);
-  std::vector<int>    charge(ns);
-  std::vector<float>  oldPhi(ns);
-  std::vector<float>  pos2(ns);
-  std::vector<float>  eta(ns);
-  std::vector<float>  theta(ns);
-  std::vector<float>  invptq(ns);
-  std::vector<float>  pt(ns);
-  std::vector<float>  x(ns);
-  std::vector<float>  y(ns);
-  std::vector<float>  z(ns);
+    // Copy of seeds o[order[i]], see clean_grid().
+    SeedCleaningData(const SeedCleaningData &o, const std::vector<int> &order) :
+      n(order.size()),
+      charge(n), oldPhi(n), pos2(n), eta(n), cotTheta(n), invptq(n), pt(n), x(n), y(n), z(n),
+      dptmax(n), dzmax2(n), drmax2(n)
+    {
+      for (int i = 0; i < n; ++i)
+      {
+        const int j = order[i];
+        charge[i]   = o.charge[j];
+        oldPhi[i]   = o.oldPhi[j];
+        pos2[i]     = o.pos2[j];
+        eta[i]      = o.eta[j];
+        cotTheta[i] = o.cotTheta[j];
+        invptq[i]   = o.invptq[j];
+        pt[i]       = o.pt[j];
+        x[i]        = o.x[j];
+        y[i]        = o.y[j];
+        z[i]        = o.z[j];
+        dptmax[i]   = o.dptmax[j];
+        dzmax2[i]   = o.dzmax2[j];
+        drmax2[i]   = o.drmax2[j];
+      }
+    }
 
-  for(int ts=0; ts<ns; ts++){
-    const Track & tk = seeds[ts];
-    nHits[ts] = tk.nFoundHits();
-    charge[ts] = tk.charge();
-    oldPhi[ts] = tk.momPhi();
-    pos2[ts] = std::pow(tk.x(), 2) + std::pow(tk.y(), 2);
-    eta[ts] = tk.momEta();
-    theta[ts] = std::atan2(tk.pT(),tk.pz());
-    invptq[ts] = tk.charge()*tk.invpT();
-    pt[ts] = tk.pT();
-    x[ts] = tk.x();
-    y[ts] = tk.y();
-    z[ts] = tk.z();
-  }
+    // Does seed ts remove seed tss of o? Arithmetic is kept as in the original
+    // pairwise loop so that results are bit-identical.
+    bool match(int ts, const SeedCleaningData &o, int tss) const
+    {
+      const float invR1GeV = 1.f/Config::track1GeVradius;
 
-  for(int ts=0; ts<ns; ts++){
+      ////// Always require charge consistency. If different charge is assigned, do not remove seed-track
+      const bool same_charge = o.charge[tss] == charge[ts];
 
-    if (not writetrack[ts]) continue;//FIXME: this speed up prevents transitive masking; check build cost!
+      const float thisDPt = std::abs(o.pt[tss]-pt[ts]);
+      const bool  dpt_ok  = ! (thisDPt > dptmax[ts]);
 
-    const float oldPhi1 = oldPhi[ts];
-    const float pos2_first = pos2[ts];
-    const float Eta1 = eta[ts];
-    const float Pt1 = pt[ts];
-    const float invptq_first = invptq[ts];
+      const float deta2 = std::pow(eta[ts]-o.eta[tss], 2);
 
-    //#pragma simd /* Vectorization via simd had issues with icc */
-    for (int tss= ts+1; tss<ns; tss++){
+      const float thisDXYSign05 = o.pos2[tss] > pos2[ts] ? -0.5f : 0.5f;
 
-      const float Pt2 = pt[tss];
+      const float thisDXY = thisDXYSign05*sqrt( std::pow(x[ts]-o.x[tss], 2) + std::pow(y[ts]-o.y[tss], 2) );
 
-      ////// Always require charge consistency. If different charge is assigned, do not remove seed-track
-      if(charge[tss] != charge[ts])
-        continue;
+      const float newPhi1 = oldPhi[ts]-thisDXY*invR1GeV*invptq[ts];
+      const float newPhi2 = o.oldPhi[tss]+thisDXY*invR1GeV*o.invptq[tss];
 
-      const float thisDPt = std::abs(Pt2-Pt1);
-      ////// Require pT consistency between seeds. If dpT is large, do not remove seed-track.
-      ////// Adaptive thresholds, based on pT of reference seed-track (choice is a compromise between efficiency and duplicate rate):
-      ////// - 2.5% if track is barrel and w/ pT<2 GeV
-      ////// - 1.25% if track is non-barrel and w/ pT<2 GeV
-      ////// - 10% if track w/ 2<pT<5 GeV
-      ////// - 20% if track w/ 5<pT<10 GeV
-      ////// - 25% if track w/ pT>10 GeV
-      if(thisDPt>dpt_brl_0*(Pt1) && Pt1<ptmax_0 && std::abs(Eta1)<etamax_brl)
-        continue;
+      // cdist() written without a subtraction under a condition, so that the
+      // loop in clean_grid() can be if-converted and vectorized.
+      const float adphi = std::abs(newPhi1-newPhi2);
+      const bool  wrap  = adphi > Config::PI;
+      const float dphi  = (wrap ? Config::TwoPI : 0.f) - (wrap ? adphi : -adphi);
 
-      else if(thisDPt>dpt_ec_0*(Pt1) && Pt1<ptmax_0 && std::abs(Eta1)>etamax_brl)
-        continue;
+      const float dr2 = deta2+dphi*dphi;
 
-      else if(thisDPt>dpt_1*(Pt1) && Pt1>ptmax_0 && Pt1<ptmax_1)
-        continue;
+      const float thisDZ = z[ts]-o.z[tss]-thisDXY*(cotTheta[ts]+o.cotTheta[tss]);
+      const float dz2 = thisDZ*thisDZ;
 
-      else if(thisDPt>dpt_2*(Pt1) && Pt1>ptmax_1 && Pt1<ptmax_2)
-        continue;
+      ////// Reject tracks within dR-dz elliptical window.
+      return same_charge & dpt_ok & (dz2/dzmax2[ts]+dr2/drmax2[ts]<1.0f);
+    }
 
-      else if(thisDPt>dpt_3*(Pt1) && Pt1>ptmax_2)
-        continue;
+    bool match(int ts, int tss) const { return match(ts, *this, tss); }
 
+    // Original O(N^2) loop.
+    void clean_brute_force(std::vector<bool> &writetrack) const
+    {
+      for (int ts = 0; ts < n; ts++)
+      {
+        if (not writetrack[ts]) continue;//FIXME: this speed up prevents transitive masking; check build cost!
+
+        for (int tss = ts+1; tss < n; tss++)
+        {
+          if (match(ts, tss)) writetrack[tss] = false;
+        }
+      }
+    }
 
-      const float Eta2 = eta[tss];
-      const float deta2 = std::pow(Eta1-Eta2, 2);
+    void clean_grid(std::vector<bool> &writetrack) const;
+  };
 
-      const float oldPhi2 = oldPhi[tss];
+  //----------------------------------------------------------------------------
 
-      const float pos2_second = pos2[tss];
-      const float thisDXYSign05 = pos2_second > pos2_first ? -0.5f : 0.5f;
+  struct SeedCleaningGrid
+  {
+    int   n_eta = 1, n_phi = 1;
+    float eta_min = 0, eta_w = 1, phi_w = Config::TwoPI;
 
-      const float thisDXY = thisDXYSign05*sqrt( std::pow(x[ts]-x[tss], 2) + std::pow(y[ts]-y[tss], 2) );
+    std::vector<int> cell_beg; // n_cells + 1 offsets into seeds
+    std::vector<int> seeds;    // seed indices, ascending within each cell
 
-      const float invptq_second = invptq[tss];
+    int n_cells() const { return 2 * n_eta * n_phi; }
 
-      const float newPhi1 = oldPhi1-thisDXY*invR1GeV*invptq_first;
-      const float newPhi2 = oldPhi2+thisDXY*invR1GeV*invptq_second;
+    int eta_bin(float eta) const { return std::clamp((int) std::floor((eta - eta_min) / eta_w), 0, n_eta - 1); }
+    int phi_bin(float phi) const { return std::clamp((int) std::floor((phi + Config::PI) / phi_w), 0, n_phi - 1); }
 
-      const float dphi = cdist(std::abs(newPhi1-newPhi2));
+    int cell(int chg, int ie, int ip) const { return ((chg > 0) * n_eta + ie) * n_phi + ip; }
+  };
 
-      const float dr2 = deta2+dphi*dphi;
+  void SeedCleaningData::clean_grid(std::vector<bool> &writetrack) const
+  {
+    const float invR1GeV = 1.f/Config::track1GeVradius;
+
+    // Seeds with non-finite eta, phi or curvature can not match in either role.
+    auto usable = [&](int i) { return std::isfinite(eta[i]) && std::isfinite(oldPhi[i]) && std::isfinite(invptq[i]); };
+
+    // Windows are widened by a relative and an absolute margin to cover
+    // rounding in match().
+    std::vector<float> eta_win(n), phi_win(n);
+    float eta_lo = 0, eta_hi = 0, max_eta_win = 0, sum_phi_win = 0, rmax = 0, bmax = 0;
+    int   n_usable = 0;
+    bool  finite_windows = true;
+    for (int i = 0; i < n; ++i)
+    {
+      if ( ! usable(i)) continue;
+      eta_lo = n_usable ? std::min(eta_lo, eta[i]) : eta[i];
+      eta_hi = n_usable ? std::max(eta_hi, eta[i]) : eta[i];
+      rmax   = std::max(rmax, std::sqrt(pos2[i]));
+      bmax   = std::max(bmax, std::abs(invptq[i]));
+      ++n_usable;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+      if ( ! usable(i)) continue;
+      eta_win[i] = std::sqrt(drmax2[i]) * 1.001f + 1e-5f;
+      phi_win[i] = eta_win[i] + rmax * invR1GeV * (std::abs(invptq[i]) + bmax) * 1.001f + 1e-4f;
+      if ( ! std::isfinite(phi_win[i])) finite_windows = false;
+      max_eta_win  = std::max(max_eta_win, eta_win[i]);
+      sum_phi_win += phi_win[i];
+    }
 
-      const float thisDZ = z[ts]-z[tss]-thisDXY*(1.f/std::tan(theta[ts])+1.f/std::tan(theta[tss]));
-      const float dz2 = thisDZ*thisDZ;
+    SeedCleaningGrid g;
+    if (finite_windows && n_usable > 0)
+    {
+      g.eta_min = eta_lo;
+      g.eta_w   = std::max(max_eta_win, 1e-3f);
+      g.n_eta   = std::clamp((int) ((eta_hi - eta_lo) / g.eta_w) + 1, 1, 4096);
+      g.n_phi   = std::clamp((int) (Config::TwoPI * n_usable / sum_phi_win), 1, 256);
+      g.phi_w   = Config::TwoPI / g.n_phi;
+    }
 
-      ////// Reject tracks within dR-dz elliptical window.
-      ////// Adaptive thresholds, based on observation that duplicates are more abundant at large pseudo-rapidity and low track pT
-      if(std::abs(Eta1)<etamax_brl){
-        if(dz2/dzmax2_brl+dr2/drmax2_brl<1.0f)
-          writetrack[tss]=false;
-      }
-      else if(Pt1>ptmin_hpt){
-        if(dz2/dzmax2_hpt+dr2/drmax2_hpt<1.0f)
-          writetrack[tss]=false;
-      }
-      else {
-        if(dz2/dzmax2_els+dr2/drmax2_els<1.0f)
-          writetrack[tss]=false;
+    // Counting sort of seeds into cells, keeps seed order within each cell.
+    std::vector<int> seed_cell(n, -1);
+    g.cell_beg.assign(g.n_cells() + 1, 0);
+    for (int i = 0; i < n; ++i)
+    {
+      if ( ! usable(i)) continue;
+      seed_cell[i] = g.cell(charge[i], g.eta_bin(eta[i]), g.phi_bin(oldPhi[i]));
+      ++g.cell_beg[seed_cell[i] + 1];
+    }
+    for (int c = 0; c < g.n_cells(); ++c) g.cell_beg[c + 1] += g.cell_beg[c];
+    g.seeds.resize(g.cell_beg[g.n_cells()]);
+    {
+      std::vector<int> pos(g.cell_beg.begin(), g.cell_beg.end() - 1);
+      for (int i = 0; i < n; ++i)
+      {
+        if (seed_cell[i] >= 0) g.seeds[pos[seed_cell[i]]++] = i;
       }
     }
 
-    if(writetrack[ts])
-      cleanSeedTracks.emplace_back(seeds[ts]);
+    // Seeds in cell order, cell c is [cell_beg[c], cell_beg[c + 1]).
+    const SeedCleaningData cd(*this, g.seeds);
+    int max_cell_size = 0;
+    for (int c = 0; c < g.n_cells(); ++c) max_cell_size = std::max(max_cell_size, g.cell_beg[c + 1] - g.cell_beg[c]);
 
-  }
+    // Find matching pairs for seeds in [beg, end), whether they survive or not.
+    auto find_matches = [&](int beg, int end, std::vector<std::pair<int, int>> &matches)
+    {
+      // short: char stores could alias the vector pointers and int stores the
+      // charge of seed data, which would then be reloaded in the loop.
+      std::vector<short> pass(max_cell_size);
+      for (int ts = beg; ts < end; ++ts)
+      {
+        if (seed_cell[ts] < 0) continue;
 
-  seeds.swap(cleanSeedTracks);
+        const int ie   = g.eta_bin(eta[ts]);
+        const int ip   = g.phi_bin(oldPhi[ts]);
+        const int de   = finite_windows ? (int) std::ceil(eta_win[ts] / g.eta_w) + 1 : g.n_eta;
+        const int dp   = finite_windows ? (int) std::ceil(phi_win[ts] / g.phi_w) + 1 : g.n_phi;
+        const int ip_1 = 2 * dp + 1 >= g.n_phi ? 0         : ip - dp;
+        const int ip_2 = 2 * dp + 1 >= g.n_phi ? g.n_phi-1 : ip + dp;
 
-#ifdef DEBUG
-  {
-    const int ns2 = seeds.size();
-    printf("Number of CMS seeds before %d --> after %d cleaning\n", ns, ns2);
+        for (int e = std::max(ie - de, 0); e <= std::min(ie + de, g.n_eta - 1); ++e)
+        {
+          for (int p = ip_1; p <= ip_2; ++p)
+          {
+            // Only seeds after ts in the cell.
+            const int  c  = g.cell(charge[ts], e, (p + g.n_phi) % g.n_phi);
+            const int *sb = &g.seeds[0];
+            const int  kb = std::upper_bound(sb + g.cell_beg[c], sb + g.cell_beg[c + 1], ts) - sb;
+            const int  ke = g.cell_beg[c + 1];
+
+#pragma omp simd
+            for (int k = kb; k < ke; ++k)
+            {
+              pass[k - kb] = match(ts, cd, k);
+            }
+            for (int k = kb; k < ke; ++k)
+            {
+              if (pass[k - kb]) matches.emplace_back(ts, g.seeds[k]);
+            }
+          }
+        }
+      }
+    };
 
-    for (int it = 0; it < ns2; it++)
+    std::vector<std::pair<int, int>> matches;
+#ifdef TBB
+    tbb::enumerable_thread_specific<std::vector<std::pair<int, int>>> thr_matches;
+    tbb::parallel_for(tbb::blocked_range<int>(0, n, 64),
+      [&](const tbb::blocked_range<int> &r)
+      {
+        find_matches(r.begin(), r.end(), thr_matches.local());
+      });
+    for (auto &m : thr_matches) matches.insert(matches.end(), m.begin(), m.end());
+    std::sort(matches.begin(), matches.end());
+#else
+    find_matches(0, n, matches);
+#endif
+
+    // Apply in seed order, only surviving seeds remove others.
+    for (auto &m : matches)
     {
-      const Track& ss = seeds[it];
-      printf("  %3i q=%+i pT=%7.3f eta=% 7.3f nHits=%i label=% i\n",
-             it,ss.charge(),ss.pT(),ss.momEta(),ss.nFoundHits(),ss.label());
+      if (writetrack[m.first]) writetrack[m.second] = false;
     }
   }
+
+  int clean_seeds(TrackVec &seeds, const SeedCleaningData &data)
+  {
+    const int ns = seeds.size();
+
+    std::vector<bool> writetrack(ns, true);
+    if (Config::seedCleaningBruteForce) data.clean_brute_force(writetrack);
+    else                                data.clean_grid(writetrack);
+
+    TrackVec cleanSeedTracks;
+    cleanSeedTracks.reserve(ns);
+    for (int ts = 0; ts < ns; ts++)
+    {
+      if (writetrack[ts])
+        cleanSeedTracks.emplace_back(seeds[ts]);
+    }
+
+    seeds.swap(cleanSeedTracks);
+
+#ifdef DEBUG
+    {
+      const int ns2 = seeds.size();
+      printf("Number of CMS seeds before %d --> after %d cleaning\n", ns, ns2);
+
+      for (int it = 0; it < ns2; it++)
+      {
+        const Track& ss = seeds[it];
+        printf("  %3i q=%+i pT=%7.3f eta=% 7.3f nHits=%i label=% i\n",
+               it,ss.charge(),ss.pT(),ss.momEta(),ss.nFoundHits(),ss.label());
+      }
+    }
 #endif
 
-  return seeds.size();
+    return seeds.size();
+  }
+}
+
+int Event::clean_cms_seedtracks(TrackVec *seed_ptr)
+{
+  const float etamax_brl = Config::c_etamax_brl;
+  const float dzmax_brl  = Config::c_dzmax_brl;
+  const float drmax_brl  = Config::c_drmax_brl;
+  const float ptmin_hpt  = Config::c_ptmin_hpt;
+  const float dzmax_hpt  = Config::c_dzmax_hpt;
+  const float drmax_hpt  = Config::c_drmax_hpt;
+  const float dzmax_els  = Config::c_dzmax_els;
+  const float drmax_els  = Config::c_drmax_els;
+
+  const float dzmax2_brl = dzmax_brl*dzmax_brl;
+  const float drmax2_brl = drmax_brl*drmax_brl;
+  const float dzmax2_hpt = dzmax_hpt*dzmax_hpt;
+  const float drmax2_hpt = drmax_hpt*drmax_hpt;
+  const float dzmax2_els = dzmax_els*dzmax_els;
+  const float drmax2_els = drmax_els*drmax_els;
+
+  TrackVec &seeds = (seed_ptr != nullptr) ? *seed_ptr : seedTracks_;
+
+  SeedCleaningData data(seeds);
+
+  ////// Adaptive dR-dz window thresholds, based on observation that duplicates are more abundant at large pseudo-rapidity and low track pT
+  for (int ts = 0; ts < data.n; ts++)
+  {
+    if (std::abs(data.eta[ts])<etamax_brl) { data.dzmax2[ts] = dzmax2_brl; data.drmax2[ts] = drmax2_brl; }
+    else if (data.pt[ts]>ptmin_hpt)        { data.dzmax2[ts] = dzmax2_hpt; data.drmax2[ts] = drmax2_hpt; }
+    else                                   { data.dzmax2[ts] = dzmax2_els; data.drmax2[ts] = drmax2_els; }
+  }
+
+  return clean_seeds(seeds, data);
 }
 
 int Event::clean_cms_seedtracks_iter(TrackVec *seed_ptr, const IterationConfig& itrcfg)
 { 
   const float etamax_brl = Config::c_etamax_brl;
-  const float dpt_brl_0  = Config::c_dpt_brl_0;
-  const float dpt_ec_0   = Config::c_dpt_ec_0;
-  const float ptmax_0    = Config::c_ptmax_0;
-  const float dpt_1      = Config::c_dpt_1;
-  const float ptmax_1    = Config::c_ptmax_1;
-  const float dpt_2      = Config::c_dpt_2;
-  const float ptmax_2    = Config::c_ptmax_2;
-  const float dpt_3      = Config::c_dpt_3;
-  
+
   const float dzmax_bh = itrcfg.m_params.c_dzmax_bh;
   const float drmax_bh = itrcfg.m_params.c_drmax_bh;
   const float dzmax_eh = itrcfg.m_params.c_dzmax_eh;
@@ -762,141 +1230,35 @@ int Event::clean_cms_seedtracks_iter(TrackVec *seed_ptr, const IterationConfig&
   const float drmax2_el = drmax_el*drmax_el;
 
   TrackVec &seeds = (seed_ptr != nullptr) ? *seed_ptr : seedTracks_;
-  const int ns = seeds.size();
-  std::cout << "before seed cleaning "<< seeds.size()<<std::endl;
-
-  TrackVec cleanSeedTracks;
-  cleanSeedTracks.reserve(ns);
-  std::vector<bool> writetrack(ns, true);
-
-  const float invR1GeV = 1.f/Config::track1GeVradius;
-
-  std::vector<int>    nHits(ns);
-  std::vector<int>    charge(ns);
-  std::vector<float>  oldPhi(ns);
-  std::vector<float>  pos2(ns);
-  std::vector<float>  eta(ns);
-  std::vector<float>  theta(ns);
-  std::vector<float>  invptq(ns);
-  std::vector<float>  pt(ns);
-  std::vector<float>  x(ns);
-  std::vector<float>  y(ns);
-  std::vector<float>  z(ns);
-
-  for(int ts=0; ts<ns; ts++){
-    const Track & tk = seeds[ts];
-    nHits[ts] = tk.nFoundHits();
-    charge[ts] = tk.charge();
-    oldPhi[ts] = tk.momPhi();
-    pos2[ts] = std::pow(tk.x(), 2) + std::pow(tk.y(), 2);
-    eta[ts] = tk.momEta();
-    theta[ts] = std::atan2(tk.pT(),tk.pz());
-    invptq[ts] = tk.charge()*tk.invpT();
-    pt[ts] = tk.pT();
-    x[ts] = tk.x();
-    y[ts] = tk.y();
-    z[ts] = tk.z();
+  {
+    std::lock_guard<std::mutex> printlock(Event::printmutex);
+    std::cout << "before seed cleaning "<< seeds.size()<<std::endl;
   }
 
-  for(int ts=0; ts<ns; ts++){
-
-    if (not writetrack[ts]) continue;//FIXME: this speed up prevents transitive masking; check build cost!
-
-    const float oldPhi1 = oldPhi[ts];
-    const float pos2_first = pos2[ts];
-    const float Eta1 = eta[ts];
-    const float Pt1 = pt[ts];
-    const float invptq_first = invptq[ts];
-
-    //#pragma simd /* Vectorization via simd had issues with icc */
-    for (int tss= ts+1; tss<ns; tss++){
-
-      const float Pt2 = pt[tss];
-
-      ////// Always require charge consistency. If different charge is assigned, do not remove seed-track
-      if(charge[tss] != charge[ts])
-        continue;
-
-      const float thisDPt = std::abs(Pt2-Pt1);
-      ////// Require pT consistency between seeds. If dpT is large, do not remove seed-track.
-      ////// Adaptive thresholds, based on pT of reference seed-track (choice is a compromise between efficiency and duplicate rate):
-      ////// - 2.5% if track is barrel and w/ pT<2 GeV
-      ////// - 1.25% if track is non-barrel and w/ pT<2 GeV
-      ////// - 10% if track w/ 2<pT<5 GeV
-      ////// - 20% if track w/ 5<pT<10 GeV
-      ////// - 25% if track w/ pT>10 GeV
-      if(thisDPt>dpt_brl_0*(Pt1) && Pt1<ptmax_0 && std::abs(Eta1)<etamax_brl)
-        continue;
-
-      else if(thisDPt>dpt_ec_0*(Pt1) && Pt1<ptmax_0 && std::abs(Eta1)>etamax_brl)
-        continue;
-
-      else if(thisDPt>dpt_1*(Pt1) && Pt1>ptmax_0 && Pt1<ptmax_1)
-        continue;
+  SeedCleaningData data(seeds);
 
-      else if(thisDPt>dpt_2*(Pt1) && Pt1>ptmax_1 && Pt1<ptmax_2)
-        continue;
-
-      else if(thisDPt>dpt_3*(Pt1) && Pt1>ptmax_2)
-        continue;
-
-
-      const float Eta2 = eta[tss];
-      const float deta2 = std::pow(Eta1-Eta2, 2);
-
-      const float oldPhi2 = oldPhi[tss];
-
-      const float pos2_second = pos2[tss];
-      const float thisDXYSign05 = pos2_second > pos2_first ? -0.5f : 0.5f;
-
-      const float thisDXY = thisDXYSign05*sqrt( std::pow(x[ts]-x[tss], 2) + std::pow(y[ts]-y[tss], 2) );
-
-      const float invptq_second = invptq[tss];
-
-      const float newPhi1 = oldPhi1-thisDXY*invR1GeV*invptq_first;
-      const float newPhi2 = oldPhi2+thisDXY*invR1GeV*invptq_second;
-
-      const float dphi = cdist(std::abs(newPhi1-newPhi2));
-
-      const float dr2 = deta2+dphi*dphi;
-
-      const float thisDZ = z[ts]-z[tss]-thisDXY*(1.f/std::tan(theta[ts])+1.f/std::tan(theta[tss]));
-      const float dz2 = thisDZ*thisDZ;
-
-      ////// Reject tracks within dR-dz elliptical window.
-      ////// Adaptive thresholds, based on observation that duplicates are more abundant at large pseudo-rapidity and low track pT
-      if(std::abs(Eta1)<etamax_brl){
-        if(Pt1>ptmin_hpt){if(dz2/dzmax2_bh+dr2/drmax2_bh<1.0f) writetrack[tss]=false; }
-        else{if(dz2/dzmax2_bl+dr2/drmax2_bl<1.0f) writetrack[tss]=false; }
-      }
-      else {
-      	if(Pt1>ptmin_hpt){if(dz2/dzmax2_eh+dr2/drmax2_eh<1.0f) writetrack[tss]=false; }
-        else{if(dz2/dzmax2_el+dr2/drmax2_el<1.0f) writetrack[tss]=false; } 
-      }
+  ////// Adaptive dR-dz window thresholds, based on observation that duplicates are more abundant at large pseudo-rapidity and low track pT
+  for (int ts = 0; ts < data.n; ts++)
+  {
+    const bool hpt = data.pt[ts]>ptmin_hpt;
+    if (std::abs(data.eta[ts])<etamax_brl)
+    {
+      if (hpt) { data.dzmax2[ts] = dzmax2_bh; data.drmax2[ts] = drmax2_bh; }
+      else     { data.dzmax2[ts] = dzmax2_bl; data.drmax2[ts] = drmax2_bl; }
+    }
+    else
+    {
+      if (hpt) { data.dzmax2[ts] = dzmax2_eh; data.drmax2[ts] = drmax2_eh; }
+      else     { data.dzmax2[ts] = dzmax2_el; data.drmax2[ts] = drmax2_el; }
     }
-
-    if(writetrack[ts])
-      cleanSeedTracks.emplace_back(seeds[ts]);
-
   }
 
-  seeds.swap(cleanSeedTracks);
+  clean_seeds(seeds, data);
 
-#ifdef DEBUG
   {
-    const int ns2 = seeds.size();
-    printf("Number of CMS seeds before %d --> after %d cleaning\n", ns, ns2);
-
-    for (int it = 0; it < ns2; it++)
-    {
-      const Track& ss = seeds[it];
-      printf("  %3i q=%+i pT=%7.3f eta=% 7.3f nHits=%i label=% i\n",
-             it,ss.charge(),ss.pT(),ss.momEta(),ss.nFoundHits(),ss.label());
-    }
+    std::lock_guard<std::mutex> printlock(Event::printmutex);
+    std::cout << "AFTER seed cleaning "<< seeds.size()<<std::endl;
   }
-#endif
-  
-  std::cout << "AFTER seed cleaning "<< seeds.size()<<std::endl;
 
   return seeds.size();
 }
@@ -1010,7 +1372,7 @@ void Event::fill_hitmask_bool_vectors(int track_algo,
 
   for (int l = 0; l < n_lay; ++l)
   {
-    const int n_hit = (int) layerHits_[l].size();
+    const int n_hit = (int) layerHitMasks_[l].size();
     layer_masks[l].resize(n_hit);
 
     for (int i = 0; i < n_hit; ++i)
@@ -1035,7 +1397,7 @@ void Event::fill_hitmask_bool_vectors(std::vector<int> &track_algo_vec,
 
   for (int l = 0; l < n_lay; ++l)
   {
-    const int n_hit = (int) layerHits_[l].size();
+    const int n_hit = (int) layerHitMasks_[l].size();
     layer_masks[l].resize(n_hit);
 
     for (int i = 0; i < n_hit; ++i)
@@ -1051,10 +1413,10 @@ void Event::fill_hitmask_bool_vectors(std::vector<int> &track_algo_vec,
 // DataFile
 //==============================================================================
 
-int DataFile::OpenRead(const std::string& fname, bool set_n_layers)
+int DataFile::OpenRead(const std::string& fname, bool set_n_layers, bool use_mmap)
 {
   constexpr int min_ver = 4;
-  constexpr int max_ver = 5;
+  constexpr int max_ver = 6;
 
   f_fp = fopen(fname.c_str(), "r");
   assert (f_fp != 0 && "Opening of input file failed.");
@@ -1072,10 +1434,10 @@ int DataFile::OpenRead(const std::string& fname, bool set_n_layers)
             f_header.f_format_version, min_ver, max_ver);
     exit(1);
   }
-  if (f_header.f_sizeof_track != sizeof(Track))
+  if (f_header.f_sizeof_track != sizeof(TrackFileRecord))
   {
     fprintf(stderr, "sizeof(Track) on file (%d) different from current value (%d).\n",
-            f_header.f_sizeof_track, (int) sizeof(Track));
+            f_header.f_sizeof_track, (int) sizeof(TrackFileRecord));
     exit(1);
   }
   if (f_header.f_sizeof_hit != sizeof(Hit))
@@ -1109,6 +1471,9 @@ int DataFile::OpenRead(const std::string& fname, bool set_n_layers)
     if (f_header.f_extra_sections & ES_SimTrackStates) printf(" SimTrackStates");
     if (f_header.f_extra_sections & ES_Seeds)          printf(" Seeds");
     if (f_header.f_extra_sections & ES_CmsswTracks)    printf(" CmsswTracks");
+    if (f_header.f_extra_sections & ES_HitIterMasks)   printf(" HitIterMasks");
+    if (f_header.f_extra_sections & ES_EventIndex)     printf(" EventIndex");
+    if (f_header.f_extra_sections & ES_CompressedHits) printf(" CompressedHits");
     printf("\n");
   }
 
@@ -1122,9 +1487,113 @@ int DataFile::OpenRead(const std::string& fname, bool set_n_layers)
     exit(1);
   }
 
+  if (HasEventIndex())
+  {
+    ReadEventIndex();
+  }
+
+  if (use_mmap)
+  {
+    struct stat st;
+    if (fstat(fileno(f_fp), &st) != 0)
+    {
+      fprintf(stderr, "Stat of input file '%s' failed.\n", fname.c_str());
+      exit(1);
+    }
+    f_map_size = st.st_size;
+
+    void *map = mmap(nullptr, f_map_size, PROT_READ, MAP_PRIVATE, fileno(f_fp), 0);
+    if (map == MAP_FAILED)
+    {
+      fprintf(stderr, "Memory mapping of input file '%s' failed.\n", fname.c_str());
+      exit(1);
+    }
+    f_map = static_cast<const char*>(map);
+
+    // The FILE is no longer needed, the mapping stays valid after close.
+    fclose(f_fp);
+    f_fp = 0;
+
+    if ( ! HasEventIndex()) BuildEventIndex();
+
+    madvise(map, f_map_size, MADV_WILLNEED);
+
+    printf("  Mapped %zu bytes, indexed %d events\n", f_map_size, (int) f_ev_offsets.size());
+  }
+
   return f_header.f_n_events;
 }
 
+void DataFile::ReadEventIndex()
+{
+  DataFileIndexTrailer trl;
+
+  fseek(f_fp, -(long) sizeof(DataFileIndexTrailer), SEEK_END);
+  fread(&trl, sizeof(DataFileIndexTrailer), 1, f_fp);
+  if (trl.f_magic != DataFileIndexTrailer().f_magic || trl.f_n_entries < 0)
+  {
+    fprintf(stderr, "Corrupt event index trailer (magic=0x%x, n_entries=%d).\n",
+            trl.f_magic, trl.f_n_entries);
+    exit(1);
+  }
+
+  f_ev_offsets.resize(trl.f_n_entries);
+  fseek(f_fp, trl.f_index_pos, SEEK_SET);
+  fread(f_ev_offsets.data(), sizeof(long), trl.f_n_entries, f_fp);
+
+  f_next_ev = 0;
+}
+
+void DataFile::BuildEventIndex()
+{
+  // Walk the chain of evsize integers once; this only touches one int per event.
+
+  f_ev_offsets.clear();
+  f_ev_offsets.reserve(std::max(f_header.f_n_events, 0));
+
+  long pos = sizeof(DataFileHeader);
+  while (pos + (long) sizeof(int) <= (long) f_map_size &&
+         (f_header.f_n_events < 0 || (int) f_ev_offsets.size() < f_header.f_n_events))
+  {
+    int evsize;
+    memcpy(&evsize, f_map + pos, sizeof(int));
+    if (evsize < (int) sizeof(int) || pos + evsize > (long) f_map_size)
+    {
+      fprintf(stderr, "Corrupt event %d at offset %ld (evsize=%d).\n",
+              (int) f_ev_offsets.size(), pos, evsize);
+      exit(1);
+    }
+    f_ev_offsets.push_back(pos);
+    pos += evsize;
+  }
+
+  f_next_ev = 0;
+}
+
+int DataFile::ClaimNextEventIndex()
+{
+  const int n_ev = f_ev_offsets.size();
+
+  int iev = f_next_ev++;
+  if (Config::loopOverFile)
+  {
+    // Wrap around to the beginning of the file.
+    iev %= n_ev;
+  }
+  else if (iev >= n_ev)
+  {
+    fprintf(stderr, "Requested event %d, only %d events on file.\n", iev, n_ev);
+    exit(1);
+  }
+
+  return iev;
+}
+
+const char* DataFile::ClaimNextEvent()
+{
+  return f_map + f_ev_offsets[ClaimNextEventIndex()] + sizeof(int);
+}
+
 void DataFile::OpenWrite(const std::string& fname, int nev, int extra_sections)
 {
   f_fp = fopen(fname.c_str(), "w");
@@ -1140,6 +1609,14 @@ int DataFile::AdvancePosToNextEvent(FILE *fp)
 {
   int evsize;
 
+  if ( ! f_ev_offsets.empty())
+  {
+    // Random access through the event index, each thread has its own fp.
+    fseek(fp, f_ev_offsets[ClaimNextEventIndex()], SEEK_SET);
+    fread(&evsize, sizeof(int), 1, fp);
+    return evsize;
+  }
+
   std::lock_guard<std::mutex> readlock(f_next_ev_mutex);
 
   fseek(fp, f_pos, SEEK_SET);
@@ -1160,6 +1637,12 @@ int DataFile::AdvancePosToNextEvent(FILE *fp)
 
 void DataFile::SkipNEvents(int n_to_skip)
 {
+  if ( ! f_ev_offsets.empty())
+  {
+    f_next_ev += n_to_skip;
+    return;
+  }
+
   int evsize;
 
   std::lock_guard<std::mutex> readlock(f_next_ev_mutex);
@@ -1174,12 +1657,32 @@ void DataFile::SkipNEvents(int n_to_skip)
 
 void DataFile::Close()
 {
-  fclose(f_fp);
-  f_fp = 0;
+  if (f_fp)
+  {
+    fclose(f_fp);
+    f_fp = 0;
+  }
+  if (f_map)
+  {
+    munmap(const_cast<char*>(f_map), f_map_size);
+    f_map = nullptr;
+    f_map_size = 0;
+  }
+  f_ev_offsets.clear();
+  f_next_ev = 0;
   f_header = DataFileHeader();
 }
 
 void DataFile::CloseWrite(int n_written){
+  if (HasEventIndex())
+  {
+    fseek(f_fp, 0, SEEK_END);
+    DataFileIndexTrailer trl;
+    trl.f_index_pos = ftell(f_fp);
+    trl.f_n_entries = f_ev_offsets.size();
+    fwrite(f_ev_offsets.data(), sizeof(long), f_ev_offsets.size(), f_fp);
+    fwrite(&trl, sizeof(DataFileIndexTrailer), 1, f_fp);
+  }
   if (f_header.f_n_events != n_written){
     fseek(f_fp, 0, SEEK_SET);
     f_header.f_n_events = n_written;
@@ -5,6 +5,7 @@
 #include "Validation.h"
 #include "Config.h"
 #include "mkFit/SteeringParams.h"
+#include <atomic>
 #include <mutex>
 
 namespace mkfit {
@@ -28,6 +29,16 @@ public:
   void read_in  (DataFile &data_file, FILE *in_fp=0);
   int  write_tracks(FILE *fp, const TrackVec& tracks);
   int  read_tracks (FILE *fp,       TrackVec& tracks, bool skip_reading = false);
+  int  read_tracks (const char *&ptr, TrackVec& tracks, bool skip_reading = false);
+
+  static bool requires_hit_vectors();
+
+  // Read-only view of hits in layer l. Points into the memory-mapped input file
+  // when hits were not copied into layerHits_ (see read_in_mapped()).
+  HitSpan layer_hits(int l) const
+  {
+    return layerHitSpans_.empty() ? HitSpan(layerHits_[l]) : layerHitSpans_[l];
+  }
 
   void setInputFromCMSSW(std::vector<HitVec> hits, TrackVec seeds);
 
@@ -51,10 +62,14 @@ public:
   Validation& validation_;
 
 private:
+  void        read_in_mapped(DataFile &data_file);
+  const char* read_compressed_layer(const DataFile &data_file, int il, int nh, const char *block);
+
   int  evtID_;
 
 public:
   std::vector<HitVec> layerHits_;
+  std::vector<HitSpan> layerHitSpans_; // only set for zero-copy reads from a mapped file
   std::vector<std::vector<uint64_t> > layerHitMasks_;//aligned with layerHits_
   MCHitInfoVec simHitsInfo_;
 
@@ -71,11 +86,19 @@ public:
 typedef std::vector<Event> EventVec;
 
 
+// Layout of Track records in data files: TrackBase padded to the size of a
+// Track with hits in std::vector. Hits of all tracks follow the track array.
+// Equal to Track unless built with TRACK_INLINE_HOTS.
+struct TrackFileRecord : public TrackBase
+{
+  std::vector<HitOnTrack> m_hots_unused;
+};
+
 struct DataFileHeader
 {
   int f_magic          = 0xBEEF;
-  int f_format_version = 5;
-  int f_sizeof_track   = sizeof(Track);
+  int f_format_version = 6;
+  int f_sizeof_track   = sizeof(TrackFileRecord);
   int f_sizeof_hit     = sizeof(Hit);
   int f_sizeof_hot     = sizeof(HitOnTrack);
   int f_n_layers       = -1;
@@ -89,6 +112,15 @@ struct DataFileHeader
   }
 };
 
+// Written at the very end of files with ES_EventIndex (format version >= 6).
+// The event offset table, f_n_entries longs, starts at f_index_pos.
+struct DataFileIndexTrailer
+{
+  long f_index_pos = -1;
+  int  f_n_entries =  0;
+  int  f_magic     = 0xFEED;
+};
+
 struct DataFile
 {
   enum ExtraSection
@@ -96,7 +128,9 @@ struct DataFile
     ES_SimTrackStates = 0x1,
     ES_Seeds          = 0x2,
     ES_CmsswTracks    = 0x4,
-    ES_HitIterMasks   = 0x8
+    ES_HitIterMasks   = 0x8,
+    ES_EventIndex     = 0x10,
+    ES_CompressedHits = 0x20  // hits and masks stored per layer with compress_hits()
   };
 
   FILE *f_fp  =  0;
@@ -106,18 +140,37 @@ struct DataFile
 
   std::mutex     f_next_ev_mutex;
 
+  // Event offsets, read from the trailing index table or, for mapped files
+  // without one, built on open. When available, events are claimed with an
+  // atomic counter and no locking. On write, collected for the index table.
+  std::vector<long> f_ev_offsets;
+  std::atomic<int>  f_next_ev {0};
+
+  // Memory-mapped reading.
+  const char       *f_map      = nullptr;
+  size_t            f_map_size = 0;
+
   // ----------------------------------------------------------------
 
   bool HasSimTrackStates() const { return f_header.f_extra_sections & ES_SimTrackStates; }
   bool HasSeeds()          const { return f_header.f_extra_sections & ES_Seeds; }
   bool HasCmsswTracks()    const { return f_header.f_extra_sections & ES_CmsswTracks; }
   bool HasHitIterMasks()   const { return f_header.f_extra_sections & ES_HitIterMasks; }
+  bool HasEventIndex()     const { return f_header.f_extra_sections & ES_EventIndex; }
+  bool HasCompressedHits() const { return f_header.f_extra_sections & ES_CompressedHits; }
+
+  bool IsMapped()          const { return f_map != nullptr; }
 
-  int  OpenRead (const std::string& fname, bool set_n_layers = false);
+  int  OpenRead (const std::string& fname, bool set_n_layers = false, bool use_mmap = false);
   void OpenWrite(const std::string& fname, int nev, int extra_sections=0);
 
   int  AdvancePosToNextEvent(FILE *fp);
 
+  void        ReadEventIndex();
+  void        BuildEventIndex();
+  int         ClaimNextEventIndex();
+  const char* ClaimNextEvent(); // returns pointer to event data, just after evsize
+
   void SkipNEvents(int n_to_skip);
 
   void Close();
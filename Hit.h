@@ -303,6 +303,28 @@ private:
 };
 
 typedef std::vector<Hit> HitVec;
+
+// Non-owning, read-only view of a contiguous array of hits. Points either
+// into a HitVec or directly into a memory-mapped input file (see DataFile).
+struct HitSpan
+{
+  const Hit *m_hits = nullptr;
+  int        m_size = 0;
+
+  HitSpan() {}
+  HitSpan(const Hit *hits, int size) : m_hits(hits), m_size(size) {}
+  HitSpan(const HitVec &hitv) : m_hits(hitv.data()), m_size(hitv.size()) {}
+
+  int  size()  const { return m_size; }
+  bool empty() const { return m_size == 0; }
+
+  const Hit* data()  const { return m_hits; }
+  const Hit* begin() const { return m_hits; }
+  const Hit* end()   const { return m_hits + m_size; }
+
+  const Hit& operator[](int i) const { return m_hits[i]; }
+};
+
 typedef std::map<int,std::map<int,std::vector<int> > > LayIdxIDVecMapMap;
 typedef std::map<int, std::unordered_set<int> > TrkIDLaySetMap;
 typedef std::array<int,2>    PairIdx;
@@ -0,0 +1,262 @@
+#include "HitCompression.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace mkfit {
+
+namespace
+{
+  constexpr int kWordsPerHit  = sizeof(Hit) / sizeof(uint32_t);
+  constexpr int kWordsPerMask = sizeof(uint64_t) / sizeof(uint32_t);
+
+  static_assert(sizeof(Hit) % sizeof(uint32_t) == 0, "Hit must consist of 32-bit words.");
+
+  constexpr int kMinMatch   = 4;
+  constexpr int kMaxOffset  = 0xffff;
+  constexpr int kHashBits   = 12;
+
+  inline uint32_t read32(const uint8_t *p) { uint32_t v; memcpy(&v, p, 4); return v; }
+
+  inline int hash32(uint32_t v) { return (v * 2654435761u) >> (32 - kHashBits); }
+
+  //----------------------------------------------------------------------------
+  // Columns <-> byte planes, with delta coding along each column.
+  //----------------------------------------------------------------------------
+
+  // Rows are row_stride 32-bit words apart; words are accessed with memcpy as
+  // they are floats as well as ints.
+
+  void pack_columns(const char *rows, int n_rows, int n_cols, int col_off, int row_stride,
+                    uint8_t *planes)
+  {
+    // planes holds 4 byte planes of n_rows bytes for each column, the first
+    // one written here is column col_off.
+    for (int c = 0; c < n_cols; ++c)
+    {
+      uint8_t *pl = planes + (size_t) (col_off + c) * 4 * n_rows;
+      uint32_t prev = 0;
+      for (int r = 0; r < n_rows; ++r)
+      {
+        uint32_t w;
+        memcpy(&w, rows + ((size_t) r * row_stride + c) * sizeof(uint32_t), sizeof(uint32_t));
+        const uint32_t d = w - prev;
+        prev = w;
+        pl[r]              = d;
+        pl[r +     n_rows] = d >> 8;
+        pl[r + 2 * n_rows] = d >> 16;
+        pl[r + 3 * n_rows] = d >> 24;
+      }
+    }
+  }
+
+  void unpack_columns(const uint8_t *planes, int n_rows, int n_cols, int col_off, int row_stride,
+                      char *rows)
+  {
+    for (int c = 0; c < n_cols; ++c)
+    {
+      const uint8_t *pl = planes + (size_t) (col_off + c) * 4 * n_rows;
+      uint32_t prev = 0;
+      for (int r = 0; r < n_rows; ++r)
+      {
+        const uint32_t d = (uint32_t) pl[r]                     |
+                           (uint32_t) pl[r +     n_rows] <<  8  |
+                           (uint32_t) pl[r + 2 * n_rows] << 16  |
+                           (uint32_t) pl[r + 3 * n_rows] << 24;
+        prev += d;
+        memcpy(rows + ((size_t) r * row_stride + c) * sizeof(uint32_t), &prev, sizeof(uint32_t));
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // LZ77 block coder.
+  //----------------------------------------------------------------------------
+
+  void put_length(std::vector<char> &out, int len)
+  {
+    while (len >= 255) { out.push_back((char) 255); len -= 255; }
+    out.push_back((char) len);
+  }
+
+  void put_sequence(std::vector<char> &out, const uint8_t *lit, int n_lit, int offset, int match_len)
+  {
+    const int ml = match_len > 0 ? match_len - kMinMatch : 0;
+
+    out.push_back((char) ((std::min(n_lit, 15) << 4) | std::min(ml, 15)));
+    if (n_lit >= 15) put_length(out, n_lit - 15);
+    out.insert(out.end(), lit, lit + n_lit);
+    if (match_len > 0)
+    {
+      out.push_back((char) (offset & 0xff));
+      out.push_back((char) (offset >> 8));
+      if (ml >= 15) put_length(out, ml - 15);
+    }
+  }
+
+  void lz_compress(const uint8_t *in, int n, std::vector<char> &out)
+  {
+    int table[1 << kHashBits];
+    std::fill(table, table + (1 << kHashBits), -1);
+
+    int anchor = 0, i = 0;
+    while (i + kMinMatch <= n)
+    {
+      const uint32_t seq = read32(in + i);
+      const int h   = hash32(seq);
+      const int ref = table[h];
+      table[h] = i;
+
+      if (ref >= 0 && i - ref <= kMaxOffset && read32(in + ref) == seq)
+      {
+        int len = kMinMatch;
+        while (i + len < n && in[ref + len] == in[i + len]) ++len;
+
+        put_sequence(out, in + anchor, i - anchor, i - ref, len);
+        i += len;
+        anchor = i;
+      }
+      else
+      {
+        ++i;
+      }
+    }
+    // Last sequence carries only literals; the decoder stops when its output is full.
+    put_sequence(out, in + anchor, n - anchor, 0, 0);
+  }
+
+  // Returns -1 if the input ends within the length or the length is absurd.
+  int get_length(const uint8_t *&ip, const uint8_t *ip_end)
+  {
+    int len = 0, b;
+    do
+    {
+      if (ip == ip_end || len > (1 << 30)) return -1;
+      b = *ip++;
+      len += b;
+    } while (b == 255);
+    return len;
+  }
+
+  // Lengths and offsets come from the file; they are checked against the
+  // remaining input and output before use.
+  void lz_decompress(const uint8_t *ip, const uint8_t *ip_end, uint8_t *out, int n)
+  {
+    uint8_t *op = out, *op_end = out + n;
+
+    while (ip < ip_end)
+    {
+      const int token = *ip++;
+
+      int n_lit = token >> 4;
+      if (n_lit == 15)
+      {
+        const int ext = get_length(ip, ip_end);
+        if (ext < 0) break;
+        n_lit += ext;
+      }
+      if (n_lit > op_end - op || n_lit > ip_end - ip) break;
+      memcpy(op, ip, n_lit);
+      op += n_lit;
+      ip += n_lit;
+
+      if (op == op_end) return;
+
+      if (ip_end - ip < 2) break;
+      const int offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      int len = token & 0xf;
+      if (len == 15)
+      {
+        const int ext = get_length(ip, ip_end);
+        if (ext < 0) break;
+        len += ext;
+      }
+      len += kMinMatch;
+      if (offset == 0 || offset > op - out || len > op_end - op) break;
+
+      // Matches may overlap their source, copy byte by byte.
+      const uint8_t *mp = op - offset;
+      for (int k = 0; k < len; ++k) op[k] = mp[k];
+      op += len;
+    }
+
+    if (op != op_end)
+    {
+      fprintf(stderr, "Corrupt compressed hit block (decoded %d of %d bytes).\n",
+              (int) (op - out), n);
+      exit(1);
+    }
+  }
+}
+
+//==============================================================================
+
+int compress_hits(const Hit *hits, const uint64_t *masks, int n_hits, std::vector<char> &buf)
+{
+  const int n_cols = kWordsPerHit + (masks ? kWordsPerMask : 0);
+
+  std::vector<uint8_t> planes((size_t) n_cols * 4 * n_hits);
+
+  pack_columns(reinterpret_cast<const char*>(hits), n_hits, kWordsPerHit, 0, kWordsPerHit, planes.data());
+  if (masks)
+  {
+    pack_columns(reinterpret_cast<const char*>(masks), n_hits, kWordsPerMask, kWordsPerHit, kWordsPerMask,
+                 planes.data());
+  }
+
+  const size_t start = buf.size();
+  buf.resize(start + sizeof(int));
+
+  lz_compress(planes.data(), planes.size(), buf);
+
+  int packed_size = buf.size() - start - sizeof(int);
+  memcpy(&buf[start], &packed_size, sizeof(int));
+
+  buf.resize(start + compressed_block_size(&buf[start]), 0);
+
+  return buf.size() - start;
+}
+
+const char* decompress_hits(const char *in, Hit *hits, uint64_t *masks, int n_hits)
+{
+  const int n_cols = kWordsPerHit + (masks ? kWordsPerMask : 0);
+
+  int packed_size;
+  memcpy(&packed_size, in, sizeof(int));
+  compressed_block_size(in); // checks packed_size
+
+  const uint8_t *ip = reinterpret_cast<const uint8_t*>(in + sizeof(int));
+
+  static thread_local std::vector<uint8_t> planes;
+  planes.resize((size_t) n_cols * 4 * n_hits);
+
+  lz_decompress(ip, ip + packed_size, planes.data(), planes.size());
+
+  unpack_columns(planes.data(), n_hits, kWordsPerHit, 0, kWordsPerHit, reinterpret_cast<char*>(hits));
+  if (masks)
+  {
+    unpack_columns(planes.data(), n_hits, kWordsPerMask, kWordsPerHit, kWordsPerMask,
+                   reinterpret_cast<char*>(masks));
+  }
+
+  return in + compressed_block_size(in);
+}
+
+int compressed_block_size(const char *in)
+{
+  int packed_size;
+  memcpy(&packed_size, in, sizeof(int));
+
+  if (packed_size < 0 || packed_size > (1 << 30))
+  {
+    fprintf(stderr, "Corrupt compressed hit block (packed size %d).\n", packed_size);
+    exit(1);
+  }
+
+  return sizeof(int) + (packed_size + sizeof(int) - 1) / sizeof(int) * sizeof(int);
+}
+
+} // end namespace mkfit
@@ -0,0 +1,34 @@
+#ifndef _hitcompression_
+#define _hitcompression_
+
+#include "Hit.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace mkfit {
+
+//==============================================================================
+// Column-wise compression of per-layer hits for DataFile::ES_CompressedHits.
+//
+// Hits (and optionally their uint64_t iteration masks) are viewed as columns
+// of 32-bit words. Each column is delta coded against the previous hit and
+// split into byte planes; the result is compressed with a small LZ77 coder
+// using an LZ4-like sequence format (token, literals, 16-bit offset).
+//
+// On file a layer block is: int packed_size, followed by packed_size bytes,
+// padded to a multiple of sizeof(int). Number of hits is stored by the caller.
+//==============================================================================
+
+// Appends a layer block to buf, returns number of bytes appended.
+int  compress_hits(const Hit *hits, const uint64_t *masks, int n_hits, std::vector<char> &buf);
+
+// Decodes a layer block starting at in into hits (and masks, if not null),
+// both sized for n_hits. Returns pointer just past the block.
+const char* decompress_hits(const char *in, Hit *hits, uint64_t *masks, int n_hits);
+
+// Size of the layer block starting at in, including the size word and padding.
+int  compressed_block_size(const char *in);
+
+} // end namespace mkfit
+#endif
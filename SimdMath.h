@@ -0,0 +1,234 @@
+#ifndef _simd_math_
+#define _simd_math_
+
+// Branch-free float versions of the transcendental functions used in
+// Matriplex kernels. Everything is inline and written with selects, integer
+// bit manipulation and polynomials only, so '#pragma omp simd' loops calling
+// these vectorize. Calls to std::sin / std::atan2 / std::log / std::hypot
+// would compile to scalar libm calls; gcc only uses vector libm (libmvec)
+// with -ffast-math.
+//
+// Each function takes the accuracy level as template parameter:
+//   MA_Full   - within a few ulp of libm, default, use where results must
+//               not change noticeably;
+//   MA_Medium - shorter polynomials, errors below ~5e-6;
+//   MA_Fast   - shortest polynomials / one Newton step, errors of 1e-5 to
+//               2e-3, for window sizes and such.
+// Maximum errors measured against double precision libm, see
+// test/simdmath_check.cxx:
+//
+//                  Full       Medium     Fast
+//   sin, cos     1.0e-7 a   1.6e-6 a   4.5e-4 a    |x| < 1e4
+//   atan2, atan  3.0e-7 a   5.0e-7 a   1.0e-5 a
+//   log          1.0e-7 m   5.0e-7 m   3.0e-5 m    normal x > 0
+//   rsqrt        1.0e-7 r   5.0e-6 r   1.8e-3 r    normal x > 0
+//   eta(r, z)    2.5e-7 m   6.0e-7 m   3.0e-5 m
+//
+// (a - absolute, r - relative, m - absolute below 1 and relative above.)
+// No special handling of inf, nan and denormals; log of zero or negative
+// numbers is undefined.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+namespace mkfit {
+namespace smath {
+
+enum MathAccuracy { MA_Fast, MA_Medium, MA_Full };
+
+//------------------------------------------------------------------------------
+// Helpers
+//------------------------------------------------------------------------------
+
+inline float   as_float(int32_t i) { float   f; std::memcpy(&f, &i, sizeof(f)); return f; }
+inline int32_t as_int  (float   f) { int32_t i; std::memcpy(&i, &f, sizeof(i)); return i; }
+
+// Bitwise select, c ? a : b. Both a and b are evaluated; gcc does not
+// if-convert a plain ?: whose operand is a floating point operation that
+// might trap (it gets sunk into a branch), which stops vectorization. Make
+// the operands of the side not taken safe first, e.g. divide by
+// select(c, x, 1.f), so that no FP exceptions are raised on such lanes.
+inline float select(const bool c, const float a, const float b)
+{
+  const int32_t m = -(int32_t) c;
+  return as_float((as_int(a) & m) | (as_int(b) & ~m));
+}
+
+// Round to nearest integer, valid for |x| < 2^22.
+inline float round_near(const float x)
+{
+  const float magic = 12582912.f; // 1.5 * 2^23
+  return (x + magic) - magic;
+}
+
+//------------------------------------------------------------------------------
+// sincos
+//------------------------------------------------------------------------------
+
+// Reduction to [-pi/4, pi/4] by multiples of pi/2 (Cody-Waite, three part
+// pi/2), then polynomials for sin and cos with quadrant selects.
+
+template<int A = MA_Full>
+inline void sincos(const float x, float& s, float& c)
+{
+  const float j = round_near(x * 0.63661977f); // 2/pi
+  const int   q = (int) j;
+
+  const float r  = ((x - j * 1.5703125f) - j * 4.837512969970703125e-4f) - j * 7.54978995489188216e-8f;
+  const float r2 = r * r;
+
+  float sr, cr;
+  if (A == MA_Full)
+  {
+    sr = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+    cr = 1.f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+  }
+  else if (A == MA_Medium)
+  {
+    sr = r + r * r2 * (-1.6663458542e-1f + r2 * 8.1646088910e-3f);
+    cr = 1.f - 0.5f * r2 + r2 * r2 * (4.1661278581e-2f + r2 * -1.3652449422e-3f);
+  }
+  else
+  {
+    sr = r + r * r2 * -1.6246492052e-1f;
+    cr = 1.f + r2 * (-4.9977630756e-1f + r2 * 4.0488936815e-2f);
+  }
+
+  const bool swap = q & 1;
+  s = swap ? cr : sr;
+  c = swap ? sr : cr;
+  s = (q & 2)       ? -s : s;
+  c = ((q + 1) & 2) ? -c : c;
+}
+
+//------------------------------------------------------------------------------
+// atan2, atan
+//------------------------------------------------------------------------------
+
+// atan(t) for t in [0, 1]: reduction to [0, tan(pi/8)], odd polynomial.
+template<int A>
+inline float atan_unit(const float t)
+{
+  const bool  big = t > 0.41421356f; // tan(pi/8)
+  const float z   = select(big, (t - 1.f) / (t + 1.f), t);
+
+  const float z2 = z * z;
+  float p;
+  if (A == MA_Full)
+    p = -3.33329491539e-1f + z2 * (1.99777106478e-1f + z2 * (-1.38776856032e-1f + z2 * 8.05374449538e-2f));
+  else if (A == MA_Medium)
+    p = -3.3325614972e-1f + z2 * (1.9716159168e-1f + z2 * -1.1233591442e-1f);
+  else
+    p = -3.3184909899e-1f + z2 * 1.7044936443e-1f;
+
+  return z + z * z2 * p + (big ? 0.78539816f : 0.f);
+}
+
+// Ratio of min/max magnitudes to [0, 1], then octant corrections.
+template<int A = MA_Full>
+inline float atan2(const float y, const float x)
+{
+  const float ax = std::abs(x), ay = std::abs(y);
+  const float mx = std::max(ax, ay), mn = std::min(ax, ay);
+
+  // Not std::max(mx, tiny): gcc duplicates the division into both of its
+  // branches.
+  float a = atan_unit<A>(mn / (mx + 1e-37f));
+  a = select(ay > ax, 1.57079633f - a, a);
+  a = select(x < 0.f, 3.14159265f - a, a);
+  return std::copysign(a, y);
+}
+
+// Not as atan2(x, 1): with a constant argument gcc turns the min/max of
+// atan2 into branches.
+template<int A = MA_Full>
+inline float atan(const float x)
+{
+  const float ax  = std::abs(x);
+  const bool  inv = ax > 1.f;
+  float a = atan_unit<A>(select(inv, 1.f / select(inv, ax, 1.f), ax));
+  a = select(inv, 1.57079633f - a, a);
+  return std::copysign(a, x);
+}
+
+//------------------------------------------------------------------------------
+// hypot, rsqrt
+//------------------------------------------------------------------------------
+
+// No protection against overflow, unlike std::hypot(); fine for coordinates.
+inline float hypot(const float x, const float y)
+{
+  return std::sqrt(x * x + y * y);
+}
+
+template<int A = MA_Full>
+inline float rsqrt(const float x)
+{
+  if (A == MA_Full) return 1.f / std::sqrt(x);
+
+  float y = as_float(0x5f375a86 - (as_int(x) >> 1));
+  y = y * (1.5f - 0.5f * x * y * y);
+  if (A == MA_Medium)
+    y = y * (1.5f - 0.5f * x * y * y);
+  return y;
+}
+
+//------------------------------------------------------------------------------
+// log, eta
+//------------------------------------------------------------------------------
+
+// x = m * 2^e with m in [sqrt(1/2), sqrt(2)), log(1 + f) with f = m - 1 from a
+// polynomial, e * log(2) added in two parts.
+
+template<int A = MA_Full>
+inline float log(const float x)
+{
+  const int32_t ix = as_int(x);
+  int   e = ((ix >> 23) & 0xff) - 126;
+  float m = as_float((ix & 0x007fffff) | 0x3f000000); // [0.5, 1)
+
+  const bool lo = m < 0.70710678f;
+  e -= lo ? 1 : 0;
+  m += lo ? m : 0.f;
+
+  const float f  = m - 1.f;
+  const float f2 = f * f;
+  float p;
+  if (A == MA_Full)
+    p = 3.3333331174e-1f + f * (-2.4999993993e-1f + f * (2.0000714765e-1f + f * (-1.6668057665e-1f + f * (1.4249322787e-1f +
+        f * (-1.2420140846e-1f + f * (1.1676998740e-1f + f * (-1.1514610310e-1f + f * 7.0376836292e-2f)))))));
+  else if (A == MA_Medium)
+    p = 3.3317432288e-1f + f * (-2.4936868151e-1f + f * (2.0493808751e-1f + f * (-1.8496899473e-1f + f * 1.1708023809e-1f)));
+  else
+    p = 3.3595900342e-1f + f * (-2.6497002505e-1f + f * 1.7188468113e-1f);
+
+  const float fe = (float) e;
+  const float y  = f * f2 * p + fe * -2.12194440e-4f - 0.5f * f2;
+  return (f + y) + fe * 0.693359375f;
+}
+
+// Pseudorapidity from transverse radius and z,
+//   eta = -log(tan(theta/2)) = sign(z) * log((|z| + sqrt(r^2 + z^2)) / r),
+// the form with |z| avoids cancellation for negative z.
+template<int A = MA_Full>
+inline float eta(const float r, const float z)
+{
+  const float e = log<A>((std::abs(z) + std::sqrt(r * r + z * z)) / r);
+  return std::copysign(e, z);
+}
+
+// Pseudorapidity from theta in (0, pi).
+template<int A = MA_Full>
+inline float eta(const float theta)
+{
+  float s, c;
+  sincos<A>(theta, s, c);
+  return eta<A>(s, c);
+}
+
+} // end namespace smath
+} // end namespace mkfit
+
+#endif
@@ -77,6 +77,7 @@ SMatrix66 TrackState::jacobianCartesianToCCS(float px,float py,float pz) const {
 // TrackBase
 //==============================================================================
 
+template<>
 bool TrackBase::hasSillyValues(bool dump, bool fix, const char* pref)
 {
   bool is_silly = false;
@@ -104,10 +105,18 @@ bool TrackBase::hasSillyValues(bool dump, bool fix, const char* pref)
 // Track
 //==============================================================================
 
-void Track::resizeHitsForInput()
+bool Track::resizeHitsForInput()
 {
+#ifdef TRACK_INLINE_HOTS
+  const bool fits = lastHitIdx_ < HoTInlineVec::s_capacity;
+  if ( ! fits) lastHitIdx_ = HoTInlineVec::s_capacity - 1;
+  hitsOnTrk_.clear();
+#else
+  const bool fits = true;
   bzero(&hitsOnTrk_, sizeof(hitsOnTrk_));
+#endif
   hitsOnTrk_.resize(lastHitIdx_ + 1);
+  return fits;
 }
 
 void Track::sortHitsByLayer()
@@ -8,6 +8,8 @@
 
 #include <vector>
 #include <map>
+#include <cassert>
+#include <cstdint>
 
 namespace mkfit {
 
@@ -71,18 +73,16 @@ typedef std::vector<ReducedTrack> RedTrackVec;
 // TrackState
 //==============================================================================
 
-struct TrackState //  possible to add same accessors as track?
+// Parameters and the accessors that only depend on them, shared by TrackState
+// and TrackStateCompact.
+struct TrackStateParams
 {
 public:
-  TrackState() : valid(true) {}
-  TrackState(int charge, const SVector3& pos, const SVector3& mom, const SMatrixSym66& err) :
-    parameters(SVector6(pos.At(0),pos.At(1),pos.At(2),mom.At(0),mom.At(1),mom.At(2))),
-    errors(err), charge(charge), valid(true) {}
+  TrackStateParams() {}
+  TrackStateParams(const SVector6& par) : parameters(par) {}
+
   SVector3 position() const {return SVector3(parameters[0],parameters[1],parameters[2]);}
   SVector6 parameters;
-  SMatrixSym66 errors;
-  short charge;
-  bool valid;
 
   // track state position
   float x()      const {return parameters.At(0);}
@@ -92,6 +92,29 @@ public:
   float posPhi() const {return getPhi  (x(),y());}
   float posEta() const {return getEta  (posR(),z());}
 
+  // track state momentum
+  float invpT()  const {return parameters.At(3);}
+  float momPhi() const {return parameters.At(4);}
+  float theta()  const {return parameters.At(5);}
+  float pT()     const {return std::abs(1.f/parameters.At(3));}
+  float px()     const {return pT()*std::cos(parameters.At(4));}
+  float py()     const {return pT()*std::sin(parameters.At(4));}
+  float pz()     const {return pT()/std::tan(parameters.At(5));}
+  float momEta() const {return getEta (theta());}
+  float p()      const {return pT()/std::sin(parameters.At(5));}
+};
+
+struct TrackState : public TrackStateParams //  possible to add same accessors as track?
+{
+public:
+  TrackState() : valid(true) {}
+  TrackState(int charge, const SVector3& pos, const SVector3& mom, const SMatrixSym66& err) :
+    TrackStateParams(SVector6(pos.At(0),pos.At(1),pos.At(2),mom.At(0),mom.At(1),mom.At(2))),
+    errors(err), charge(charge), valid(true) {}
+  SMatrixSym66 errors;
+  short charge;
+  bool valid;
+
   // track state position errors
   float exx()    const {return std::sqrt(errors.At(0,0));}
   float eyy()    const {return std::sqrt(errors.At(1,1));}
@@ -105,17 +128,6 @@ public:
   float eposEta() const {return std::sqrt(getEtaErr2(x(),y(),z(),errors.At(0,0),errors.At(1,1),errors.At(2,2),
 						     errors.At(0,1),errors.At(0,2),errors.At(1,2)));}
 
-  // track state momentum
-  float invpT()  const {return parameters.At(3);}
-  float momPhi() const {return parameters.At(4);}
-  float theta()  const {return parameters.At(5);}
-  float pT()     const {return std::abs(1.f/parameters.At(3));}
-  float px()     const {return pT()*std::cos(parameters.At(4));}
-  float py()     const {return pT()*std::sin(parameters.At(4));}
-  float pz()     const {return pT()/std::tan(parameters.At(5));}
-  float momEta() const {return getEta (theta());}
-  float p()      const {return pT()/std::sin(parameters.At(5));}
-
   float einvpT()  const {return std::sqrt(errors.At(3,3));}
   float emomPhi() const {return std::sqrt(errors.At(4,4));}
   float etheta()  const {return std::sqrt(errors.At(5,5));}
@@ -131,30 +143,139 @@ public:
   SMatrix66 jacobianCartesianToCCS(float px,float py,float pz) const;
 };
 
+//==============================================================================
+// TrackStateCompact
+//==============================================================================
+
+// Compact storage of a symmetric 6x6 covariance: the diagonal as floats and
+// the 15 correlation coefficients as 16-bit integers scaled by 32767, 56
+// instead of 84 bytes. Diagonal elements are exact, off-diagonal ones have an
+// absolute error below 1.6e-5 * sqrt(C_ii * C_jj).
+// Pack() / Unpack() take the 21 floats in SMatrixSym66 / MPlexLS order.
+
+struct CompactSym66
+{
+  float   m_diag[6];
+  int16_t m_rho[15];
+
+  static constexpr float s_scale = 32767.f;
+
+  static constexpr int Idx(int i, int j) { return i * (i + 1) / 2 + j; } // i > j
+
+  void Pack(const float *a)
+  {
+    float rsd[6];
+    for (int i = 0; i < 6; ++i)
+    {
+      m_diag[i] = a[Idx(i, i)];
+      rsd[i]    = m_diag[i] > 0.f ? 1.f / std::sqrt(m_diag[i]) : 0.f;
+    }
+    for (int i = 1, k = 0; i < 6; ++i)
+    {
+      for (int j = 0; j < i; ++j, ++k)
+      {
+        const float rho = std::min(std::max(a[Idx(i, j)] * rsd[i] * rsd[j], -1.f), 1.f);
+        m_rho[k] = (int16_t) std::round(rho * s_scale);
+      }
+    }
+  }
+
+  void Unpack(float *a) const
+  {
+    float sd[6];
+    for (int i = 0; i < 6; ++i)
+    {
+      a[Idx(i, i)] = m_diag[i];
+      sd[i]        = std::sqrt(std::max(m_diag[i], 0.f));
+    }
+    for (int i = 1, k = 0; i < 6; ++i)
+    {
+      for (int j = 0; j < i; ++j, ++k)
+      {
+        a[Idx(i, j)] = (m_rho[k] * (1.f / s_scale)) * sd[i] * sd[j];
+      }
+    }
+  }
+
+  // Rounds a to what storing it as CompactSym66 would give.
+  static void RoundTrip(float *a)
+  {
+    CompactSym66 c;
+    c.Pack(a);
+    c.Unpack(a);
+  }
+};
+
+// TrackState with compact covariance, used for TrackCand when built with
+// COMPACT_CAND_STATE (Makefile.config). Converts to / from TrackState.
+struct TrackStateCompact : public TrackStateParams
+{
+public:
+  TrackStateCompact() : valid(true) {}
+
+  explicit TrackStateCompact(const TrackState& ts) :
+    TrackStateParams(ts.parameters), charge(ts.charge), valid(ts.valid)
+  {
+    errors.Pack(ts.errors.Array());
+  }
+
+  explicit operator TrackState() const
+  {
+    TrackState ts;
+    ts.parameters = parameters;
+    errors.Unpack(ts.errors.Array());
+    ts.charge = charge;
+    ts.valid  = valid;
+    return ts;
+  }
+
+  CompactSym66 errors;
+  short charge;
+  bool valid;
+};
+
 //==============================================================================
 // TrackBase
 //==============================================================================
 
-class TrackBase
+// TrackBase is TrackBaseT<TrackState>. With COMPACT_CAND_STATE, TrackCand
+// derives from TrackBaseT<TrackStateCompact>; members that use the covariance
+// as SMatrixSym66 can then not be used for it.
+
+template<typename TS>
+class TrackBaseT
 {
 public:
-  TrackBase() {}
+  TrackBaseT() {}
 
-  TrackBase(const TrackState& state, float chi2, int label) :
+  TrackBaseT(const TS& state, float chi2, int label) :
     state_(state),
     chi2_ (chi2),
     label_(label)
   {}
 
-  TrackBase(int charge, const SVector3& position, const SVector3& momentum,
-            const SMatrixSym66& errors, float chi2) :
+  TrackBaseT(int charge, const SVector3& position, const SVector3& momentum,
+             const SMatrixSym66& errors, float chi2) :
     state_(charge, position, momentum, errors), chi2_(chi2)
   {}
 
-  ~TrackBase() {}
+  // Conversion between full and compact track states.
+  template<typename OTS>
+  explicit TrackBaseT(const TrackBaseT<OTS>& o) :
+    state_     (o.state_),
+    chi2_      (o.chi2_),
+    score_     (o.score_),
+    lastHitIdx_(o.lastHitIdx_),
+    nFoundHits_(o.nFoundHits_),
+    label_     (o.label_)
+  {
+    status_._raw_ = o.status_._raw_;
+  }
 
-  const TrackState&  state() const { return state_; }
-  void setState(const TrackState& newState) { state_ = newState; }
+  ~TrackBaseT() {}
+
+  const TS&  state() const { return state_; }
+  void setState(const TS& newState) { state_ = newState; }
 
   const SVector6&     parameters() const {return state_.parameters;}
   const SMatrixSym66& errors()     const {return state_.errors;}
@@ -165,7 +286,7 @@ public:
   // Non-const versions needed for CopyOut of Matriplex.
   SVector6&     parameters_nc() {return state_.parameters;}
   SMatrixSym66& errors_nc()     {return state_.errors;}
-  TrackState&   state_nc()      {return state_;}
+  TS&           state_nc()      {return state_;}
 
   SVector3 position() const {return SVector3(state_.parameters[0],state_.parameters[1],state_.parameters[2]);}
   SVector3 momentum() const {return SVector3(state_.parameters[3],state_.parameters[4],state_.parameters[5]);}
@@ -338,7 +459,9 @@ public:
   // ------------------------------------------------------------------------
 
 protected:
-  TrackState    state_;
+  template<typename> friend class TrackBaseT;
+
+  TS            state_;
   float         chi2_       =  0.;
   float         score_      =  0.;
   short int     lastHitIdx_ = -1;
@@ -347,6 +470,10 @@ protected:
   int           label_      = -1;
 };
 
+typedef TrackBaseT<TrackState> TrackBase;
+
+template<> bool TrackBase::hasSillyValues(bool dump, bool fix, const char* pref);
+
 //==============================================================================
 // TrackCand
 //==============================================================================
@@ -356,6 +483,55 @@ protected:
 
 // class TrackCand : public TrackBase { ... };
 
+//==============================================================================
+// HoTInlineVec
+//==============================================================================
+
+// Fixed-capacity stand-in for std::vector<HitOnTrack>, up to
+// Config::nMaxTrkHits hits stored inline. Used as Track hit storage when
+// built with TRACK_INLINE_HOTS (Makefile.config): copying a Track, exporting
+// candidates and resizing TrackVecs then never touch the heap.
+// Only the subset of the vector interface used by Track is provided.
+
+class HoTInlineVec
+{
+public:
+  static constexpr int s_capacity = Config::nMaxTrkHits;
+
+  int  size()  const { return m_size; }
+  bool full()  const { return m_size == s_capacity; }
+
+  void reserve(int) {}
+  void clear() { m_size = 0; }
+
+  void resize(int n)
+  {
+    assert(n <= s_capacity);
+    for (int i = m_size; i < n; ++i) m_hots[i] = HitOnTrack();
+    m_size = n;
+  }
+
+  void push_back(const HitOnTrack &hot)
+  {
+    assert(m_size < s_capacity);
+    m_hots[m_size++] = hot;
+  }
+
+        HitOnTrack& operator[](int i)       { return m_hots[i]; }
+  const HitOnTrack& operator[](int i) const { return m_hots[i]; }
+
+        HitOnTrack* data()        { return m_hots; }
+  const HitOnTrack* data()  const { return m_hots; }
+        HitOnTrack* begin()       { return m_hots; }
+  const HitOnTrack* begin() const { return m_hots; }
+        HitOnTrack* end()         { return m_hots + m_size; }
+  const HitOnTrack* end()   const { return m_hots + m_size; }
+
+private:
+  HitOnTrack m_hots[s_capacity];
+  int        m_size = 0;
+};
+
 //==============================================================================
 // Track
 //==============================================================================
@@ -388,12 +564,10 @@ public:
     TrackBase(charge, position, momentum, errors, chi2)
   {}
 
-  Track(const Track &t) :
-    TrackBase  (t),
-    hitsOnTrk_ (t.hitsOnTrk_)
-  {}
+  Track(const Track &t) = default;
+  Track& operator=(const Track &t) = default;
 
-  ~Track(){}
+  ~Track() = default;
 
   // used for swimming cmssw rec tracks to mkFit position
   float swimPhiToR(const float x, const float y) const;
@@ -407,7 +581,7 @@ public:
   const HitVec hitsVector(const std::vector<HitVec>& globalHitVec) const
   {
     HitVec hitsVec;
-    for (int ihit = 0; ihit < Config::nMaxTrkHits; ++ihit) {
+    for (int ihit = 0; ihit <= lastHitIdx_; ++ihit) {
       const HitOnTrack &hot = hitsOnTrk_[ihit];
       if (hot.index >= 0) {
         hitsVec.push_back( globalHitVec[hot.layer][hot.index] );
@@ -445,10 +619,34 @@ public:
   void setHitIdxAtPos(int pos, const HitOnTrack &hot)
   { hitsOnTrk_[pos] =  hot; }
 
-  void resizeHitsForInput();
+  // Returns false if hits on file do not fit into inline storage; the track
+  // then keeps the first s_capacity of them, the caller has to skip the rest.
+  bool resizeHitsForInput();
 
   void addHitIdx(int hitIdx, int hitLyr, float chi2)
   {
+#ifdef TRACK_INLINE_HOTS
+    if (hitsOnTrk_.full())
+    {
+      // As in MkFinder::add_hit(): a found hit or a -2 replaces the last one,
+      // adjusting the found count; anything else is dropped. Found includes
+      // -9 as below.
+      HitOnTrack &last = hitsOnTrk_[lastHitIdx_];
+      const bool last_found = last.index >= 0 || last.index == -9;
+      if (hitIdx >= 0 || hitIdx == -9)
+      {
+        if ( ! last_found) ++nFoundHits_;
+        last = { hitIdx, hitLyr };
+        chi2_ += chi2;
+      }
+      else if (hitIdx == -2)
+      {
+        if (last_found) --nFoundHits_;
+        last = { hitIdx, hitLyr };
+      }
+      return;
+    }
+#endif
     hitsOnTrk_.push_back( { hitIdx, hitLyr } );
     ++lastHitIdx_;
     if (hitIdx >= 0 || hitIdx == -9)
@@ -555,8 +753,8 @@ public:
 
   int nUniqueLayers() const
   {
-    // make local copy in vector: sort it in place
-    std::vector<HitOnTrack> tmp_hitsOnTrk(hitsOnTrk_.begin(), hitsOnTrk_.end());
+    // make local copy of hits: sort it in place
+    HitOnTrackStorage tmp_hitsOnTrk(hitsOnTrk_);
     std::sort(tmp_hitsOnTrk.begin(), tmp_hitsOnTrk.end(),
 	      [](const auto & h1, const auto & h2) { return h1.layer < h2.layer; });
 
@@ -597,7 +795,13 @@ public:
   Track clone() const { return Track(*this); }
 	
 private:
-  std::vector<HitOnTrack>    hitsOnTrk_;
+#ifdef TRACK_INLINE_HOTS
+  typedef HoTInlineVec            HitOnTrackStorage;
+#else
+  typedef std::vector<HitOnTrack> HitOnTrackStorage;
+#endif
+
+  HitOnTrackStorage          hitsOnTrk_;
 };
 
 typedef std::vector<Track>    TrackVec;
@@ -56,6 +56,7 @@ public:
   /*MM: moving out to IterationLayerConfig*/
   //// Selection limits
   float         m_q_bin; // > 0 - bin width, < 0 - number of bins
+  int           m_phi_bins = 0; // power of 2, at most 1024; 0 - Config::m_nphi
   //float         m_select_min_dphi, m_select_max_dphi;
   //float         m_select_min_dq,   m_select_max_dq;
   
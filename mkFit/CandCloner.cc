@@ -3,6 +3,8 @@
 #include "HitStructures.h"
 #include "SteeringParams.h"
 
+#include <algorithm>
+
 //#define DEBUG
 #include "Debug.h"
 
@@ -20,10 +22,6 @@ namespace mkfit {
 void CandCloner::Setup(const IterationParams &ip)
 {
   mp_iteration_params = &ip;
-  for (int iseed = 0; iseed < s_max_seed_range; ++iseed)
-  {
-    t_cands_for_next_lay[iseed].reserve(mp_iteration_params->maxCandsPerSeed);
-  }
 }
 
 void CandCloner::Release()
@@ -70,47 +68,16 @@ void CandCloner::ProcessSeedRange(int is_beg, int is_end)
 
     if ( ! hitsForSeed.empty())
     {
-      //sort the new hits
-      std::sort(hitsForSeed.begin(), hitsForSeed.end(), sortCandListByScore);
-
-      int num_hits = std::min((int) hitsForSeed.size(), mp_iteration_params->maxCandsPerSeed);
+      const int max_cands = mp_iteration_params->maxCandsPerSeed;
 
-      // This is from buffer, we know it was cleared after last usage.
-      std::vector<TrackCand> &cv = t_cands_for_next_lay[is - is_beg];
+      // Spare slots of the seed, swapped in by pointer at the end.
+      TrackCand *cv = ccand.NextCands();
 
       int n_pushed = 0;
 
-      for (int ih = 0; ih < num_hits; ih++)
+      // Stores candidate tc made from hit h2a, picking up an overlap hit if available.
+      auto push_hit_cand = [&](TrackCand &tc, const IdxChi2List &h2a)
       {
-        const IdxChi2List &h2a = hitsForSeed[ih];
-
-        TrackCand tc( ccand[h2a.trkIdx] );
-        tc.addHitIdx(h2a.hitIdx, m_layer, h2a.chi2_hit);
-        tc.setScore(h2a.score);
-
-        if (h2a.hitIdx == -2)
-        {
-          if (h2a.score > ccand.m_best_short_cand.score())
-          {
-            ccand.m_best_short_cand = tc;
-          }
-          continue;
-        }
-
-        // Could also skip storing of cands with last -3 hit.
-
-        // Squeeze in extra tracks that are better than current one.
-        while (extra_i != extra_e && sortByScoreTrackCand(*extra_i, tc) &&
-               n_pushed < mp_iteration_params->maxCandsPerSeed)
-        {
-          cv.emplace_back(*extra_i);
-          ++n_pushed;
-          ++extra_i;
-        }
-
-        if (n_pushed >= mp_iteration_params->maxCandsPerSeed)
-          break;
-
         // set the overlap if we have a true hit and pT > pTCutOverlap
         HitMatch *hm;
         if (tc.pT() > mp_iteration_params->pTCutOverlap && h2a.hitIdx >= 0 &&
@@ -134,30 +101,112 @@ void CandCloner::ProcessSeedRange(int is_beg, int is_end)
           //        ccand[h2a.trkIdx].chi2(), h2a.chi2, hm->m_chi2, h2a.module, hm->m_module_id);
         }
 
-        cv.emplace_back( tc );
-        ++n_pushed;
+        cv[n_pushed++] = tc;
 
         if (h2a.hitIdx >= 0)
         {
           mp_kalman_update_list->push_back(std::pair<int,int>(m_start_seed + is, n_pushed - 1));
         }
+      };
+
+      if (Config::foldExtrasIntoTopK)
+      {
+        // Short (-2) hits take no slot, only the best one can become the best short cand.
+        auto short_beg = std::partition(hitsForSeed.begin(), hitsForSeed.end(),
+                                        [](const IdxChi2List &h) { return h.hitIdx != -2; });
+        if (short_beg != hitsForSeed.end())
+        {
+          const IdxChi2List &h2a = *std::min_element(short_beg, hitsForSeed.end(), sortCandListByScore);
+          if (h2a.score > ccand.m_best_short_cand.score())
+          {
+            TrackCand tc( ccand[h2a.trkIdx] );
+            tc.addHitIdx(h2a.hitIdx, m_layer, h2a.chi2_hit);
+            tc.setScore(h2a.score);
+            ccand.m_best_short_cand = tc;
+          }
+          hitsForSeed.erase(short_beg, hitsForSeed.end());
+        }
+
+        // Extras enter the selection as entries with trkIdx = -1 - index into extras.
+        for (int ie = 0; ie < (int) extras.size(); ++ie)
+        {
+          IdxChi2List e;
+          e.trkIdx = -1 - ie;
+          e.hitIdx = -1;
+          e.score  = extras[ie].score();
+          hitsForSeed.push_back(e);
+        }
+
+        const int num_sel = std::min((int) hitsForSeed.size(), max_cands);
+        std::partial_sort(hitsForSeed.begin(), hitsForSeed.begin() + num_sel, hitsForSeed.end(),
+                          sortCandListByScore);
+
+        for (int ih = 0; ih < num_sel; ih++)
+        {
+          const IdxChi2List &h2a = hitsForSeed[ih];
+
+          if (h2a.trkIdx < 0)
+          {
+            cv[n_pushed++] = extras[-1 - h2a.trkIdx];
+            continue;
+          }
+
+          TrackCand tc( ccand[h2a.trkIdx] );
+          tc.addHitIdx(h2a.hitIdx, m_layer, h2a.chi2_hit);
+          tc.setScore(h2a.score);
+
+          push_hit_cand(tc, h2a);
+        }
+        extra_i = extra_e;
+      }
+      else
+      {
+        // Only the best max_cands hits are used, no need to sort the rest.
+        const int num_hits = std::min((int) hitsForSeed.size(), max_cands);
+        std::partial_sort(hitsForSeed.begin(), hitsForSeed.begin() + num_hits, hitsForSeed.end(),
+                          sortCandListByScore);
+
+        for (int ih = 0; ih < num_hits; ih++)
+        {
+          const IdxChi2List &h2a = hitsForSeed[ih];
+
+          TrackCand tc( ccand[h2a.trkIdx] );
+          tc.addHitIdx(h2a.hitIdx, m_layer, h2a.chi2_hit);
+          tc.setScore(h2a.score);
+
+          if (h2a.hitIdx == -2)
+          {
+            if (h2a.score > ccand.m_best_short_cand.score())
+            {
+              ccand.m_best_short_cand = tc;
+            }
+            continue;
+          }
+
+          // Could also skip storing of cands with last -3 hit.
+
+          // Squeeze in extra tracks that are better than current one.
+          while (extra_i != extra_e && sortByScoreTrackCand(*extra_i, tc) && n_pushed < max_cands)
+          {
+            cv[n_pushed++] = *extra_i;
+            ++extra_i;
+          }
+
+          if (n_pushed >= max_cands)
+            break;
+
+          push_hit_cand(tc, h2a);
+        }
       }
 
       // Add remaining extras as long as there is still room for them.
-      while (extra_i != extra_e && n_pushed < mp_iteration_params->maxCandsPerSeed)
+      while (extra_i != extra_e && n_pushed < max_cands)
       {
-        cv.emplace_back(*extra_i);
-        ++n_pushed;
+        cv[n_pushed++] = *extra_i;
         ++extra_i;
       }
 
-      //ccand.swap(cv); // segfaulting w/ backwards fit input tracks -- using loop below now
-      ccand.resize(cv.size());
-      for (size_t ii = 0; ii < cv.size(); ++ii)
-      {
-        ccand[ii] = cv[ii];
-      }
-      cv.clear();
+      ccand.SwapInNextCands(n_pushed);
     }
     else // hitsForSeed.empty()
     {
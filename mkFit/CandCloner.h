@@ -21,17 +21,7 @@ public:
   // Maximum number of seeds processed in one call to ProcessSeedRange()
   static const int s_max_seed_range = MPT_SIZE;
 
-private:
-  // Temporaries in ProcessSeedRange(), resized/reserved  in constructor.
-
-  // Size of this one is s_max_seed_range
-  std::vector<std::vector<TrackCand>> t_cands_for_next_lay;
-
-public:
-  CandCloner()
-  {
-    t_cands_for_next_lay.resize(s_max_seed_range);
-  }
+  CandCloner() {}
 
   void Setup(const IterationParams &ip);
   void Release();
@@ -0,0 +1,26 @@
+#ifndef CpuFeatures_h
+#define CpuFeatures_h
+
+namespace mkfit {
+
+// CPU features code built with VEC_HOST flags can use.
+enum CpuFeature_e
+{
+  CF_avx      = 1 << 0,
+  CF_fma      = 1 << 1,
+  CF_avx2     = 1 << 2,
+  CF_avx512f  = 1 << 3,
+  CF_avx512cd = 1 << 4,
+  CF_avx512bw = 1 << 5,
+  CF_avx512dq = 1 << 6,
+  CF_avx512vl = 1 << 7
+};
+
+// Features enabled for the mkFit executable, set in mkFit.cc from the
+// predefined macros and checked by mkFit-isa-check.cxx before anything
+// else runs.
+extern const unsigned g_build_cpu_features;
+
+} // end namespace mkfit
+
+#endif
@@ -8,6 +8,13 @@
 
 namespace mkfit {
 
+LayerOfHits::LayerOfHits() :
+  m_sorter(new RadixSort)
+{}
+
+LayerOfHits::~LayerOfHits()
+{}
+
 void LayerOfHits::setup_bins(float qmin, float qmax, float dq)
 {
   // Define layer with min/max and number of bins along q.
@@ -30,7 +37,34 @@ void LayerOfHits::setup_bins(float qmin, float qmax, float dq)
   }
   m_fq = m_nq / (qmax - qmin); // qbin = (q_hit - m_qmin) * m_fq;
 
-  m_phi_bin_infos.resize(m_nq);
+  m_phi_bin_infos.resize(m_nq, m_nphi);
+}
+
+void LayerOfHits::setup_phi_bins(int nphi)
+{
+  if (nphi <= 0 || nphi > (1 << m_phi_bits_fine) || (nphi & (nphi - 1)) != 0)
+  {
+    fprintf(stderr, "LayerOfHits::SetupLayer layer %d: number of phi bins %d is not a power of 2 between 1 and %d.\n",
+            m_layer_info->m_layer_id, nphi, 1 << m_phi_bits_fine);
+    exit(1);
+  }
+
+  m_nphi           = nphi;
+  m_phi_mask       = nphi - 1;
+  m_phi_bits       = __builtin_ctz(nphi);
+  m_phi_bits_shift = m_phi_bits_fine - m_phi_bits;
+  m_phi_fine_xmask = ~((1 << m_phi_bits_shift) - 1);
+  m_fphi           = nphi / Config::TwoPI;
+}
+
+void LayerOfHits::check_bin_index_range(int size) const
+{
+  if (size > std::numeric_limits<bin_index_t>::max())
+  {
+    fprintf(stderr, "LayerOfHits layer %d: %d hits do not fit into %d-bit bin indices, define LOH_32BIT_BIN_INDICES.\n",
+            m_layer_info->m_layer_id, size, (int) (8 * sizeof(bin_index_t)));
+    exit(1);
+  }
 }
 
 void LayerOfHits::SetupLayer(const LayerInfo &li)
@@ -43,10 +77,115 @@ void LayerOfHits::SetupLayer(const LayerInfo &li)
 
   m_is_barrel = m_layer_info->is_barrel();
 
+  setup_phi_bins(li.m_phi_bins > 0 ? li.m_phi_bins : Config::m_nphi);
+
   if (m_is_barrel) setup_bins(li.m_zmin, li.m_zmax, li.m_q_bin);
   else             setup_bins(li.m_rin,  li.m_rout, li.m_q_bin);
 }
 
+void LayerOfHits::Reset()
+{
+  m_n_allocs_total += m_n_allocs;
+  m_n_allocs = 0;
+  m_n_hits   = 0;
+}
+
+void LayerOfHits::FillStorageStats(HitStorageStats &s) const
+{
+  auto reserved = [](const auto &v) { return v.capacity() * sizeof(v[0]); };
+  auto used     = [](const auto &v) { return v.size()     * sizeof(v[0]); };
+
+  s.m_n_allocs       = m_n_allocs;
+  s.m_n_allocs_total = m_n_allocs_total + m_n_allocs;
+
+  s.m_bytes_reserved = reserved(m_hit_infos) + reserved(m_qphifines) + reserved(m_ext_idcs) +
+                       reserved(m_hit_phis)  + reserved(m_hit_qs) + reserved(m_ranks) +
+                       2 * m_sorter->GetCapacity() * sizeof(unsigned int);
+  s.m_bytes_used     = used(m_hit_infos) + used(m_qphifines) + used(m_ext_idcs) +
+                       used(m_hit_phis)  + used(m_hit_qs) +
+                       (Config::useRadixHitSort ? 2 : 1) * m_n_hits * sizeof(unsigned int);
+#ifdef COPY_SORTED_HITS
+  for (auto &v : m_hit_pos) { s.m_bytes_reserved += reserved(v); s.m_bytes_used += used(v); }
+  for (auto &v : m_hit_err) { s.m_bytes_reserved += reserved(v); s.m_bytes_used += used(v); }
+  s.m_bytes_reserved += reserved(m_hit_mcids) + reserved(m_hit_detids);
+  s.m_bytes_used     += used(m_hit_mcids)     + used(m_hit_detids);
+#endif
+}
+
+bool LayerOfHits::sort_qphifines(int size)
+{
+  if (Config::useRadixHitSort)
+  {
+    sort_qphifines_radix(size);
+    return false;
+  }
+  sort_qphifines_counting(size);
+  return true;
+}
+
+void LayerOfHits::sort_qphifines_radix(int size)
+{
+  // Ranks are reset so that hits with equal keys stay in input order, as they
+  // would with a fresh sorter.
+  const unsigned int n_resizes = m_sorter->GetNbResizes();
+
+  m_sorter->ResetRanks();
+  m_sorter->Sort(m_qphifines.data(), size, RADIX_UNSIGNED);
+  m_hit_ranks = m_sorter->GetRanks();
+
+  m_n_allocs += m_sorter->GetNbResizes() - n_resizes;
+}
+
+void LayerOfHits::sort_qphifines_counting(int size)
+{
+  // Counting sort over q-phi bins, the bins themselves hold the histogram:
+  // 1. count hits per bin in .second;
+  // 2. prefix sum turns bins into empty ranges at their start positions;
+  // 3. scatter hit indices, advancing .second to the end of each bin.
+  // Within a bin hits are then ordered by fine phi with a stable insertion
+  // sort, giving the same order as the radix sort of m_qphifines. Bins hold
+  // a few hits at most, so this costs about one more pass.
+
+  resize_retained(m_ranks, size);
+  m_hit_ranks = m_ranks.data();
+
+  PhiBinInfo_t *bins   = m_phi_bin_infos[0];
+  const int     n_bins = m_phi_bin_infos.size();
+
+  auto bin_of = [&](uint32_t qphi) {
+    return (int) (qphi >> 16) * m_nphi + (int) ((qphi & m_phi_mask_fine) >> m_phi_bits_shift);
+  };
+
+  for (int b = 0; b < n_bins; ++b) bins[b].second = 0;
+
+  for (int i = 0; i < size; ++i) ++bins[bin_of(m_qphifines[i])].second;
+
+  bin_index_t pos = 0;
+  for (int b = 0; b < n_bins; ++b)
+  {
+    const bin_index_t n = bins[b].second;
+    bins[b] = { pos, pos };
+    pos += n;
+  }
+
+  for (int i = 0; i < size; ++i) m_hit_ranks[bins[bin_of(m_qphifines[i])].second++] = i;
+
+  for (int b = 0; b < n_bins; ++b)
+  {
+    for (int i = bins[b].first + 1; i < (int) bins[b].second; ++i)
+    {
+      const unsigned int r   = m_hit_ranks[i];
+      const uint32_t     key = m_qphifines[r];
+      int j = i;
+      for ( ; j > bins[b].first && m_qphifines[m_hit_ranks[j - 1]] > key; --j)
+      {
+        m_hit_ranks[j] = m_hit_ranks[j - 1];
+      }
+      m_hit_ranks[j] = r;
+    }
+  }
+}
+
 //==============================================================================
 
 /*
@@ -73,29 +212,28 @@ void detect_q_min_max(const HitVec &hitv)
 }
 */
 
-void LayerOfHits::SuckInHits(const HitVec &hitv)
+void LayerOfHits::SuckInHits(const HitSpan &hitv)
 {
   assert (m_nq > 0 && "SetupLayer() was not called.");
 
   const int size = hitv.size();
 
-  m_ext_hits  = & hitv;
+  check_bin_index_range(size);
+
+  m_ext_hits  = hitv.data();
+  m_n_hits    = size;
 
 #ifdef COPY_SORTED_HITS
-  if (m_capacity < size)
-  {
-    free_hits();
-    alloc_hits(1.02 * size);
-  }
+  resize_sorted_hits(size);
 #endif
 
   if (Config::usePhiQArrays)
   {
-    m_hit_phis.resize(size);
-    m_hit_qs.resize(size);
-    m_hit_infos.resize(size);
+    resize_retained(m_hit_phis, size);
+    resize_retained(m_hit_qs, size);
+    resize_retained(m_hit_infos, size);
   }
-  m_qphifines.resize(size);
+  resize_retained(m_qphifines, size);
 
   for (int i = 0; i < size; ++i)
   {
@@ -111,22 +249,17 @@ void LayerOfHits::SuckInHits(const HitVec &hitv)
     }
   }
 
-  operator delete [] (m_hit_ranks);
-  {
-    RadixSort sort;
-    sort.Sort(&m_qphifines[0], size, RADIX_UNSIGNED);
-    m_hit_ranks = sort.RelinquishRanks();
-  }
+  const bool bins_filled = sort_qphifines(size);
 
   int curr_qphi = -1;
-  empty_q_bins(0, m_nq, 0);
+  if ( ! bins_filled) empty_q_bins(0, m_nq, 0);
 
   for (int i = 0; i < size; ++i)
   {
     int j = m_hit_ranks[i];
 
 #ifdef COPY_SORTED_HITS
-    memcpy(&m_hits[i], &hitv[j], sizeof(Hit));
+    copy_sorted_hit(i, hitv[j]);
 #endif
 
     if (Config::usePhiQArrays)
@@ -135,6 +268,8 @@ void LayerOfHits::SuckInHits(const HitVec &hitv)
       m_hit_qs  [i] = m_hit_infos[j].q;
     }
 
+    if (bins_filled) continue;
+
     // Combined q-phi bin with fine part masked off
     const int jqphi   = m_qphifines[j] & m_phi_fine_xmask;
 
@@ -151,6 +286,8 @@ void LayerOfHits::SuckInHits(const HitVec &hitv)
     m_phi_bin_infos[q_bin][phi_bin].second++;
   }
 
+  if ( ! bins_filled) position_empty_bins();
+
   // Check for mis-sorts due to lost precision (not really important).
   // float phi_prev = 0;
   // int   bin_prev = -1;
@@ -187,7 +324,7 @@ void LayerOfHits::BeginRegistrationOfHits(const HitVec &hitv)
 {
   assert (m_nq > 0 && "SetupLayer() was not called.");
 
-  m_ext_hits = &hitv;
+  m_ext_hits = hitv.data();
 
   m_hit_infos.clear();
   m_qphifines.clear();
@@ -198,53 +335,50 @@ void LayerOfHits::BeginRegistrationOfHits(const HitVec &hitv)
 
 void LayerOfHits::RegisterHit(int idx)
 {
-  const Hit &h = (*m_ext_hits)[idx];
+  const Hit &h = m_ext_hits[idx];
 
-  m_ext_idcs.push_back(idx);
+  push_back_retained(m_ext_idcs, idx);
   m_min_ext_idx = std::min(m_min_ext_idx, idx);
   m_max_ext_idx = std::max(m_max_ext_idx, idx);
 
   HitInfo hi = { h.phi(), m_is_barrel ? h.z() : h.r() };
 
-  m_qphifines.push_back( GetPhiBinFine(hi.phi) + (GetQBinChecked(hi.q) << 16) );
+  push_back_retained(m_qphifines, (uint32_t) (GetPhiBinFine(hi.phi) + (GetQBinChecked(hi.q) << 16)));
 
   if (Config::usePhiQArrays)
   {
-    m_hit_infos.emplace_back(hi);
+    push_back_retained(m_hit_infos, hi);
   }
 }
 
 void LayerOfHits::EndRegistrationOfHits(bool build_original_to_internal_map)
 {
   const int size = m_ext_idcs.size();
-  if (size == 0) return;
-
-  // radix
-  operator delete [] (m_hit_ranks);
+  m_n_hits = size;
+  if (size == 0)
   {
-    RadixSort sort;
-    sort.Sort(&m_qphifines[0], size, RADIX_UNSIGNED);
-    m_hit_ranks = sort.RelinquishRanks();
+    empty_q_bins(0, m_nq, 0);
+    return;
   }
 
+  check_bin_index_range(size);
+
+  const bool bins_filled = sort_qphifines(size);
+
   // copy q/phi
 
 #ifdef COPY_SORTED_HITS
-  if (m_capacity < size)
-  {
-    free_hits();
-    alloc_hits(1.02 * size);
-  }
+  resize_sorted_hits(size);
 #endif
 
   if (Config::usePhiQArrays)
   {
-    m_hit_phis.resize(size);
-    m_hit_qs.resize(size);
+    resize_retained(m_hit_phis, size);
+    resize_retained(m_hit_qs, size);
   }
 
   int curr_qphi = -1;
-  empty_q_bins(0, m_nq, 0);
+  if ( ! bins_filled) empty_q_bins(0, m_nq, 0);
 
   for (int i = 0; i < size; ++i)
   {
@@ -252,7 +386,7 @@ void LayerOfHits::EndRegistrationOfHits(bool build_original_to_internal_map)
     int k = m_ext_idcs[j];   // index in external hit_vec
 
 #ifdef COPY_SORTED_HITS
-    memcpy(&m_hits[i], &hitv[k], sizeof(Hit));
+    copy_sorted_hit(i, m_ext_hits[k]);
 #endif
 
     if (Config::usePhiQArrays)
@@ -261,6 +395,11 @@ void LayerOfHits::EndRegistrationOfHits(bool build_original_to_internal_map)
       m_hit_qs  [i] = m_hit_infos[j].q;
     }
 
+    // m_hit_ranks[i] will never be used again ... use it to point to external index.
+    m_hit_ranks[i] = k;
+
+    if (bins_filled) continue;
+
     // Combined q-phi bin with fine part masked off
     const int jqphi = m_qphifines[j] & m_phi_fine_xmask;
 
@@ -275,11 +414,10 @@ void LayerOfHits::EndRegistrationOfHits(bool build_original_to_internal_map)
     }
 
     m_phi_bin_infos[q_bin][phi_bin].second++;
-
-    // m_hit_ranks[i] will never be used again ... use it to point to external index.
-    m_hit_ranks[i] = k;
   }
 
+  if ( ! bins_filled) position_empty_bins();
+
   if (build_original_to_internal_map)
   {
     if (m_max_ext_idx - m_min_ext_idx + 1 > 8*size)
@@ -295,7 +433,7 @@ void LayerOfHits::EndRegistrationOfHits(bool build_original_to_internal_map)
              size, m_max_ext_idx - m_min_ext_idx + 1);
     }
 
-    m_ext_idcs.resize(m_max_ext_idx - m_min_ext_idx + 1);
+    resize_retained(m_ext_idcs, m_max_ext_idx - m_min_ext_idx + 1);
     for (int i = 0; i < size; ++i)
     {
       m_ext_idcs[m_hit_ranks[i] - m_min_ext_idx] = i;
@@ -382,7 +520,7 @@ void LayerOfHits::PrintBins()
   for (int qb = 0; qb < m_nq; ++qb)
   {
     printf("%c bin %d\n", is_barrel() ? 'Z' : 'R', qb);
-    for (int pb = 0; pb < Config::m_nphi; ++pb)
+    for (int pb = 0; pb < m_nphi; ++pb)
     {
       if (pb % 8 == 0)
         printf(" Phi %4d: ", pb);
@@ -403,7 +541,7 @@ Track TrackCand::exportTrack() const
   // printf("TrackCand::exportTrack label=%5d, total_hits=%2d, overlaps=%2d\n", label(),
   //        nTotalHits(), nOverlapHits_);
 
-  Track res(*this);
+  Track res(TrackBase(static_cast<const TrackCandBase&>(*this)));
   res.resizeHits(nTotalHits(), nFoundHits());
   res.setNOverlapHits(nOverlapHits());
 
@@ -440,10 +578,132 @@ EventOfHits::EventOfHits(const TrackerInfo &trk_inf) :
 }
 
 
+//==============================================================================
+// IterationHitMasks
+//==============================================================================
+
+void IterationHitMasks::Fill(const EventOfHits &eoh, const std::vector<std::vector<uint64_t>> &hit_masks,
+                             const IterationsInfo &itrs_info)
+{
+  m_n_iters = itrs_info.size();
+
+  m_layer_offset .resize(eoh.m_n_layers);
+  m_layer_n_words.resize(eoh.m_n_layers);
+
+  int n_words = 0;
+  for (int l = 0; l < eoh.m_n_layers; ++l)
+  {
+    m_layer_offset [l] = n_words;
+    m_layer_n_words[l] = (eoh[l].GetNHits() + 63) / 64;
+    n_words += m_n_iters * m_layer_n_words[l];
+  }
+  m_words.assign(n_words, 0);
+
+  std::vector<uint64_t> algo_bits(m_n_iters);
+  for (int i = 0; i < m_n_iters; ++i)
+  {
+    const int ta = itrs_info[i].m_track_algorithm;
+    algo_bits[i] = ta >= 0 && ta < 64 ? (uint64_t) 1 << ta : 0;
+  }
+
+  for (int l = 0; l < std::min(eoh.m_n_layers, (int) hit_masks.size()); ++l)
+  {
+    const LayerOfHits &L = eoh[l];
+    const int n_hits = L.GetNHits();
+    if (hit_masks[l].empty()) continue;
+
+    for (int hi = 0; hi < n_hits; ++hi)
+    {
+      const uint64_t hm  = hit_masks[l][L.GetOriginalHitIndex(hi)];
+      const uint64_t bit = (uint64_t) 1 << (hi & 63);
+      uint64_t *w = &m_words[m_layer_offset[l] + (hi >> 6)];
+      for (int i = 0; i < m_n_iters; ++i)
+      {
+        if (hm & algo_bits[i]) w[i * m_layer_n_words[l]] |= bit;
+      }
+    }
+  }
+}
+
+
+//==============================================================================
+// PhiBinAdvisor
+//==============================================================================
+
+void PhiBinAdvisor::Fill(const EventOfHits &eoh)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (m_n_events == 0)
+  {
+    m_nq  .resize(eoh.m_n_layers);
+    m_nphi.resize(eoh.m_n_layers);
+    m_sum_hits     .assign(eoh.m_n_layers, 0);
+    m_sum_row_hits2.assign(eoh.m_n_layers, 0);
+  }
+  ++m_n_events;
+
+  for (int l = 0; l < eoh.m_n_layers; ++l)
+  {
+    const LayerOfHits &L = eoh[l];
+
+    m_nq  [l] = L.m_nq;
+    m_nphi[l] = L.m_nphi;
+
+    for (int q = 0; q < L.m_nq; ++q)
+    {
+      // Empty bins point to where their hits would be, see position_empty_bins().
+      const double n = L.m_phi_bin_infos[q][L.m_nphi - 1].second - L.m_phi_bin_infos[q][0].first;
+
+      m_sum_hits     [l] += n;
+      m_sum_row_hits2[l] += n * n;
+    }
+  }
+}
+
+int PhiBinAdvisor::SuggestPhiBins(int layer, float hits_per_bin) const
+{
+  if (m_sum_hits[layer] == 0) return m_nphi[layer];
+
+  const double row_hits = m_sum_row_hits2[layer] / m_sum_hits[layer];
+  const int    bits     = std::lround(std::log2(std::max(1.0, row_hits / hits_per_bin)));
+
+  return 1 << std::min(bits, 10);
+}
+
+void PhiBinAdvisor::Print(float hits_per_bin) const
+{
+  printf("Suggested phi bins for about %.2f hits per bin, from %d events:\n", hits_per_bin, m_n_events);
+  printf("  layer  q-bins  hits/event  hits/q-row  phi-bins  suggested\n");
+  for (int l = 0; l < (int) m_nq.size(); ++l)
+  {
+    printf("  %5d  %6d  %10.1f  %10.1f  %8d  %9d\n", l, m_nq[l],
+           m_sum_hits[l] / m_n_events,
+           m_sum_hits[l] > 0 ? m_sum_row_hits2[l] / m_sum_hits[l] : 0.0,
+           m_nphi[l], SuggestPhiBins(l, hits_per_bin));
+  }
+  printf("As settings for the geometry plugin:\n");
+  for (int l = 0; l < (int) m_nq.size(); ++l)
+  {
+    printf("  ti.m_layers[%d].m_phi_bins = %d;\n", l, SuggestPhiBins(l, hits_per_bin));
+  }
+}
+
 //==============================================================================
 // CombCandidate
 //==============================================================================
 
+void CombCandidate::GrowHots()
+{
+  // Can not grow in place when the nodes are still in the arena block.
+  std::vector<HoTNode> hots(std::max(2 * m_hots_capacity, 16));
+  std::copy(m_hots, m_hots + m_hots_size, hots.begin());
+
+  m_hots_overflow.swap(hots);
+  m_hots          = m_hots_overflow.data();
+  m_hots_capacity = m_hots_overflow.size();
+}
+
 void CombCandidate::ImportSeed(const Track& seed)
 {
   emplace_back(TrackCand(seed, this));
@@ -495,7 +755,10 @@ void CombCandidate::MergeCandsAndBestShortOne(const IterationParams& params, boo
       //          front().score(), best_short->score());
       // }
 
-      insert(ci, *best_short);
+      assert(m_size < m_max_cands);
+      std::move_backward(ci, end(), end() + 1);
+      *ci = *best_short;
+      ++m_size;
     }
 
   }
@@ -13,9 +13,15 @@
 #include <array>
 #include "tbb/concurrent_vector.h"
 
+#include <memory>
+#include <mutex>
+
+class RadixSort;
+
 namespace mkfit {
 
 class IterationParams;
+class IterationsInfo;
 
 typedef tbb::concurrent_vector<TripletIdx> TripletIdxConVec;
 
@@ -40,11 +46,36 @@ typedef tbb::concurrent_vector<TripletIdx> TripletIdxConVec;
 // Need a good "array of pods" class with aligned alloc and automatic growth.
 // For now just implement the no-resize / no-destroy basics in the BoH.
 
-typedef std::pair<uint16_t, uint16_t> PhiBinInfo_t;
+// Define to use 32-bit hit indices in phi-bin infos, needed for layers with
+// more than 65535 hits.
+//#define LOH_32BIT_BIN_INDICES
+
+#ifdef LOH_32BIT_BIN_INDICES
+typedef uint32_t bin_index_t;
+#else
+typedef uint16_t bin_index_t;
+#endif
+
+typedef std::pair<bin_index_t, bin_index_t> PhiBinInfo_t;
 
-typedef std::array<PhiBinInfo_t, Config::m_nphi> vecPhiBinInfo_t;
+// Phi-bin infos of all q-bins stored row after row, [q] returns the row of
+// q-bin q. Number of phi bins is set per layer.
+class PhiBinInfoGrid
+{
+  std::vector<PhiBinInfo_t> m_bins;
+  int                       m_nphi = 0;
+
+public:
+  void resize(int nq, int nphi) { m_nphi = nphi; m_bins.resize(nq * nphi); }
 
-typedef std::vector<vecPhiBinInfo_t> vecvecPhiBinInfo_t;
+  int  size() const { return m_bins.size(); }
+
+  PhiBinInfo_t*       operator[](int q)       { return &m_bins[q * m_nphi]; }
+  const PhiBinInfo_t* operator[](int q) const { return &m_bins[q * m_nphi]; }
+
+  std::vector<PhiBinInfo_t>::iterator begin() { return m_bins.begin(); }
+  std::vector<PhiBinInfo_t>::iterator end()   { return m_bins.end(); }
+};
 
 //==============================================================================
 
@@ -64,21 +95,54 @@ inline bool sortTrksByPhiMT(const Track& t1, const Track& t2)
 // Note: the same code is used for barrel and endcap. In barrel the longitudinal
 // bins are in Z and in endcap they are in R -- here this coordinate is called Q
 
-// When not defined, hits are accessed from the original hit vector and
-// only sort ranks are kept for proper access.
+// When COPY_SORTED_HITS is not defined, hits are accessed from the original
+// hit vector and only sort ranks are kept for proper access.
 //
-//#define COPY_SORTED_HITS
+// When defined (USE_COPY_SORTED_HITS in Makefile.config), positions, errors,
+// mc-hit-ids and det-ids of hits are also copied in phi-sorted order into
+// per-component arrays (SoA) so that the hit selection and chi2 loops in
+// MkFinder read them sequentially. GetHit() and the original index mapping
+// still use the original hit vector, which must outlive the event as before.
+
+// Memory held by hit structures, see LayerOfHits::FillStorageStats().
+struct HitStorageStats
+{
+  int    m_n_allocs       = 0; // buffer (re)allocations since last Reset()
+  int    m_n_allocs_total = 0; // buffer (re)allocations since construction
+  size_t m_bytes_reserved = 0; // capacity of all buffers
+  size_t m_bytes_used     = 0; // part of it used by the current event
+
+  void add(const HitStorageStats &o)
+  {
+    m_n_allocs       += o.m_n_allocs;
+    m_n_allocs_total += o.m_n_allocs_total;
+    m_bytes_reserved += o.m_bytes_reserved;
+    m_bytes_used     += o.m_bytes_used;
+  }
+};
 
 class LayerOfHits
 {
 private:
+  const Hit                *m_ext_hits;
 #ifdef COPY_SORTED_HITS
-  Hit                      *m_hits = 0;
-  int                       m_capacity = 0;
-#else
-  unsigned int             *m_hit_ranks = 0; // allocated by IceSort via new []
-  const HitVec             *m_ext_hits;
+  // Sorted copy of hits, one array per component, see GetHitPosColumn().
+  std::vector<float>        m_hit_pos[3];
+  std::vector<float>        m_hit_err[6];
+  std::vector<int>          m_hit_mcids;
+  std::vector<uint16_t>     m_hit_detids;
 #endif
+  // Sorter is kept across events so its rank buffers are reused; m_hit_ranks
+  // points into one of them or into m_ranks (counting sort) and is valid until
+  // the next sort.
+  std::unique_ptr<RadixSort> m_sorter;
+  std::vector<unsigned int>  m_ranks;
+  unsigned int             *m_hit_ranks = 0;
+  int                       m_n_hits    = 0;
+
+  // Buffer growth accounting, see Reset() and FillStorageStats().
+  int                       m_n_allocs       = 0;
+  int                       m_n_allocs_total = 0;
 
   // Stuff needed during setup
   struct HitInfo
@@ -93,7 +157,7 @@ private:
 
 public:
   const LayerInfo            *m_layer_info = 0;
-  vecvecPhiBinInfo_t         m_phi_bin_infos;
+  PhiBinInfoGrid             m_phi_bin_infos;
   std::vector<float>         m_hit_phis;
   std::vector<float>         m_hit_qs;
 
@@ -101,14 +165,22 @@ public:
   int   m_nq = 0;
   bool  m_is_barrel;
 
+  // Phi binning, set from LayerInfo::m_phi_bins.
+  int   m_nphi;
+  int   m_phi_mask;
+  int   m_phi_bits;
+  int   m_phi_bits_shift;
+  int   m_phi_fine_xmask;
+  float m_fphi;
+
   int   layer_id()  const { return m_layer_info->m_layer_id; }
   bool  is_barrel() const { return m_is_barrel;   }
   bool  is_endcap() const { return ! m_is_barrel; }
-  int   bin_index(int q, int p) const { return q*Config::m_nphi + p; }
+  int   bin_index(int q, int p) const { return q*m_nphi + p; }
 
   PhiBinInfo_t operator[](int i) const {
-    int q = i / Config::m_nphi;
-    int p = i % Config::m_nphi;
+    int q = i / m_nphi;
+    int p = i % m_nphi;
     return m_phi_bin_infos[q][p];
   }
 
@@ -142,32 +214,57 @@ public:
   { return  m_layer_info->is_tec_lyr(); }
 
   // Testing bin filling
-  static constexpr float m_fphi     = Config::m_nphi / Config::TwoPI;
-  static constexpr int   m_phi_mask = 0x7f;
-  static constexpr int   m_phi_bits = 7;
+  // Fine phi bins are used for sorting, phi bins are a power of 2 of those.
   static constexpr float m_fphi_fine      = 1024 / Config::TwoPI;
   static constexpr int   m_phi_mask_fine  = 0x3ff;
   static constexpr int   m_phi_bits_fine  = 10; //can't be more than 16
-  static constexpr int   m_phi_bits_shift = m_phi_bits_fine - m_phi_bits;
-  static constexpr int   m_phi_fine_xmask = ~((1 << m_phi_bits_shift) - 1);
 
 protected:
 
 #ifdef COPY_SORTED_HITS
-  void alloc_hits(int size)
+  void resize_sorted_hits(int size)
   {
-    m_hits = (Hit*) _mm_malloc(sizeof(Hit) * size, 64);
-    m_capacity = size;
-    for (int ihit = 0; ihit < m_capacity; ihit++){m_hits[ihit] = Hit();}
+    for (auto &v : m_hit_pos) resize_retained(v, size);
+    for (auto &v : m_hit_err) resize_retained(v, size);
+    resize_retained(m_hit_mcids,  size);
+    resize_retained(m_hit_detids, size);
   }
 
-  void free_hits()
+  void copy_sorted_hit(int i, const Hit &h)
   {
-    _mm_free(m_hits);
+    const float *pos = h.posArray(), *err = h.errArray();
+    for (int c = 0; c < 3; ++c) m_hit_pos[c][i] = pos[c];
+    for (int c = 0; c < 6; ++c) m_hit_err[c][i] = err[c];
+    m_hit_mcids [i] = h.mcHitID();
+    m_hit_detids[i] = h.detIDinLayer();
   }
 #endif
 
   void setup_bins(float qmin, float qmax, float dq);
+  void setup_phi_bins(int nphi);
+  void check_bin_index_range(int size) const;
+
+  // Resize / push_back that note when a buffer has to grow. Capacity is never
+  // released so after a few events these stop allocating.
+  template<typename T>
+  void resize_retained(std::vector<T> &v, int n)
+  {
+    if ((size_t) n > v.capacity()) ++m_n_allocs;
+    v.resize(n);
+  }
+
+  template<typename T>
+  void push_back_retained(std::vector<T> &v, const T &x)
+  {
+    if (v.size() == v.capacity()) ++m_n_allocs;
+    v.push_back(x);
+  }
+
+  // Sorts hits by m_qphifines into m_hit_ranks. Returns true when the bins in
+  // m_phi_bin_infos were filled as well, false when the caller has to do it.
+  bool sort_qphifines(int size);
+  void sort_qphifines_radix(int size);
+  void sort_qphifines_counting(int size);
 
 
   // Not used.
@@ -178,7 +275,7 @@ protected:
   //   hits_in_bin = 0;
   // }
 
-  void empty_phi_bins(int q_bin, int phi_bin_1, int phi_bin_2, uint16_t hit_count)
+  void empty_phi_bins(int q_bin, int phi_bin_1, int phi_bin_2, bin_index_t hit_count)
   {
     for (int pb = phi_bin_1; pb < phi_bin_2; ++pb)
     {
@@ -186,28 +283,37 @@ protected:
     }
   }
 
-  void empty_q_bins(int q_bin_1, int q_bin_2, uint16_t hit_count)
+  void empty_q_bins(int q_bin_1, int q_bin_2, bin_index_t hit_count)
   {
     for (int qb = q_bin_1; qb < q_bin_2; ++qb)
     {
-      empty_phi_bins(qb, 0, Config::m_nphi, hit_count);
+      empty_phi_bins(qb, 0, m_nphi, hit_count);
     }
   }
 
-public:
-  LayerOfHits() {}
-
-  ~LayerOfHits()
+  // Point empty bins to where their hits would start, so that the hits of
+  // consecutive phi bins are always [first of first bin, second of last bin).
+  void position_empty_bins()
   {
-#ifdef COPY_SORTED_HITS
-    free_hits();
-#endif
-    operator delete [] (m_hit_ranks);
+    bin_index_t pos = 0;
+    for (auto &b : m_phi_bin_infos)
+    {
+      if (b.first == b.second) b = { pos, pos };
+      else                     pos = b.second;
+    }
   }
 
+public:
+  LayerOfHits();
+  ~LayerOfHits();
+
   void  SetupLayer(const LayerInfo &li);
 
-  void  Reset() {}
+  // Prepare for the next event. All buffers, including sort ranks, keep their
+  // capacity and are only grown when an event has more hits than any before.
+  void  Reset();
+
+  void  FillStorageStats(HitStorageStats &s) const;
 
   float NormalizeQ(float q) const { return std::clamp(q, m_qmin, m_qmax); }
 
@@ -221,10 +327,13 @@ public:
 
   int   GetPhiBinChecked(float phi) const { return GetPhiBin(phi) & m_phi_mask; }
 
-  const vecPhiBinInfo_t& GetVecPhiBinInfo(float q) const { return m_phi_bin_infos[GetQBin(q)]; }
+  const PhiBinInfo_t* GetVecPhiBinInfo(float q) const { return m_phi_bin_infos[GetQBin(q)]; }
 
-  // Get in all hits from given hit-vec
-  void  SuckInHits(const HitVec &hitv);
+  // Get in all hits from given hit-vec or hit-span. The hits must outlive the
+  // processing of the event (COPY_SORTED_HITS only copies the parts needed in
+  // the inner loops of finding).
+  void  SuckInHits(const HitVec &hitv) { SuckInHits(HitSpan(hitv)); }
+  void  SuckInHits(const HitSpan &hits);
 
   // Use external hit-vec and only use hits that are passed to me.
   void  BeginRegistrationOfHits(const HitVec &hitv);
@@ -236,16 +345,24 @@ public:
   // Use this to remap internal hit index to external one.
   int   GetOriginalHitIndex(int i) const { return m_hit_ranks[i]; }
 
+  int   GetNHits() const { return m_n_hits; }
+
+  const Hit& GetHit(int i) const { return m_ext_hits[m_hit_ranks[i]]; }
+  const Hit* GetHitArray() const { return m_ext_hits; }
+
+  const Hit& GetHitWithOriginalIndex(int i) const { return m_ext_hits[i]; }
+
 #ifdef COPY_SORTED_HITS
-  const Hit& GetHit(int i) const { return m_hits[i]; }
-  const Hit* GetHitArray() const { return m_hits; }
-#else
-  const Hit& GetHit(int i) const { return (*m_ext_hits)[m_hit_ranks[i]]; }
-  const Hit* GetHitArray() const { return & (*m_ext_hits)[0]; }
+  // Component c of positions (x, y, z) / errors (as in Hit::errArray()) of
+  // all hits, indexed with the sorted hit index.
+  const float* GetHitPosColumn(int c) const { return m_hit_pos[c].data(); }
+  const float* GetHitErrColumn(int c) const { return m_hit_err[c].data(); }
 
-  // This would also be possible for COPY_SORTED_HITS, but somebody must guarantee they stay const
-  // after suck in -- and we need to add m_ext_hits for that case, too.
-  const Hit& GetHitWithOriginalIndex(int i) const { return (*m_ext_hits)[i]; }
+  int          GetHitMcHitID     (int i) const { return m_hit_mcids [i]; }
+  unsigned int GetHitDetIDinLayer(int i) const { return m_hit_detids[i]; }
+#else
+  int          GetHitMcHitID     (int i) const { return GetHit(i).mcHitID(); }
+  unsigned int GetHitDetIDinLayer(int i) const { return GetHit(i).detIDinLayer(); }
 #endif
 
   // void  SelectHitIndices(float q, float phi, float dq, float dphi, std::vector<int>& idcs, bool isForSeeding=false, bool dump=false);
@@ -272,9 +389,21 @@ public:
     }
   }
 
-  void SuckInHits(int layer, const HitVec &hitv)
+  HitStorageStats GetStorageStats() const
+  {
+    HitStorageStats s;
+    for (auto &i : m_layers_of_hits)
+    {
+      HitStorageStats ls;
+      i.FillStorageStats(ls);
+      s.add(ls);
+    }
+    return s;
+  }
+
+  void SuckInHits(int layer, const HitSpan &hits)
   {
-    m_layers_of_hits[layer].SuckInHits(hitv);
+    m_layers_of_hits[layer].SuckInHits(hits);
     /*
     int   nh  = hitv.size();
     auto &loh = m_layers_of_hits[layer];
@@ -288,6 +417,57 @@ public:
   const LayerOfHits& operator[](int i) const { return m_layers_of_hits[i]; }
 };
 
+//==============================================================================
+
+// Iteration hit masks of an event, one bit per hit in LayerOfHits (sorted)
+// order for each layer and iteration, so that hit scans test them without
+// going through the original hit index and can skip 64 hits at a time.
+// Filled once per event for all iterations, after hits have been sucked in.
+
+class IterationHitMasks
+{
+  int                   m_n_iters = 0;
+  std::vector<int>      m_layer_offset;  // first word of layer, iteration 0
+  std::vector<int>      m_layer_n_words; // words per iteration
+  std::vector<uint64_t> m_words;
+
+public:
+  // A hit is masked for an iteration when the bit of its track algorithm is
+  // set in the per-hit masks (in original hit order, as Event::layerHitMasks_).
+  void Fill(const EventOfHits &eoh, const std::vector<std::vector<uint64_t>> &hit_masks,
+            const IterationsInfo &itrs_info);
+
+  const uint64_t* GetLayerMask(int iter, int layer) const
+  {
+    return m_words.data() + m_layer_offset[layer] + iter * m_layer_n_words[layer];
+  }
+
+  static bool IsSet(const uint64_t *mask, int hi) { return (mask[hi >> 6] >> (hi & 63)) & 1; }
+};
+
+//==============================================================================
+
+// Collects hit occupancy of q-bin rows over events and suggests per-layer
+// numbers of phi bins so that the bins hits are in hold about hits_per_bin
+// hits each. Rows are weighted by their hits as search windows go where hits
+// are. Results are printed as LayerInfo::m_phi_bins settings for the
+// geometry plugin.
+
+class PhiBinAdvisor
+{
+  std::mutex          m_mutex;
+  int                 m_n_events = 0;
+  std::vector<int>    m_nq, m_nphi;
+  std::vector<double> m_sum_hits;      // per layer, over events
+  std::vector<double> m_sum_row_hits2; // per layer, sum of squared q-row hit counts
+
+public:
+  void Fill(const EventOfHits &eoh);
+
+  int  SuggestPhiBins(int layer, float hits_per_bin) const;
+  void Print(float hits_per_bin) const;
+};
+
 
 
 //==============================================================================
@@ -371,18 +551,32 @@ struct HitMatchPair
 
 class CombCandidate;
 
-class TrackCand : public TrackBase
+// With COMPACT_CAND_STATE (Makefile.config) the candidate covariance is kept as
+// CompactSym66 and expanded to floats when loaded into Matriplexes, see
+// MkFinder::copy_in/out_cand_err(). Config::emulate_compact_cand_state gives
+// the same rounding with full storage, for comparison of physics performance.
+
+#ifdef COMPACT_CAND_STATE
+typedef TrackBaseT<TrackStateCompact> TrackCandBase;
+#else
+typedef TrackBase                     TrackCandBase;
+#endif
+
+class TrackCand : public TrackCandBase
 {
 public:
   TrackCand() {}
 
   explicit TrackCand(const TrackBase& base, CombCandidate* ccand) :
-    TrackBase        (base),
+    TrackCandBase    (base),
     m_comb_candidate (ccand)
   {
     // Reset hit counters -- caller has to initialize hits.
     lastHitIdx_ = -1;
     nFoundHits_ =  0;
+#ifndef COMPACT_CAND_STATE
+    if (Config::emulate_compact_cand_state) CompactSym66::RoundTrip(errors_nc().Array());
+#endif
   }
 
   CombCandidate* combCandidate() const { return m_comb_candidate; }
@@ -459,63 +653,105 @@ inline float getScoreCand(const TrackCand& cand1)
 }
 
 
-// This inheritance sucks but not doing it will require more changes.
+// Candidates of one seed. Candidate slots, overlap records and hit-on-track
+// nodes live in blocks of the arena in EventOfCombCandidates; this class
+// provides a vector-like view of the candidates.
+// Each seed has two blocks of candidate slots, the current one and a spare one
+// that the CandCloner fills with the candidates for the next layer and then
+// swaps in.
 
-class CombCandidate : public std::vector<TrackCand>
+class CombCandidate
 {
 public:
   enum SeedState_e { Dormant = 0, Finding, Finished };
 
+  typedef TrackCand*       iterator;
+  typedef const TrackCand* const_iterator;
+
   TrackCand    m_best_short_cand;
   SeedState_e  m_state           = Dormant;
   int          m_last_seed_layer = -1;
   unsigned int m_seed_type       =  0;
 
-  int                  m_hots_size = 0;
-  std::vector<HoTNode> m_hots;
+  int          m_hots_size     = 0;
+  int          m_hots_capacity = 0;
+  HoTNode     *m_hots          = nullptr;
 
-  std::vector<HitMatchPair> m_overlap_hits; // XXXX HitMatchPair could be a member in TrackCand
+  HitMatchPair *m_overlap_hits = nullptr; // XXXX HitMatchPair could be a member in TrackCand
 
+protected:
+  TrackCand   *m_cands       = nullptr;
+  TrackCand   *m_spare_cands = nullptr;
+  int          m_size        = 0;
+  int          m_max_cands   = 0;
 
-  CombCandidate()
-  {
-  }
+  // HoTs that do not fit into the arena block are moved here, see AddHit().
+  std::vector<HoTNode> m_hots_overflow;
 
-  // Need this so resize of EventOfCombinedCandidates::m_candidates can reuse vectors used here.
-  CombCandidate(CombCandidate&& o) :
-    std::vector<TrackCand>(std::move(o)),
-    m_best_short_cand(std::move(o.m_best_short_cand)),
-    m_state(o.m_state),
-    m_last_seed_layer(o.m_last_seed_layer),
-    m_seed_type(o.m_seed_type),
-    m_hots_size(o.m_hots_size),
-    m_hots(std::move(o.m_hots)),
-    m_overlap_hits(std::move(o.m_overlap_hits))
-  {}
+  void GrowHots();
+
+public:
+  CombCandidate() {}
 
-  void Reset(int max_cands_per_seed, int expected_num_hots)
+  // Binds to arena blocks and resets the state, called when a seed is imported.
+  void Bind(TrackCand *cands, TrackCand *spare_cands, int max_cands,
+            HitMatchPair *overlap_hits, HoTNode *hots, int hots_capacity)
   {
-    reserve(max_cands_per_seed); // we should never exceed this
-    clear();
+    m_cands         = cands;
+    m_spare_cands   = spare_cands;
+    m_size          = 0;
+    m_max_cands     = max_cands;
+    m_overlap_hits  = overlap_hits;
+    m_hots          = hots;
+    m_hots_capacity = hots_capacity;
+    m_hots_size     = 0;
+
+    for (int i = 0; i < max_cands; ++i) m_overlap_hits[i].reset();
 
     m_best_short_cand.setScore( getScoreWorstPossible() );
+  }
+
+  int  size()  const { return m_size; }
+  bool empty() const { return m_size == 0; }
+  void clear()       { m_size = 0; }
+
+  iterator       begin()       { return m_cands; }
+  iterator       end()         { return m_cands + m_size; }
+  const_iterator begin() const { return m_cands; }
+  const_iterator end()   const { return m_cands + m_size; }
+
+        TrackCand& operator[](int i)       { return m_cands[i]; }
+  const TrackCand& operator[](int i) const { return m_cands[i]; }
 
-    // expected_num_hots is different for CloneEngine and Std, especially as long as we
-    // instantiate all candidates before purging them.
-    // ce:  N_layer * N_cands ~~ 20 * 6 = 120
-    // std: i don't know, maybe double?
-    m_hots.reserve(expected_num_hots);
-    m_hots_size = 0;
-    m_hots.clear();
+        TrackCand& front()       { return m_cands[0]; }
+  const TrackCand& front() const { return m_cands[0]; }
+        TrackCand& back()        { return m_cands[m_size - 1]; }
+  const TrackCand& back()  const { return m_cands[m_size - 1]; }
 
-    m_overlap_hits.resize(max_cands_per_seed);
+  void emplace_back(const TrackCand &tc)
+  {
+    assert(m_size < m_max_cands);
+    m_cands[m_size++] = tc;
+  }
+  void push_back(const TrackCand &tc) { emplace_back(tc); }
+  void pop_back() { --m_size; }
+
+  // Slots for the candidates of the next layer; they replace the current
+  // ones, by pointer, in SwapInNextCands().
+  TrackCand* NextCands() { return m_spare_cands; }
+
+  void SwapInNextCands(int n)
+  {
+    std::swap(m_cands, m_spare_cands);
+    m_size = n;
   }
 
   void ImportSeed(const Track& seed);
 
   int AddHit(const HitOnTrack& hot, float chi2, int prev_idx)
   {
-    m_hots.push_back({hot, chi2, prev_idx});
+    if (m_hots_size == m_hots_capacity) GrowHots();
+    m_hots[m_hots_size] = {hot, chi2, prev_idx};
     return m_hots_size++;
   }
 
@@ -590,13 +826,28 @@ public:
   int     m_capacity;
   int     m_size;
 
+  // Arena: storage of all seeds, indexed by seed. Only grows, so Reset() does
+  // not touch per-seed state; that is set up in InsertSeed().
+  std::vector<TrackCand>    m_cand_arena;    // 2 * m_max_cands_per_seed per seed
+  std::vector<HitMatchPair> m_overlap_arena; // m_max_cands_per_seed per seed
+  std::vector<HoTNode>      m_hots_arena;    // m_hots_per_seed per seed
+
+  int     m_max_cands_per_seed;
+  int     m_hots_per_seed;
+
 public:
   EventOfCombCandidates(int size=0) :
     m_candidates(),
     m_capacity  (0),
-    m_size      (0)
+    m_size      (0),
+    m_max_cands_per_seed(0),
+    m_hots_per_seed     (0)
   {}
 
+  // expected_num_hots is different for CloneEngine and Std, especially as long as we
+  // instantiate all candidates before purging them.
+  // ce:  N_layer * N_cands ~~ 20 * 6 = 120
+  // std: i don't know, maybe double? Seeds exceeding it spill to their own vector.
   void Reset(int new_capacity, int max_cands_per_seed, int expected_num_hots = 128)
   {
     if (new_capacity > m_capacity)
@@ -604,10 +855,16 @@ public:
       m_candidates.resize(new_capacity);
       m_capacity = new_capacity;
     }
-    for (int s = 0; s < m_capacity; ++s)
-    {
-      m_candidates[s].Reset(max_cands_per_seed, expected_num_hots);
-    }
+    m_max_cands_per_seed = max_cands_per_seed;
+    m_hots_per_seed      = expected_num_hots;
+
+    if (m_cand_arena.size() < (size_t) m_capacity * 2 * max_cands_per_seed)
+      m_cand_arena.resize((size_t) m_capacity * 2 * max_cands_per_seed);
+    if (m_overlap_arena.size() < (size_t) m_capacity * max_cands_per_seed)
+      m_overlap_arena.resize((size_t) m_capacity * max_cands_per_seed);
+    if (m_hots_arena.size() < (size_t) m_capacity * expected_num_hots)
+      m_hots_arena.resize((size_t) m_capacity * expected_num_hots);
+
     m_size = 0;
   }
 
@@ -617,6 +874,11 @@ public:
   {
     assert (m_size < m_capacity);
 
+    const size_t s = m_size, mc = m_max_cands_per_seed;
+
+    m_candidates[m_size].Bind(&m_cand_arena[2 * s * mc], &m_cand_arena[(2 * s + 1) * mc], mc,
+                              &m_overlap_arena[s * mc],
+                              &m_hots_arena[s * m_hots_per_seed], m_hots_per_seed);
     m_candidates[m_size].ImportSeed(seed);
 
     ++m_size;
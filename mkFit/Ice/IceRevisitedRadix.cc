@@ -173,7 +173,7 @@ To do:
  *	Constructor.
  */
 //----------------------------------------------------------------------
-RadixSort::RadixSort() : mCurrentSize(0), mRanks(0), mRanks2(0), mTotalCalls(0), mNbHits(0)
+RadixSort::RadixSort() : mCurrentSize(0), mCapacity(0), mRanks(0), mRanks2(0), mTotalCalls(0), mNbHits(0), mNbResizes(0)
 {
 #ifndef RADIX_LOCAL_RAM
   // Allocate input-independent ram
@@ -212,9 +212,21 @@ udword* RadixSort::RelinquishRanks()
   mRanks = 0;
   DELETEARRAY(mRanks2);
   mCurrentSize = 0;
+  mCapacity    = 0;
   return ranks;
 }
 
+//----------------------------------------------------------------------
+/**
+ * Invalidate ranks of the previous sort. The next sort does not use
+ * them as a starting point and equal keys keep their input order.
+ */
+//----------------------------------------------------------------------
+void RadixSort::ResetRanks()
+{
+  INVALIDATE_RANKS;
+}
+
 
 //----------------------------------------------------------------------
 /**
@@ -233,6 +245,9 @@ bool RadixSort::Resize(udword nb)
   mRanks  = new udword[nb];	CHECKALLOC(mRanks);
   mRanks2 = new udword[nb];	CHECKALLOC(mRanks2);
 
+  mCapacity = nb;
+  mNbResizes++;
+
   return true;
 }
 
@@ -241,7 +256,7 @@ inline_ void RadixSort::CheckResize(udword nb)
   udword CurSize = CURRENT_SIZE;
   if(nb!=CurSize)
     {
-      if(nb>CurSize)	Resize(nb);
+      if(nb>mCapacity)	Resize(nb);
       mCurrentSize = nb;
       INVALIDATE_RANKS;
     }
@@ -543,6 +558,6 @@ udword RadixSort::GetUsedRam() const
   UsedRam += 256*4*sizeof(udword);		// Histograms
   UsedRam += 256*sizeof(udword);		// Link
 #endif
-  UsedRam += 2*CURRENT_SIZE*sizeof(udword);	// 2 lists of indices
+  UsedRam += 2*mCapacity*sizeof(udword);	// 2 lists of indices
   return UsedRam;
 }
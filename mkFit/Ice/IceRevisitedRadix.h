@@ -39,11 +39,16 @@ public:
   //! Access to results. mRanks is a list of indices in sorted order,
   //i.e. in the order you may further process your data
   const udword*	GetRanks() const { return mRanks; }
+  udword*	GetRanks()       { return mRanks; }
 
   //! Detach mRanks. After this the caller is responsible for
   //! freeing this array via delete [] operator.
   udword* RelinquishRanks();
 
+  //! Forget the previous sort order so the next sort starts from
+  //! identity ranks. Rank buffers are kept.
+  void    ResetRanks();
+
   //! mIndices2 gets trashed on calling the sort routine, but
   //otherwise you can recycle it the way you want.
   udword* GetRecyclable() const { return mRanks2; }
@@ -54,6 +59,10 @@ public:
   udword  GetNbTotalCalls() const { return mTotalCalls; }
   //! Returns the number of eraly exits due to temporal coherence.
   udword  GetNbHits()       const { return mNbHits; }
+  //! Returns the number of elements rank buffers can hold without reallocation.
+  udword  GetCapacity()     const { return mCapacity; }
+  //! Returns the number of rank buffer (re)allocations.
+  udword  GetNbResizes()    const { return mNbResizes; }
 
 private:
 #ifndef RADIX_LOCAL_RAM
@@ -61,11 +70,13 @@ private:
   udword*	mLink;  	//!< Offsets (nearly a cumulative distribution function)
 #endif
   udword	mCurrentSize;	//!< Current size of the indices list
+  udword	mCapacity;	//!< Allocated size of the indices lists
   udword*	mRanks;		//!< Two lists, swapped each pass
   udword*	mRanks2;
   // Stats
   udword	mTotalCalls;	//!< Total number of calls to the sort routine
   udword	mNbHits;	//!< Number of early exits due to coherence
+  udword	mNbResizes;	//!< Number of rank buffer (re)allocations
 
   // Internal methods
   void	CheckResize(udword nb);
@@ -1,5 +1,6 @@
 #include "KalmanUtilsMPlex.h"
 #include "PropagationMPlex.h"
+#include "SimdMath.h"
 
 //#define DEBUG
 #include "Debug.h"
@@ -393,6 +394,106 @@ void KHC(const MPlexL2& A, const MPlexLS& B, MPlexLS& C)
 #include "K62HC.ah"
 }
 
+//==============================================================================
+// Single lane helpers for the multi-hit chi2
+//==============================================================================
+
+// Upper-left 3x3 of J * C * J^T for the position rows of a 3x6 Jacobian,
+// sym storage as in MPlexHS.
+inline
+void SimilarityPos3x6(const MPlexLS& C, const int n,
+                      const float (&jx)[6], const float (&jy)[6], const float (&jz)[6],
+                      float (&out)[6])
+{
+  // Fully unrolled, so that the calling loop over n vectorizes and the zero
+  // elements of the Jacobian drop out.
+  float tx[6], ty[6], tz[6];
+#pragma GCC unroll 6
+  for (int j = 0; j < 6; ++j)
+  {
+    tx[j] = ty[j] = tz[j] = 0.f;
+#pragma GCC unroll 6
+    for (int l = 0; l < 6; ++l)
+    {
+      const float c = C.ConstAt(n, l, j);
+      tx[j] += jx[l] * c;
+      ty[j] += jy[l] * c;
+      tz[j] += jz[l] * c;
+    }
+  }
+  out[0] = out[1] = out[2] = out[3] = out[4] = out[5] = 0.f;
+#pragma GCC unroll 6
+  for (int j = 0; j < 6; ++j)
+  {
+    out[0] += tx[j] * jx[j];
+    out[1] += ty[j] * jx[j];
+    out[2] += ty[j] * jy[j];
+    out[3] += tz[j] * jx[j];
+    out[4] += tz[j] * jy[j];
+    out[5] += tz[j] * jz[j];
+  }
+}
+
+// Chi2 of hit h in lane n against track position p with position covariance
+// c, same operations as kalmanOperation(KFO_Calculate_Chi2, ...).
+inline
+float Chi2Barrel(const float px, const float py, const float pz, const float (&c)[6],
+                 const MPlexHS& msErr, const MPlexHV& msPar, const int n)
+{
+  const float mx = msPar.ConstAt(n, 0, 0);
+  const float my = msPar.ConstAt(n, 1, 0);
+  const float mz = msPar.ConstAt(n, 2, 0);
+
+  const float r   = smath::hypot(mx, my);
+  const float r00 = -(my + py) / (2*r);
+  const float r01 =  (mx + px) / (2*r);
+
+  const float b0 = c[0] + msErr.ConstAt(n, 0, 0);
+  const float b1 = c[1] + msErr.ConstAt(n, 1, 0);
+  const float b2 = c[2] + msErr.ConstAt(n, 1, 1);
+  const float b3 = c[3] + msErr.ConstAt(n, 2, 0);
+  const float b4 = c[4] + msErr.ConstAt(n, 2, 1);
+  const float b5 = c[5] + msErr.ConstAt(n, 2, 2);
+
+  const float l0 = r00*(mx - px) + r01*(my - py);
+  const float l1 = mz - pz;
+
+  const float h0 = r00*b0 + r01*b1;
+  const float h1 = r00*b1 + r01*b2;
+  const float s0 = h0*r00 + h1*r01;
+  const float s1 = b3*r00 + b4*r01;
+  const float s2 = b5;
+
+  const double det = (double) s0 * s2 - (double) s1 * s1;
+  const float  s   = 1.f / det;
+  const float  i0  = s * s2;
+  const float  i1  = s1 * -s;
+  const float  i2  = s * s0;
+
+  return i0*l0*l0 + i2*l1*l1 + 2*(i1*l1*l0);
+}
+
+// As Chi2Barrel(), for kalmanOperationEndcap().
+inline
+float Chi2Endcap(const float px, const float py, const float c0, const float c1, const float c2,
+                 const MPlexHS& msErr, const MPlexHV& msPar, const int n)
+{
+  const float l0 = msPar.ConstAt(n, 0, 0) - px;
+  const float l1 = msPar.ConstAt(n, 1, 0) - py;
+
+  const float s0 = c0 + msErr.ConstAt(n, 0, 0);
+  const float s1 = c1 + msErr.ConstAt(n, 1, 0);
+  const float s2 = c2 + msErr.ConstAt(n, 1, 1);
+
+  const double det = (double) s0 * s2 - (double) s1 * s1;
+  const float  s   = 1.f / det;
+  const float  i0  = s * s2;
+  const float  i1  = s1 * -s;
+  const float  i2  = s * s0;
+
+  return i0*l0*l0 + i2*l1*l1 + 2*(i1*l1*l0);
+}
+
 // //Warning: MultFull is not vectorized, use only for testing!
 // template<typename T1, typename T2, typename T3>
 // void MultFull(const T1& A, int nia, int nja, const T2& B, int nib, int njb, T3& C, int nic, int njc)
@@ -481,7 +582,7 @@ void kalmanPropagateAndUpdate(const MPlexLS &psErr,  const MPlexLV& psPar, MPlex
 #pragma omp simd
     for (int n = 0; n < NN; ++n)
     {
-      msRad.At(n, 0, 0) = std::hypot(msPar.ConstAt(n, 0, 0), msPar.ConstAt(n, 1, 0));
+      msRad.At(n, 0, 0) = smath::hypot(msPar.ConstAt(n, 0, 0), msPar.ConstAt(n, 1, 0));
     }
 
     propagateHelixToRMPlex(psErr, psPar, Chg, msRad, propErr, propPar, N_proc, propFlags);
@@ -528,7 +629,7 @@ void kalmanPropagateAndComputeChi2(const MPlexLS &psErr,  const MPlexLV& psPar,
 #pragma omp simd
     for (int n = 0; n < NN; ++n)
     {
-      msRad.At(n, 0, 0) = std::hypot(msPar.ConstAt(n, 0, 0), msPar.ConstAt(n, 1, 0));
+      msRad.At(n, 0, 0) = smath::hypot(msPar.ConstAt(n, 0, 0), msPar.ConstAt(n, 1, 0));
     }
 
     propagateHelixToRMPlex(psErr, psPar, inChg, msRad, propErr, propPar, N_proc, propFlags);
@@ -543,6 +644,127 @@ void kalmanPropagateAndComputeChi2(const MPlexLS &psErr,  const MPlexLV& psPar,
   }
 }
 
+// Chi2 of every track against all hits in its window, hit slot h of all
+// tracks being in msErr[h], msPar[h]. Gives the same as calling
+// kalmanPropagateAndComputeChi2() for each slot but the track side is set up
+// once per layer: when propagation to the hit position is required, the
+// state at the layer is moved to the radius of each hit with the exact helix
+// position (as in helixAtRClosedFormCCS_impl()) and the position covariance
+// transported with the first order Jacobian of that short step, instead of
+// running the full propagation for every hit. Without propagation to the
+// hit the result is identical to kalmanOperation().
+void kalmanPropagateAndComputeChi2MultiHit(const MPlexLS &psErr,  const MPlexLV& psPar, const MPlexQI &inChg,
+                                           const MPlexHS *msErr,  const MPlexHV *msPar, const int n_hits,
+                                                 MPlexQF *outChi2,
+                                           const int      N_proc, const PropagationFlags propFlags)
+{
+  if ( ! Config::finding_requires_propagation_to_hit_pos)
+  {
+    for (int h = 0; h < n_hits; ++h)
+    {
+#pragma omp simd
+      for (int n = 0; n < NN; ++n)
+      {
+        const float c[6] = { psErr.ConstAt(n, 0, 0), psErr.ConstAt(n, 1, 0), psErr.ConstAt(n, 1, 1),
+                             psErr.ConstAt(n, 2, 0), psErr.ConstAt(n, 2, 1), psErr.ConstAt(n, 2, 2) };
+        outChi2[h].At(n, 0, 0) = Chi2Barrel(psPar.ConstAt(n, 0, 0), psPar.ConstAt(n, 1, 0), psPar.ConstAt(n, 2, 0),
+                                            c, msErr[h], msPar[h], n);
+      }
+    }
+    return;
+  }
+
+  // Track side terms.
+  MPlexQF cosP, sinP, cotT, ooST2, kinv, kappa, p0u, p0n, r0sq;
+
+  const bool use_param_b_field = propFlags.use_param_b_field;
+
+#pragma omp simd
+  for (int n = 0; n < NN; ++n)
+  {
+    const float x0 = psPar.ConstAt(n, 0, 0);
+    const float y0 = psPar.ConstAt(n, 1, 0);
+    float sT, cT;
+    smath::sincos(psPar.ConstAt(n, 4, 0), sinP.At(n, 0, 0), cosP.At(n, 0, 0));
+    smath::sincos(psPar.ConstAt(n, 5, 0), sT, cT);
+
+    r0sq (n, 0, 0) = x0*x0 + y0*y0;
+    const float bf = smath::select(use_param_b_field, Config::BfieldFromZR(psPar.ConstAt(n, 2, 0), std::sqrt(r0sq(n, 0, 0))), Config::Bfield);
+    const float k  = inChg.ConstAt(n, 0, 0) * 100.f / (-Config::sol*bf);
+    kinv (n, 0, 0) = 1.f / k;
+    kappa(n, 0, 0) = psPar.ConstAt(n, 3, 0) * kinv(n, 0, 0);
+    cotT (n, 0, 0) = cT / sT;
+    ooST2(n, 0, 0) = 1.f / (sT*sT);
+    p0u  (n, 0, 0) =  x0*cosP(n, 0, 0) + y0*sinP(n, 0, 0);
+    p0n  (n, 0, 0) = -x0*sinP(n, 0, 0) + y0*cosP(n, 0, 0);
+  }
+
+  for (int h = 0; h < n_hits; ++h)
+  {
+    const MPlexHS &mErr = msErr[h];
+    const MPlexHV &mPar = msPar[h];
+
+#pragma omp simd
+    for (int n = 0; n < NN; ++n)
+    {
+      const float cP = cosP(n, 0, 0), sP = sinP(n, 0, 0), kp = kappa(n, 0, 0), ki = kinv(n, 0, 0);
+
+      // Transverse path w = rho*tan(alpha/2) to the hit radius, see
+      // helixAtRClosedFormCCS_impl(); lanes without a crossing stay put.
+      const float mx   = mPar.ConstAt(n, 0, 0);
+      const float my   = mPar.ConstAt(n, 1, 0);
+      const float c    = 0.5f*(r0sq(n, 0, 0) - (mx*mx + my*my));
+      const float a    = 2.f + kp*(2.f*p0n(n, 0, 0) + kp*c);
+      const float disc = p0u(n, 0, 0)*p0u(n, 0, 0) - a*c;
+      const float den  = p0u(n, 0, 0) + std::sqrt(std::max(disc, 0.f));
+      const bool  fail = (disc <= 0.f) | (den <= 0.f);
+      const float w    = smath::select(fail, 0.f, -c / smath::select(fail, 1.f, den));
+
+      // Steps within a layer are short, |t| << 0.1; series for D = rho*alpha.
+      const float t    = kp*w;
+      const float t2   = t*t;
+      const float oo1t = 1.f / (1.f + t2);
+      const float rsa  = 2.f*w*oo1t;
+      const float rca  = rsa*t;
+      const float D    = 2.f*w*(1.f + t2*(-1.f/3 + t2*(1.f/5)));
+
+      const float px = psPar.ConstAt(n, 0, 0) + rsa*cP - rca*sP;
+      const float py = psPar.ConstAt(n, 1, 0) + rsa*sP + rca*cP;
+      const float pz = psPar.ConstAt(n, 2, 0) + D*cotT(n, 0, 0);
+
+      // Direction at the hit and derivatives of D from |p(D)| = r.
+      const float cosa = (1.f - t2)*oo1t;
+      const float sina = 2.f*t*oo1t;
+      const float ux   = cP*cosa - sP*sina;
+      const float uy   = sP*cosa + cP*sina;
+      const float oopu = smath::select(fail, 0.f, 1.f / smath::select(fail, 1.f, px*ux + py*uy));
+
+      // Position derivatives at fixed D on 1/pt and phi.
+      const float drsadi = -kp*D*D*D*(1.f/3)*ki;
+      const float drcadi = 0.5f*D*D*ki;
+      const float dxdi   = drsadi*cP - drcadi*sP;
+      const float dydi   = drsadi*sP + drcadi*cP;
+      const float dxdp   = -rsa*sP - rca*cP;
+      const float dydp   =  rsa*cP - rca*sP;
+
+      const float dDdx = -px*oopu;
+      const float dDdy = -py*oopu;
+      const float dDdi = -(px*dxdi + py*dydi)*oopu;
+      const float dDdp = -(px*dxdp + py*dydp)*oopu;
+
+      const float ct = cotT(n, 0, 0);
+      const float jx[6] = { 1.f + ux*dDdx, ux*dDdy, 0.f, dxdi + ux*dDdi, dxdp + ux*dDdp, 0.f };
+      const float jy[6] = { uy*dDdx, 1.f + uy*dDdy, 0.f, dydi + uy*dDdi, dydp + uy*dDdp, 0.f };
+      const float jz[6] = { ct*dDdx, ct*dDdy, 1.f, ct*dDdi, ct*dDdp, -D*ooST2(n, 0, 0) };
+
+      float cov[6];
+      SimilarityPos3x6(psErr, n, jx, jy, jz, cov);
+
+      outChi2[h].At(n, 0, 0) = Chi2Barrel(px, py, pz, cov, mErr, mPar, n);
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 
 void kalmanOperation(const int      kfOp,
@@ -585,7 +807,7 @@ void kalmanOperation(const int      kfOp,
   MPlexQF rotT00;
   MPlexQF rotT01;
   for (int n = 0; n < NN; ++n) {
-    const float r = std::hypot(msPar.ConstAt(n, 0, 0), msPar.ConstAt(n, 1, 0));
+    const float r = smath::hypot(msPar.ConstAt(n, 0, 0), msPar.ConstAt(n, 1, 0));
     rotT00.At(n, 0, 0) = -(msPar.ConstAt(n, 1, 0) + psPar.ConstAt(n, 1, 0)) / (2*r);
     rotT01.At(n, 0, 0) =  (msPar.ConstAt(n, 0, 0) + psPar.ConstAt(n, 0, 0)) / (2*r);
   }
@@ -769,6 +991,93 @@ void kalmanPropagateAndComputeChi2Endcap(const MPlexLS &psErr,  const MPlexLV& p
   }
 }
 
+// Endcap version of kalmanPropagateAndComputeChi2MultiHit(), the step to
+// the z of each hit being D = dz*tan(theta) in the transverse plane.
+void kalmanPropagateAndComputeChi2MultiHitEndcap(const MPlexLS &psErr,  const MPlexLV& psPar, const MPlexQI &inChg,
+                                                 const MPlexHS *msErr,  const MPlexHV *msPar, const int n_hits,
+                                                       MPlexQF *outChi2,
+                                                 const int      N_proc, const PropagationFlags propFlags)
+{
+  if ( ! Config::finding_requires_propagation_to_hit_pos)
+  {
+    for (int h = 0; h < n_hits; ++h)
+    {
+#pragma omp simd
+      for (int n = 0; n < NN; ++n)
+      {
+        outChi2[h].At(n, 0, 0) = Chi2Endcap(psPar.ConstAt(n, 0, 0), psPar.ConstAt(n, 1, 0),
+                                            psErr.ConstAt(n, 0, 0), psErr.ConstAt(n, 1, 0), psErr.ConstAt(n, 1, 1),
+                                            msErr[h], msPar[h], n);
+      }
+    }
+    return;
+  }
+
+  // Track side terms.
+  MPlexQF cosP, sinP, tanT, ooSC, kinv, kappa;
+
+  const bool use_param_b_field = propFlags.use_param_b_field;
+
+#pragma omp simd
+  for (int n = 0; n < NN; ++n)
+  {
+    float sT, cT;
+    smath::sincos(psPar.ConstAt(n, 4, 0), sinP.At(n, 0, 0), cosP.At(n, 0, 0));
+    smath::sincos(psPar.ConstAt(n, 5, 0), sT, cT);
+
+    const float r0 = smath::hypot(psPar.ConstAt(n, 0, 0), psPar.ConstAt(n, 1, 0));
+    const float bf = smath::select(use_param_b_field, Config::BfieldFromZR(psPar.ConstAt(n, 2, 0), r0), Config::Bfield);
+    const float k  = inChg.ConstAt(n, 0, 0) * 100.f / (-Config::sol*bf);
+    kinv (n, 0, 0) = 1.f / k;
+    kappa(n, 0, 0) = psPar.ConstAt(n, 3, 0) * kinv(n, 0, 0);
+    tanT (n, 0, 0) = sT / cT;
+    ooSC (n, 0, 0) = 1.f / (sT*cT);
+  }
+
+  for (int h = 0; h < n_hits; ++h)
+  {
+    const MPlexHS &mErr = msErr[h];
+    const MPlexHV &mPar = msPar[h];
+
+#pragma omp simd
+    for (int n = 0; n < NN; ++n)
+    {
+      const float cP = cosP(n, 0, 0), sP = sinP(n, 0, 0), kp = kappa(n, 0, 0), ki = kinv(n, 0, 0);
+
+      // rho*sin(alpha) and rho*(1 - cos(alpha)) from series in alpha = kappa*D,
+      // steps within a layer are short.
+      const float D   = (mPar.ConstAt(n, 2, 0) - psPar.ConstAt(n, 2, 0))*tanT(n, 0, 0);
+      const float al  = kp*D;
+      const float al2 = al*al;
+      const float rsa = D*(1.f - al2*(1.f/6 - al2*(1.f/120)));
+      const float rca = D*al*(0.5f - al2*(1.f/24 - al2*(1.f/720)));
+
+      const float px = psPar.ConstAt(n, 0, 0) + rsa*cP - rca*sP;
+      const float py = psPar.ConstAt(n, 1, 0) + rsa*sP + rca*cP;
+
+      const float cosa = 1.f - kp*rca;
+      const float sina = kp*rsa;
+      const float ux   = cP*cosa - sP*sina;
+      const float uy   = sP*cosa + cP*sina;
+
+      // Position derivatives at fixed D on 1/pt and phi, and of D on z and theta.
+      const float drsadi = -kp*D*D*D*(1.f/3)*ki;
+      const float drcadi = 0.5f*D*D*ki;
+      const float dDdz   = -tanT(n, 0, 0);
+      const float dDdt   = D*ooSC(n, 0, 0);
+
+      const float jx[6] = { 1.f, 0.f, ux*dDdz, drsadi*cP - drcadi*sP, -rsa*sP - rca*cP, ux*dDdt };
+      const float jy[6] = { 0.f, 1.f, uy*dDdz, drsadi*sP + drcadi*cP,  rsa*cP - rca*sP, uy*dDdt };
+      const float jz[6] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f };
+
+      float cov[6];
+      SimilarityPos3x6(psErr, n, jx, jy, jz, cov);
+
+      outChi2[h].At(n, 0, 0) = Chi2Endcap(px, py, cov[0], cov[1], cov[2], mErr, mPar, n);
+    }
+  }
+}
+
 //------------------------------------------------------------------------------
 
 void kalmanOperationEndcap(const int      kfOp,
@@ -38,6 +38,11 @@ void kalmanPropagateAndComputeChi2(const MPlexLS &psErr,  const MPlexLV& psPar,
                                          MPlexQF& outChi2,
                                    const int      N_proc, const PropagationFlags propFlags);
 
+void kalmanPropagateAndComputeChi2MultiHit(const MPlexLS &psErr,  const MPlexLV& psPar, const MPlexQI &inChg,
+                                           const MPlexHS *msErr,  const MPlexHV *msPar, const int n_hits,
+                                                 MPlexQF *outChi2,
+                                           const int      N_proc, const PropagationFlags propFlags);
+
 
 void kalmanOperation(const int      kfOp,
                      const MPlexLS &psErr,  const MPlexLV& psPar,
@@ -69,6 +74,11 @@ void kalmanPropagateAndComputeChi2Endcap(const MPlexLS &psErr,  const MPlexLV& p
                                                MPlexQF& outChi2,
                                          const int      N_proc, const PropagationFlags propFlags);
 
+void kalmanPropagateAndComputeChi2MultiHitEndcap(const MPlexLS &psErr,  const MPlexLV& psPar, const MPlexQI &inChg,
+                                                 const MPlexHS *msErr,  const MPlexHV *msPar, const int n_hits,
+                                                       MPlexQF *outChi2,
+                                                 const int      N_proc, const PropagationFlags propFlags);
+
 
 void kalmanOperationEndcap(const int      kfOp,
                            const MPlexLS &psErr,  const MPlexLV& psPar,
@@ -4,6 +4,7 @@
 #include "Matrix.h"
 
 #include "PropagationMPlex.h"
+#include "SimdMath.h"
 
 namespace mkfit {
 
@@ -51,7 +52,7 @@ public:
 #pragma omp simd
     for (int n = 0; n < NN; ++n)
     {
-      msRad.At(n, 0, 0) = std::hypot(par.ConstAt(n, 0, 0), par.ConstAt(n, 1, 0));
+      msRad.At(n, 0, 0) = smath::hypot(par.ConstAt(n, 0, 0), par.ConstAt(n, 1, 0));
     }
 
     propagateHelixToRMPlex(Err[iC], Par[iC], Chg, msRad,
@@ -92,9 +93,11 @@ public:
 #pragma omp simd
     for (int n = 0; n < NN; ++n)
     {
-      const float slope = std::tan(Par[iC].ConstAt(n, 5, 0));
+      float sinT, cosT;
+      smath::sincos(Par[iC].ConstAt(n, 5, 0), sinT, cosT);
+      const float slope = sinT / cosT;
       //      msZ.At(n, 0, 0) = ( Config::beamspotz0 + slope * ( Config::beamspotr0 - std::hypot(Par[iC].ConstAt(n, 0, 0), Par[iC].ConstAt(n, 1, 0))) + slope * slope * Par[iC].ConstAt(n, 2, 0) ) / ( 1+slope*slope); // PCA w.r.t. z0, r0
-      msZ.At(n, 0, 0) = (slope * (slope * Par[iC].ConstAt(n, 2, 0) - std::hypot(Par[iC].ConstAt(n, 0, 0), Par[iC].ConstAt(n, 1, 0)))) / (1 + slope * slope); // PCA to origin
+      msZ.At(n, 0, 0) = (slope * (slope * Par[iC].ConstAt(n, 2, 0) - smath::hypot(Par[iC].ConstAt(n, 0, 0), Par[iC].ConstAt(n, 1, 0)))) / (1 + slope * slope); // PCA to origin
     } 
 
     propagateHelixToZMPlex(Err[iC], Par[iC], Chg, msZ,
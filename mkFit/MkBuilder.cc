@@ -1,5 +1,7 @@
 #include <memory>
 #include <limits>
+#include <atomic>
+#include <algorithm>
 
 #include "MkBuilder.h"
 #include "seedtestMPlex.h"
@@ -175,8 +177,10 @@ namespace mkfit {
 
 MkBuilder::MkBuilder()
 {
-  m_fndfoos_brl = { kalmanPropagateAndComputeChi2,       kalmanPropagateAndUpdate,       &MkBase::PropagateTracksToR };
-  m_fndfoos_ec  = { kalmanPropagateAndComputeChi2Endcap, kalmanPropagateAndUpdateEndcap, &MkBase::PropagateTracksToZ };
+  m_fndfoos_brl = { kalmanPropagateAndComputeChi2,       kalmanPropagateAndComputeChi2MultiHit,
+                     kalmanPropagateAndUpdate,            &MkBase::PropagateTracksToR };
+  m_fndfoos_ec  = { kalmanPropagateAndComputeChi2Endcap, kalmanPropagateAndComputeChi2MultiHitEndcap,
+                     kalmanPropagateAndUpdateEndcap,      &MkBase::PropagateTracksToZ };
 }
 
 MkBuilder::~MkBuilder()
@@ -219,6 +223,164 @@ void MkBuilder::end_event()
   m_event = nullptr;
 }
 
+MkBuilder& MkBuilder::iteration_builder(int i)
+{
+  if (i == 0) return *this;
+
+  if (i > (int) m_iteration_builders.size()) m_iteration_builders.resize(i);
+  if ( ! m_iteration_builders[i - 1]) m_iteration_builders[i - 1].reset(make_builder());
+
+  return *m_iteration_builders[i - 1];
+}
+
+//------------------------------------------------------------------------------
+// Partitioning of seeds of all regions into tasks
+//------------------------------------------------------------------------------
+
+void MkBuilder::partition_seeds_by_cost()
+{
+  // Cost of a seed is the number of layers in the finding plan of its region,
+  // optionally weighted by hit occupancy of each layer relative to the mean.
+  // Regions are cut into tasks of about equal cost, a few per finder thread,
+  // so that a single large region can not hold back the whole event.
+
+  const EventOfHits &eoh = m_job->m_event_of_hits;
+
+  std::vector<float> layer_w(eoh.m_n_layers, 1.0f);
+  if (Config::costModelHitDensity)
+  {
+    double sum = 0;
+    for (int l = 0; l < eoh.m_n_layers; ++l) sum += eoh.m_layers_of_hits[l].GetNHits();
+    const double mean = sum / eoh.m_n_layers;
+    if (mean > 0)
+    {
+      for (int l = 0; l < eoh.m_n_layers; ++l) layer_w[l] = 1.0f + eoh.m_layers_of_hits[l].GetNHits() / mean;
+    }
+  }
+
+  std::vector<float> seed_cost(m_job->num_regions(), 0.0f);
+  double total_cost = 0;
+  for (auto ri = m_job->regions_begin(); ri != m_job->regions_end(); ++ri)
+  {
+    const int             region = *ri;
+    const SteeringParams &st_par = m_job->steering_params(region);
+
+    for (auto lp = st_par.finding_begin(); lp != st_par.finding_end(); ++lp)
+    {
+      seed_cost[region] += layer_w[lp->m_layer];
+    }
+    total_cost += seed_cost[region] * RegionOfSeedIndices(m_seedEtaSeparators, region).count();
+  }
+
+  // About four tasks per thread available to this event.
+  const double task_cost = total_cost * Config::numThreadsEvents / (4 * Config::numThreadsFinder);
+
+  m_region_tasks.clear();
+  for (auto ri = m_job->regions_begin(); ri != m_job->regions_end(); ++ri)
+  {
+    const int                 region = *ri;
+    const RegionOfSeedIndices rosi(m_seedEtaSeparators, region);
+    const int                 n_seeds = rosi.count();
+
+    if (n_seeds == 0) continue;
+
+    int spt = seed_cost[region] > 0 ? (int) (task_cost / seed_cost[region]) : n_seeds;
+    spt = clamp(spt, 4, Config::numSeedsPerTask);
+
+    // Spread seeds evenly over tasks rather than leaving a small last one.
+    const int n_tasks = (n_seeds + spt - 1) / spt;
+    for (int t = 0; t < n_tasks; ++t)
+    {
+      const int beg = rosi.m_reg_beg + n_seeds *  t      / n_tasks;
+      const int end = rosi.m_reg_beg + n_seeds * (t + 1) / n_tasks;
+      m_region_tasks.push_back({ region, beg, end, (end - beg) * seed_cost[region] });
+    }
+  }
+
+  std::stable_sort(m_region_tasks.begin(), m_region_tasks.end(),
+                   [](const RegionTask &a, const RegionTask &b) { return a.m_cost > b.m_cost; });
+}
+
+template <typename FF>
+void MkBuilder::run_region_tasks(const char *name, FF &&f)
+{
+  if ( ! Config::costPartitioning)
+  {
+    const EventOfCombCandidates &eoccs = m_event_of_comb_cands;
+
+    tbb::parallel_for_each(m_job->regions_begin(), m_job->regions_end(),
+      [&](int region)
+    {
+      const RegionOfSeedIndices rosi(m_seedEtaSeparators, region);
+
+      // adaptive seeds per task based on the total estimated amount of work to divide among all threads
+      const int adaptiveSPT = clamp(Config::numThreadsEvents*eoccs.m_size/Config::numThreadsFinder + 1, 4, Config::numSeedsPerTask);
+      dprint("adaptiveSPT " << adaptiveSPT << " fill " << rosi.count() << "/" << eoccs.m_size << " region " << region);
+
+      tbb::parallel_for(rosi.tbb_blk_rng_std(adaptiveSPT),
+        [&](const tbb::blocked_range<int>& seeds)
+      {
+        f(region, seeds.begin(), seeds.end());
+      });
+    });
+    return;
+  }
+
+  partition_seeds_by_cost();
+
+  const int n_tasks = m_region_tasks.size();
+  if (Config::logRegionTaskTimes) m_region_task_times.assign(n_tasks, 0.0);
+
+  // Workers take tasks in order of decreasing cost from a shared counter so
+  // that the expensive ones are started first and the cheap ones fill the gaps.
+  std::atomic<int> next_task(0);
+
+  tbb::parallel_for(0, std::min(n_tasks, Config::numThreadsFinder),
+    [&](int)
+  {
+    for (int t = next_task++; t < n_tasks; t = next_task++)
+    {
+      const RegionTask &rt = m_region_tasks[t];
+
+      const double t0 = Config::logRegionTaskTimes ? dtime() : 0;
+
+      f(rt.m_region, rt.m_beg, rt.m_end);
+
+      if (Config::logRegionTaskTimes) m_region_task_times[t] = dtime() - t0;
+    }
+  });
+
+  if (Config::logRegionTaskTimes) print_region_task_times(name);
+}
+
+void MkBuilder::print_region_task_times(const char *name) const
+{
+  const int n_regions = m_job->num_regions();
+
+  std::vector<int>    n_tasks(n_regions, 0), n_seeds(n_regions, 0);
+  std::vector<double> cost(n_regions, 0), t_sum(n_regions, 0), t_max(n_regions, 0);
+
+  for (int t = 0; t < (int) m_region_tasks.size(); ++t)
+  {
+    const RegionTask &rt = m_region_tasks[t];
+    ++n_tasks[rt.m_region];
+    n_seeds[rt.m_region] += rt.m_end - rt.m_beg;
+    cost   [rt.m_region] += rt.m_cost;
+    t_sum  [rt.m_region] += m_region_task_times[t];
+    t_max  [rt.m_region]  = std::max(t_max[rt.m_region], m_region_task_times[t]);
+  }
+
+  std::lock_guard<std::mutex> printlock(Event::printmutex);
+  printf("%s: region tasks\n", name);
+  printf("  region  seeds  tasks      cost  t_sum[ms]  t_max[ms]\n");
+  for (int r = 0; r < n_regions; ++r)
+  {
+    if (n_tasks[r] == 0) continue;
+    printf("  %6d %6d %6d %9.0f %10.3f %10.3f\n",
+           r, n_seeds[r], n_tasks[r], cost[r], 1e3 * t_sum[r], 1e3 * t_max[r]);
+  }
+}
+
 void MkBuilder::import_seeds(const TrackVec &in_seeds, std::function<insert_seed_foo> insert_seed)
 {
   // bool debug = true;
@@ -612,7 +774,7 @@ void MkBuilder::map_track_hits(TrackVec & tracks)
     if (layer_has_hits[ilayer])
     {
       const auto  &loh  = m_job->m_event_of_hits.m_layers_of_hits[ilayer];
-      const auto   size = m_event->layerHits_[ilayer].size();
+      const size_t size = m_event->layer_hits(ilayer).size();
 
       for (size_t index = 0; index < size; ++index)
       {
@@ -630,7 +792,7 @@ void MkBuilder::map_track_hits(TrackVec & tracks)
     if (layer_has_hits[ilayer])
     {
       const auto  &loh  = m_job->m_event_of_hits.m_layers_of_hits[ilayer];
-      const auto   size = m_event->layerHits_[ilayer].size();
+      const size_t size = m_event->layer_hits(ilayer).size();
 
       for (size_t index = 0; index < size; ++index)
       {
@@ -647,7 +809,7 @@ void MkBuilder::map_track_hits(TrackVec & tracks)
       int hitlyr = track.getHitLyr(i);
       if (hitidx >= 0)
       {
-        const auto & global_hit_vec = m_event->layerHits_[hitlyr];
+        const HitSpan global_hit_vec = m_event->layer_hits(hitlyr);
         track.setHitIdx(i, trackHitMap[global_hit_vec[hitidx].mcHitID()-min]);
         // printf("YYY mapped %d/%d to %d\n", hitidx, hitlyr, trackHitMap[global_hit_vec[hitidx].mcHitID()-min]);
       }
@@ -667,8 +829,8 @@ void MkBuilder::remap_track_hits(TrackVec & tracks)
 
   for (int ilayer = 0; ilayer < max_layer; ++ilayer)
   {
-    const auto & global_hit_vec = m_event->layerHits_[ilayer];
-    const auto   size = global_hit_vec.size();
+    const HitSpan global_hit_vec = m_event->layer_hits(ilayer);
+    const size_t size = global_hit_vec.size();
     for (size_t index = 0; index < size; ++index)
     {
       const auto mcHitID = global_hit_vec[index].mcHitID();
@@ -681,8 +843,8 @@ void MkBuilder::remap_track_hits(TrackVec & tracks)
 
   for (int ilayer = 0; ilayer < max_layer; ++ilayer)
   {
-    const auto & global_hit_vec = m_event->layerHits_[ilayer];
-    const auto   size = global_hit_vec.size();
+    const HitSpan global_hit_vec = m_event->layer_hits(ilayer);
+    const size_t size = global_hit_vec.size();
     for (size_t index = 0; index < size; ++index)
     {
       trackHitMap[global_hit_vec[index].mcHitID()-min] = index;
@@ -1037,7 +1199,7 @@ void MkBuilder::track_print(Track &t, const char* pref)
     int idx = t.getHitIdx(ih);
     if (idx >= 0)
     {
-      const Hit &hit = m_event->layerHits_[lyr][idx];
+      const Hit &hit = m_event->layer_hits(lyr)[idx];
       printf("    hit %2d lyr=%2d idx=%4d pos r=%7.3f z=% 8.3f   mc_hit=%4d mc_trk=%4d\n",
              ih, lyr, idx, hit.r(), hit.z(),
              hit.mcHitID(), hit.mcTrackID(m_event->simHitsInfo_));
@@ -1492,7 +1654,7 @@ void MkBuilder::FindTracksBestHit()
           prev_layer = curr_layer;
           curr_layer = layer_plan_it->m_layer;
           mkfndr->Setup(m_job->m_iter_config.m_params, m_job->m_iter_config.m_layer_configs[curr_layer],
-                        m_job->get_mask_for_layer(curr_layer));
+                        m_job->get_mask_for_layer(curr_layer), m_job->get_packed_mask_for_layer(curr_layer));
 
           dprint("at layer " << curr_layer);
           const LayerOfHits &layer_of_hits = m_job->m_event_of_hits.m_layers_of_hits[curr_layer];
@@ -1727,183 +1889,186 @@ void MkBuilder::FindTracksStandard()
 
   EventOfCombCandidates &eoccs = m_event_of_comb_cands;
 
-  tbb::parallel_for_each(m_job->regions_begin(), m_job->regions_end(),
-    [&](int region)
+  // loop over tasks of seeds within regions
+  run_region_tasks("FindTracksStandard",
+    [&](int region, int start_seed, int end_seed)
   {
     const TrackerInfo     &trk_info = m_job->m_trk_info;
     const SteeringParams  &st_par   = m_job->steering_params(region);
     const IterationParams &params   = m_job->params();
 
-    const RegionOfSeedIndices rosi(m_seedEtaSeparators, region);
+    FINDER( mkfndr );
 
-    // adaptive seeds per task based on the total estimated amount of work to divide among all threads
-    const int adaptiveSPT = clamp(Config::numThreadsEvents*eoccs.m_size/Config::numThreadsFinder + 1, 4, Config::numSeedsPerTask);
-    dprint("adaptiveSPT " << adaptiveSPT << " fill " << rosi.count() << "/" << eoccs.m_size << " region " << region);
+    const int n_seeds = end_seed - start_seed;
 
-    // loop over seeds
-    tbb::parallel_for(rosi.tbb_blk_rng_std(adaptiveSPT),
-      [&](const tbb::blocked_range<int>& seeds)
+    std::vector<std::vector<TrackCand>> tmp_cands(n_seeds);
+    for (size_t iseed = 0; iseed < tmp_cands.size(); ++iseed)
     {
-      FINDER( mkfndr );
+      tmp_cands[iseed].reserve(2 * params.maxCandsPerSeed);//factor 2 seems reasonable to start with
+    }
 
-      const int start_seed = seeds.begin();
-      const int end_seed   = seeds.end();
-      const int n_seeds    = end_seed - start_seed;
+    std::vector<std::pair<int,int>> seed_cand_idx;
+    seed_cand_idx.reserve(n_seeds * params.maxCandsPerSeed);
 
-      std::vector<std::vector<TrackCand>> tmp_cands(n_seeds);
-      for (size_t iseed = 0; iseed < tmp_cands.size(); ++iseed)
-      {
-        tmp_cands[iseed].reserve(2 * params.maxCandsPerSeed);//factor 2 seems reasonable to start with
-      }
+    auto layer_plan_it = st_par.finding_begin();
 
-      std::vector<std::pair<int,int>> seed_cand_idx;
-      seed_cand_idx.reserve(n_seeds * params.maxCandsPerSeed);
+    assert( layer_plan_it->m_pickup_only );
 
-      auto layer_plan_it = st_par.finding_begin();
+    int curr_layer = layer_plan_it->m_layer, prev_layer;
 
-      assert( layer_plan_it->m_pickup_only );
+    dprintf("\nMkBuilder::FindTracksStandard region=%d, seed_pickup_layer=%d, first_layer=%d\n",
+            region, curr_layer, (layer_plan_it + 1)->m_layer);
 
-      int curr_layer = layer_plan_it->m_layer, prev_layer;
+    // Loop over layers, starting from after the seed.
+    while (++layer_plan_it != st_par.finding_end())
+    {
+      prev_layer = curr_layer;
+      curr_layer = layer_plan_it->m_layer;
+      mkfndr->Setup(m_job->m_iter_config.m_params, m_job->m_iter_config.m_layer_configs[curr_layer],
+                    m_job->get_mask_for_layer(curr_layer), m_job->get_packed_mask_for_layer(curr_layer));
 
-      dprintf("\nMkBuilder::FindTracksStandard region=%d, seed_pickup_layer=%d, first_layer=%d\n",
-              region, curr_layer, (layer_plan_it + 1)->m_layer);
+      dprintf("\n* Processing layer %d\n", curr_layer);
 
-      // Loop over layers, starting from after the seed.
-      while (++layer_plan_it != st_par.finding_end())
-      {
-        prev_layer = curr_layer;
-        curr_layer = layer_plan_it->m_layer;
-        mkfndr->Setup(m_job->m_iter_config.m_params, m_job->m_iter_config.m_layer_configs[curr_layer],
-                      m_job->get_mask_for_layer(curr_layer));
+      const LayerOfHits &layer_of_hits = m_job->m_event_of_hits.m_layers_of_hits[curr_layer];
+      const LayerInfo   &layer_info    = trk_info.m_layers[curr_layer];
+      const FindingFoos &fnd_foos      = layer_info.is_barrel() ? m_fndfoos_brl : m_fndfoos_ec;
 
-        dprintf("\n* Processing layer %d\n", curr_layer);
+      int theEndCand = find_tracks_unroll_candidates(seed_cand_idx, start_seed, end_seed,
+                                                     prev_layer, layer_plan_it->m_pickup_only);
 
-        const LayerOfHits &layer_of_hits = m_job->m_event_of_hits.m_layers_of_hits[curr_layer];
-        const LayerInfo   &layer_info    = trk_info.m_layers[curr_layer];
-        const FindingFoos &fnd_foos      = layer_info.is_barrel() ? m_fndfoos_brl : m_fndfoos_ec;
+      if (layer_plan_it->m_pickup_only || theEndCand == 0) continue;
 
-        int theEndCand = find_tracks_unroll_candidates(seed_cand_idx, start_seed, end_seed,
-                                                       prev_layer, layer_plan_it->m_pickup_only);
+      // vectorized loop
+      for (int itrack = 0; itrack < theEndCand; itrack += NN)
+      {
+        int end = std::min(itrack + NN, theEndCand);
 
-        if (layer_plan_it->m_pickup_only || theEndCand == 0) continue;
+        dprint("processing track=" << itrack << ", label=" << eoccs.m_candidates[seed_cand_idx[itrack].first][seed_cand_idx[itrack].second].label());
 
-        // vectorized loop
-        for (int itrack = 0; itrack < theEndCand; itrack += NN)
-        {
-          int end = std::min(itrack + NN, theEndCand);
+        //fixme find a way to deal only with the candidates needed in this thread
+        mkfndr->InputTracksAndHitIdx(eoccs.m_candidates,
+                                     seed_cand_idx, itrack, end,
+                                     false);
 
-          dprint("processing track=" << itrack << ", label=" << eoccs.m_candidates[seed_cand_idx[itrack].first][seed_cand_idx[itrack].second].label());
+        //propagate to layer
+        dcall(pre_prop_print(curr_layer, mkfndr.get()));
 
-          //fixme find a way to deal only with the candidates needed in this thread
-          mkfndr->InputTracksAndHitIdx(eoccs.m_candidates,
-                                       seed_cand_idx, itrack, end,
-                                       false);
+        (mkfndr.get()->*fnd_foos.m_propagate_foo)(layer_info.m_propagate_to, end - itrack,
+                                                  Config::finding_inter_layer_pflags);
 
-          //propagate to layer
-          dcall(pre_prop_print(curr_layer, mkfndr.get()));
+        dcall(post_prop_print(curr_layer, mkfndr.get()));
 
-          (mkfndr.get()->*fnd_foos.m_propagate_foo)(layer_info.m_propagate_to, end - itrack,
-                                                    Config::finding_inter_layer_pflags);
+        dprint("now get hit range");
+        mkfndr->SelectHitIndices(layer_of_hits, end - itrack);
 
-          dcall(post_prop_print(curr_layer, mkfndr.get()));
+        find_tracks_handle_missed_layers(mkfndr.get(), layer_info, tmp_cands, seed_cand_idx,
+                                         region, start_seed, itrack, end);
 
-          dprint("now get hit range");
-          mkfndr->SelectHitIndices(layer_of_hits, end - itrack);
+        // if(Config::dumpForPlots) {
+        //std::cout << "MX number of hits in window in layer " << curr_layer << " is " <<  mkfndr->getXHitEnd(0, 0, 0)-mkfndr->getXHitBegin(0, 0, 0) << std::endl;
+        //}
 
-          find_tracks_handle_missed_layers(mkfndr.get(), layer_info, tmp_cands, seed_cand_idx,
-                                           region, start_seed, itrack, end);
+        dprint("make new candidates");
+        mkfndr->FindCandidates(layer_of_hits, tmp_cands, start_seed, end - itrack, fnd_foos);
 
-          // if(Config::dumpForPlots) {
-          //std::cout << "MX number of hits in window in layer " << curr_layer << " is " <<  mkfndr->getXHitEnd(0, 0, 0)-mkfndr->getXHitBegin(0, 0, 0) << std::endl;
-          //}
+      } //end of vectorized loop
 
-          dprint("make new candidates");
-          mkfndr->FindCandidates(layer_of_hits, tmp_cands, start_seed, end - itrack, fnd_foos);
+      // Order the input candidates. Only the best maxCandsPerSeed ones and the
+      // best short (-2) one are used below, so select those instead of sorting all.
+      for (int is = 0; is < n_seeds; ++is)
+      {
+        dprint("dump seed n " << is << " with N_input_candidates=" << tmp_cands[is].size());
 
-        } //end of vectorized loop
+        std::vector<TrackCand> &tcv = tmp_cands[is];
 
-        // sort the input candidates
-        for (int is = 0; is < n_seeds; ++is)
-        {
-          dprint("dump seed n " << is << " with N_input_candidates=" << tmp_cands[is].size());
+        auto short_beg = std::partition(tcv.begin(), tcv.end(),
+                                        [](const TrackCand &c) { return c.getLastHitIdx() != -2; });
+        const auto sel_end = tcv.begin() + std::min((int) (short_beg - tcv.begin()), params.maxCandsPerSeed);
 
-          std::sort(tmp_cands[is].begin(), tmp_cands[is].end(), sortCandByScore);
+        std::partial_sort(tcv.begin(), sel_end, short_beg, sortCandByScore);
+
+        if (short_beg != tcv.end())
+        {
+          // Put the best short one at its place by score among the selected ones;
+          // it is only considered if it comes before the last of them.
+          std::iter_swap(sel_end, std::min_element(short_beg, tcv.end(), sortCandByScore));
+          std::rotate(std::upper_bound(tcv.begin(), sel_end, *sel_end, sortCandByScore), sel_end, sel_end + 1);
         }
+      }
 
-        // now fill out the output candidates
-        for (int is = 0; is < n_seeds; ++is)
+      // now fill out the output candidates
+      for (int is = 0; is < n_seeds; ++is)
+      {
+        if (tmp_cands[is].size() > 0)
         {
-          if (tmp_cands[is].size() > 0)
+          eoccs[start_seed + is].clear();
+
+          // Put good candidates into eoccs, process -2 candidates.
+          int  n_placed    = 0;
+          bool first_short = true;
+          for (int ii = 0; ii < (int) tmp_cands[is].size() && n_placed < params.maxCandsPerSeed; ++ii)
           {
-            eoccs[start_seed + is].clear();
+            TrackCand &tc = tmp_cands[is][ii];
 
-            // Put good candidates into eoccs, process -2 candidates.
-            int  n_placed    = 0;
-            bool first_short = true;
-            for (int ii = 0; ii < (int) tmp_cands[is].size() && n_placed < params.maxCandsPerSeed; ++ii)
+            // See if we have an overlap hit available, but only if we have a true hit in this layer
+            // and pT is above the pTCutOverlap
+            if (tc.pT() > params.pTCutOverlap && tc.getLastHitLyr() == curr_layer && tc.getLastHitIdx() >= 0)
             {
-              TrackCand &tc = tmp_cands[is][ii];
-
-              // See if we have an overlap hit available, but only if we have a true hit in this layer
-              // and pT is above the pTCutOverlap
-              if (tc.pT() > params.pTCutOverlap && tc.getLastHitLyr() == curr_layer && tc.getLastHitIdx() >= 0)
-              {
-                CombCandidate &ccand = eoccs[start_seed + is];
-
-                HitMatch *hm = ccand.findOverlap(tc.originIndex(), tc.getLastHitIdx(), layer_of_hits.GetHit(tc.getLastHitIdx()).detIDinLayer());
+              CombCandidate &ccand = eoccs[start_seed + is];
 
-                if (hm)
-                {
-                  tc.addHitIdx(hm->m_hit_idx, curr_layer, hm->m_chi2);
-                  tc.incOverlapCount();
-
-                  // --- ROOT text tree dump of all found overlaps
-                  // static bool first = true;
-                  // if (first)
-                  // {
-                  //   // ./mkFit ... | perl -ne 'if (/^ZZZ_EXTRA/) { s/^ZZZ_EXTRA //og; print; }' > extra.rtt
-                  //   printf("ZZZ_EXTRA label/I:can_idx/I:layer/I:pt/F:eta/F:phi/F:"
-                  //          "chi2/F:chi2_extra/F:module/I:module_extra/I:extra_label/I\n");
-                  //   first = false;
-                  // }
-
-                  // const Hit       &h    = layer_of_hits.GetHit(tc.getLastHitIdx());
-                  // const MCHitInfo &mchi = m_event->simHitsInfo_[h.mcHitID()];
-                  // // label/I:can_idx/I:layer/I:pt/F:eta/F:phi/F:chi2_orig/F:chi2/F:chi2_extra/F:module/I:module_extra/I
-                  // printf("ZZZ_EXTRA %d %d %d %f %f %f %f %f %u %u %d\n",
-                  //        tc.label(), tc.originIndex(), curr_layer, tc.pT(), tc.posEta(), tc.posPhi(),
-                  //        tc.chi2(), hm->m_chi2, layer_of_hits.GetHit(tc.getLastHitIdx()).detIDinLayer(), hm->m_module_id, mchi.mcTrackID());
-                }
-              }
+              HitMatch *hm = ccand.findOverlap(tc.originIndex(), tc.getLastHitIdx(), layer_of_hits.GetHit(tc.getLastHitIdx()).detIDinLayer());
 
-              if (tc.getLastHitIdx() != -2)
+              if (hm)
               {
-                eoccs[start_seed + is].emplace_back(tc);
-                ++n_placed;
+                tc.addHitIdx(hm->m_hit_idx, curr_layer, hm->m_chi2);
+                tc.incOverlapCount();
+
+                // --- ROOT text tree dump of all found overlaps
+                // static bool first = true;
+                // if (first)
+                // {
+                //   // ./mkFit ... | perl -ne 'if (/^ZZZ_EXTRA/) { s/^ZZZ_EXTRA //og; print; }' > extra.rtt
+                //   printf("ZZZ_EXTRA label/I:can_idx/I:layer/I:pt/F:eta/F:phi/F:"
+                //          "chi2/F:chi2_extra/F:module/I:module_extra/I:extra_label/I\n");
+                //   first = false;
+                // }
+
+                // const Hit       &h    = layer_of_hits.GetHit(tc.getLastHitIdx());
+                // const MCHitInfo &mchi = m_event->simHitsInfo_[h.mcHitID()];
+                // // label/I:can_idx/I:layer/I:pt/F:eta/F:phi/F:chi2_orig/F:chi2/F:chi2_extra/F:module/I:module_extra/I
+                // printf("ZZZ_EXTRA %d %d %d %f %f %f %f %f %u %u %d\n",
+                //        tc.label(), tc.originIndex(), curr_layer, tc.pT(), tc.posEta(), tc.posPhi(),
+                //        tc.chi2(), hm->m_chi2, layer_of_hits.GetHit(tc.getLastHitIdx()).detIDinLayer(), hm->m_module_id, mchi.mcTrackID());
               }
-              else if (first_short)
+            }
+
+            if (tc.getLastHitIdx() != -2)
+            {
+              eoccs[start_seed + is].emplace_back(tc);
+              ++n_placed;
+            }
+            else if (first_short)
+            {
+              first_short = false;
+              if (tc.score() > eoccs[start_seed + is].m_best_short_cand.score())
               {
-                first_short = false;
-                if (tc.score() > eoccs[start_seed + is].m_best_short_cand.score())
-                {
-                  eoccs[start_seed + is].m_best_short_cand = tc;
-                }
+                eoccs[start_seed + is].m_best_short_cand = tc;
               }
             }
-
-            tmp_cands[is].clear();
           }
+
+          tmp_cands[is].clear();
         }
+      }
 
-      } // end of layer loop
+    } // end of layer loop
 
-      // final sorting
-      for (int iseed = start_seed; iseed < end_seed; ++iseed)
-      {
-        eoccs[iseed].MergeCandsAndBestShortOne(m_job->params(), true, true);
-      }
-    }); // end parallel-for over chunk of seeds within region
-  }); // end of parallel-for-each over eta regions
+    // final sorting
+    for (int iseed = start_seed; iseed < end_seed; ++iseed)
+    {
+      eoccs[iseed].MergeCandsAndBestShortOne(m_job->params(), true, true);
+    }
+  }); // end of loop over tasks of seeds within regions
 
   // debug = false;
 }
@@ -1916,30 +2081,18 @@ void MkBuilder::FindTracksCloneEngine()
 {
   // debug = true;
 
-  EventOfCombCandidates &eoccs = m_event_of_comb_cands;
-
-  tbb::parallel_for_each(m_job->regions_begin(), m_job->regions_end(),
-    [&](int region)
+  run_region_tasks("FindTracksCloneEngine",
+    [&](int region, int start_seed, int end_seed)
   {
-    const RegionOfSeedIndices rosi(m_seedEtaSeparators, region);
-
-    // adaptive seeds per task based on the total estimated amount of work to divide among all threads
-    const int adaptiveSPT = clamp(Config::numThreadsEvents*eoccs.m_size/Config::numThreadsFinder + 1, 4, Config::numSeedsPerTask);
-    dprint("adaptiveSPT " << adaptiveSPT << " fill " << rosi.count() << "/" << eoccs.m_size << " region " << region);
-
-    tbb::parallel_for(rosi.tbb_blk_rng_std(adaptiveSPT),
-      [&](const tbb::blocked_range<int>& seeds)
-    {
-      CLONER( cloner );
-      FINDER( mkfndr );
+    CLONER( cloner );
+    FINDER( mkfndr );
 
-      cloner->Setup(m_job->params());
+    cloner->Setup(m_job->params());
 
-      // loop over layers
-      find_tracks_in_layers(*cloner, mkfndr.get(), seeds.begin(), seeds.end(), region);
+    // loop over layers
+    find_tracks_in_layers(*cloner, mkfndr.get(), start_seed, end_seed, region);
 
-      cloner->Release();
-    });
+    cloner->Release();
   });
 
   // debug = false;
@@ -1983,7 +2136,7 @@ void MkBuilder::find_tracks_in_layers(CandCloner &cloner, MkFinder *mkfndr,
     prev_layer = curr_layer;
     curr_layer = layer_plan_it->m_layer;
     mkfndr->Setup(m_job->m_iter_config.m_params, m_job->m_iter_config.m_layer_configs[curr_layer],
-                  m_job->get_mask_for_layer(curr_layer));
+                  m_job->get_mask_for_layer(curr_layer), m_job->get_packed_mask_for_layer(curr_layer));
 
     const bool pickup_only = layer_plan_it->m_pickup_only;
 
@@ -2199,24 +2352,12 @@ void MkBuilder::fit_cands_BH(MkFinder *mkfndr, int start_cand, int end_cand, int
 
 void MkBuilder::BackwardFit()
 {
-  EventOfCombCandidates &eoccs = m_event_of_comb_cands;
-
-  tbb::parallel_for_each(m_job->regions_begin(), m_job->regions_end(),
-    [&](int region)
+  run_region_tasks("BackwardFit",
+    [&](int region, int start_cand, int end_cand)
   {
-    const RegionOfSeedIndices rosi(m_seedEtaSeparators, region);
-
-    // adaptive seeds per task based on the total estimated amount of work to divide among all threads
-    const int adaptiveSPT = clamp(Config::numThreadsEvents*eoccs.m_size/Config::numThreadsFinder + 1, 4, Config::numSeedsPerTask);
-    dprint("adaptiveSPT " << adaptiveSPT << " fill " << rosi.count() << "/" << eoccs.m_size << " region " << region);
+    FINDER( mkfndr );
 
-    tbb::parallel_for(rosi.tbb_blk_rng_std(adaptiveSPT),
-      [&](const tbb::blocked_range<int>& cands)
-    {
-      FINDER( mkfndr );
-
-      fit_cands(mkfndr.get(), cands.begin(), cands.end(), region);
-    });
+    fit_cands(mkfndr.get(), start_cand, end_cand, region);
   });
 }
 
@@ -46,6 +46,22 @@ struct ExecutionContext
     m_fitters.populate(n_thr - m_fitters.size());
     m_finders.populate(n_thr - m_finders.size());
   }
+
+  // Only call when no finders are in use.
+  MkFinder::HitScanStats GetHitScanStats()
+  {
+    MkFinder::HitScanStats s;
+    m_finders.ForEach([&](MkFinder *f) { s.add(f->m_hit_scan_stats); });
+    return s;
+  }
+
+  // Only call when no pooled objects are in use.
+  void GetPoolStats(PoolStats &cloners, PoolStats &fitters, PoolStats &finders)
+  {
+    cloners = m_cloners.GetStats();
+    fitters = m_fitters.GetStats();
+    finders = m_finders.GetStats();
+  }
 };
 
 extern ExecutionContext g_exe_ctx;
@@ -76,9 +92,28 @@ public:
   {
     return m_iter_mask_ifc ? m_iter_mask_ifc->get_mask_for_layer(layer) : nullptr;
   }
+
+  const uint64_t* get_packed_mask_for_layer(int layer)
+  {
+    return m_iter_mask_ifc ? m_iter_mask_ifc->get_packed_mask_for_layer(layer) : nullptr;
+  }
 };
 
 
+//==============================================================================
+// RegionTask
+//==============================================================================
+
+// A range of seeds of one region processed as a single task, with its cost
+// estimated from the number of seeds and the layers they are propagated through.
+
+struct RegionTask
+{
+  int   m_region;
+  int   m_beg, m_end;
+  float m_cost;
+};
+
 //==============================================================================
 // MkBuilder
 //==============================================================================
@@ -111,6 +146,20 @@ protected:
 
   std::atomic<int> m_nan_n_silly_per_layer_count;
 
+  // Builders for further iterations run concurrently with this one, see
+  // iteration_builder(). Kept across events so their buffers are reused.
+  std::vector<std::unique_ptr<MkBuilder>> m_iteration_builders;
+
+  // Tasks of the current region loop, see run_region_tasks().
+  std::vector<RegionTask> m_region_tasks;
+  std::vector<double>     m_region_task_times;
+
+  void partition_seeds_by_cost();
+  void print_region_task_times(const char *name) const;
+
+  template <typename FF>
+  void run_region_tasks(const char *name, FF &&f);
+
 public:
   using insert_seed_foo = void(const Track &);
 
@@ -122,6 +171,10 @@ public:
   // --------
 
   static MkBuilder* make_builder();
+
+  // Builder to use for the i-th of a set of concurrently run iterations;
+  // this builder for i = 0. Not thread safe.
+  MkBuilder& iteration_builder(int i);
   static void populate()
   {
     g_exe_ctx.populate(Config::numThreadsFinder);
@@ -130,7 +183,7 @@ public:
   int total_cands() const
   {
     int res = 0;
-    for (auto const& icomb: m_event_of_comb_cands.m_candidates) res += icomb.size();
+    for (int i = 0; i < m_event_of_comb_cands.m_size; ++i) res += m_event_of_comb_cands.m_candidates[i].size();
     return res;
   }
 
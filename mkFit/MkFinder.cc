@@ -7,6 +7,9 @@
 #include "KalmanUtilsMPlex.h"
 
 #include "MatriplexPackers.h"
+#include "SimdMath.h"
+
+#include <immintrin.h>
 
 //#define DEBUG
 #include "Debug.h"
@@ -17,11 +20,13 @@
 
 namespace mkfit {
 
-void MkFinder::Setup(const IterationParams &ip, const IterationLayerConfig &ilc, const std::vector<bool> *ihm)
+void MkFinder::Setup(const IterationParams &ip, const IterationLayerConfig &ilc, const std::vector<bool> *ihm,
+                     const uint64_t *ihb)
 {
   m_iteration_params       = &ip;
   m_iteration_layer_config = &ilc;
-  m_iteration_hit_mask     =  ihm;
+  m_iteration_hit_mask     =  ihb ? nullptr : ihm;
+  m_iteration_hit_bits     =  ihb;
 }
 
 void MkFinder::Release()
@@ -29,6 +34,7 @@ void MkFinder::Release()
   m_iteration_params       = nullptr;
   m_iteration_layer_config = nullptr;
   m_iteration_hit_mask     = nullptr;
+  m_iteration_hit_bits     = nullptr;
 }
 
 
@@ -201,13 +207,13 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
   dprintf("LayerOfHits::SelectHitIndices %s layer=%d N_proc=%d\n",
            L.is_barrel() ? "barrel" : "endcap", L.layer_id(), N_proc);
 
-  float dqv[NN], dphiv[NN], qv[NN], phiv[NN];
-  int qb1v[NN], qb2v[NN], pb1v[NN], pb2v[NN];
+  HitWindows hw;
 
   const auto assignbins = [&](int itrack, float q, float dq, float phi, float dphi){
 
     float thisPt   = 1.0f/Par[iI].At(itrack,3,0);
-    float thisEta  = std::fabs( getEta( Par[iI].At(itrack,5,0) ) );
+    // Only used to pick the window parametrization, low accuracy is fine.
+    float thisEta  = std::fabs( smath::eta<smath::MA_Fast>( Par[iI].At(itrack,5,0) ) );
     //
     float min_dq   = ILC.min_dq();
     float max_dphi = ILC.max_dphi();
@@ -217,15 +223,15 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
     dphi = std::min(std::abs(dphi), max_dphi);
     dq   = clamp(dq, min_dq, ILC.max_dq());
 
-    qv[itrack] = q;
-    phiv[itrack] = phi;
-    dphiv[itrack] = dphi;
-    dqv[itrack]   = dq;
+    hw.q   [itrack] = q;
+    hw.phi [itrack] = phi;
+    hw.dphi[itrack] = dphi;
+    hw.dq  [itrack] = dq;
 
-    qb1v[itrack] = L.GetQBinChecked(q - dq);
-    qb2v[itrack] = L.GetQBinChecked(q + dq) + 1;
-    pb1v[itrack] = L.GetPhiBin(phi - dphi);
-    pb2v[itrack] = L.GetPhiBin(phi + dphi) + 1;
+    hw.qb1[itrack] = L.GetQBinChecked(q - dq);
+    hw.qb2[itrack] = L.GetQBinChecked(q + dq) + 1;
+    hw.pb1[itrack] = L.GetPhiBin(phi - dphi);
+    hw.pb2[itrack] = L.GetPhiBin(phi + dphi) + 1;
   };
 
   const auto calcdphi2 = [&](int itrack, float dphidx, float dphidy) {
@@ -258,7 +264,7 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
       assert(dphi2 >= 0);
 #endif
 
-      const float phi  = getPhi(x, y);
+      const float phi  = smath::atan2(y, x);
       float dphi = calcdphi(dphi2);
 
       const float z  = Par[iI].ConstAt(itrack, 2, 0);
@@ -279,8 +285,7 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
         if (Config::useTrigApprox) {
           sincos4(alpha, sinA, cosA);
         } else {
-          cosA = std::cos(alpha);
-          sinA = std::sin(alpha);
+          smath::sincos(alpha, sinA, cosA);
         }
         //take abs so that we always inflate the window
         const float dist = std::abs(deltaR*sinA/cosA);
@@ -310,7 +315,7 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
       assert(dphi2 >= 0);
 #endif
 
-      const float phi  = getPhi(x, y);
+      const float phi  = smath::atan2(y, x);
       float dphi = calcdphi(dphi2);
 
       const float  r = std::sqrt(r2);
@@ -323,8 +328,8 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
         //XXXXMT4GC should we also increase dr?
         //XXXXMT4GC can we just take half of layer dz?
         const float deltaZ = 5;
-        float cosT = std::cos(Par[iI].ConstAt(itrack, 5, 0));
-        float sinT = std::sin(Par[iI].ConstAt(itrack, 5, 0));
+        float cosT, sinT;
+        smath::sincos<smath::MA_Fast>(Par[iI].ConstAt(itrack, 5, 0), sinT, cosT);
         //here alpha is the helix angular path corresponding to deltaZ
         const float k = Chg.ConstAt(itrack, 0, 0) * 100.f / (-Config::sol*Config::Bfield);
         const float alpha  = deltaZ*sinT*Par[iI].ConstAt(itrack, 3, 0)/(cosT*k);
@@ -335,6 +340,21 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
     }
   }
 
+  if (Config::useSpiralHitScan && Config::usePhiQArrays)
+    ScanHitWindowsSpiral(L, N_proc, hw);
+  else if (Config::useSimdHitScan && Config::usePhiQArrays)
+    ScanHitWindows(L, N_proc, hw);
+  else
+    ScanHitWindowsScalar(L, N_proc, hw);
+}
+
+void MkFinder::ScanHitWindowsScalar(const LayerOfHits &layer_of_hits, const int N_proc,
+                                    const HitWindows &hw)
+{
+  const LayerOfHits &L = layer_of_hits;
+
+  const int cap = HitScanCap();
+
   // Vectorizing this makes it run slower!
   //#pragma ivdep
   //#pragma omp simd
@@ -346,20 +366,25 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
       continue;
     }
 
-    const int qb1 = qb1v[itrack];
-    const int qb2 = qb2v[itrack];
-    const int pb1 = pb1v[itrack];
-    const int pb2 = pb2v[itrack];
+    ++m_hit_scan_stats.m_n_windows;
+
+    const int qb1 = hw.qb1[itrack];
+    const int qb2 = hw.qb2[itrack];
+    const int pb1 = hw.pb1[itrack];
+    const int pb2 = hw.pb2[itrack];
 
     // Used only by usePhiQArrays
-    const float q = qv[itrack];
-    const float phi = phiv[itrack];
-    const float dphi = dphiv[itrack];
-    const float dq   = dqv[itrack];
+    const float q    = hw.q   [itrack];
+    const float phi  = hw.phi [itrack];
+    const float dphi = hw.dphi[itrack];
+    const float dq   = hw.dq  [itrack];
 
     dprintf("  %2d: %6.3f %6.3f %6.6f %7.5f %3d %3d %4d %4d\n",
              itrack, q, phi, dq, dphi, qb1, qb2, pb1, pb2);
 
+    // Set when a hit is found in the window after cap hits were taken.
+    bool capped = false;
+
     // MT: One could iterate in "spiral" order, to pick hits close to the center.
     // http://stackoverflow.com/questions/398299/looping-in-a-spiral
     // This would then work best with relatively small bin sizes.
@@ -379,11 +404,11 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
 
         //SK: ~20x1024 bin sizes give mostly 1 hit per bin. Commented out for 128 bins or less
         // #pragma nounroll
-        for (uint16_t hi = L.m_phi_bin_infos[qi][pb].first; hi < L.m_phi_bin_infos[qi][pb].second; ++hi)
+        for (bin_index_t hi = L.m_phi_bin_infos[qi][pb].first; hi < L.m_phi_bin_infos[qi][pb].second; ++hi)
         {
           // MT: Access into m_hit_zs and m_hit_phis is 1% run-time each.
 
-          if (m_iteration_hit_mask && (*m_iteration_hit_mask)[L.GetOriginalHitIndex(hi)])
+          if (IsHitMasked(L, hi))
           {
             // printf("Yay, denying masked hit on layer %d, hi %d, orig idx %d\n",
             //        L.m_layer_info->m_layer_id, hi, L.GetOriginalHitIndex(hi));
@@ -392,9 +417,6 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
 
           if (Config::usePhiQArrays)
           {
-            if (XHitSize[itrack] >= MPlexHitIdxMax)
-              break;
-
             const float ddq = std::abs(q - L.m_hit_qs[hi]);
             if (ddq >= dq)
               continue;
@@ -412,15 +434,22 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
             // Avi says we should have *minimal* search windows per layer.
             // Also ... if bins are sufficiently small, we do not need the extra
             // checks, see above.
-            if (L.GetHit(hi).mcHitID() == -7)
+            // Once cap hits are taken, the rest of the window is only scanned
+            // for one more hit; gap hits found after that are ignored.
+            if (L.GetHitMcHitID(hi) == -7)
             {
               //ARH: This will need a better treatment but works for now
-              XWsrResult[itrack].m_in_gap = true;
+              if (XHitSize[itrack] < cap) XWsrResult[itrack].m_in_gap = true;
             }
-            else
+            else if (XHitSize[itrack] < cap)
             {
               XHitArr.At(itrack, XHitSize[itrack]++, 0) = hi;
             }
+            else
+            {
+              capped = true;
+              goto track_done;
+            }
           }
           else
           {
@@ -431,17 +460,442 @@ void MkFinder::SelectHitIndices(const LayerOfHits &layer_of_hits,
             // Or, at least, the phi binning was much smaller and no further checks were done.
             assert(false && "this code has not been used in a while -- see comments in code");
 
-            if (XHitSize[itrack] < MPlexHitIdxMax)
+            if (XHitSize[itrack] < cap)
             {
               XHitArr.At(itrack, XHitSize[itrack]++, 0) = hi;
             }
+            else
+            {
+              capped = true;
+              goto track_done;
+            }
           }
         } //hi
       } //pi
     } //qi
+
+  track_done:
+    if (capped) ++m_hit_scan_stats.m_n_capped;
   } //itrack
 }
 
+void MkFinder::ScanHitWindowsSpiral(const LayerOfHits &layer_of_hits, const int N_proc,
+                                    const HitWindows &hw)
+{
+  // Bins are visited in square rings around the bin of the predicted
+  // position. Up to cap hits closest to it, in units of the window half-width,
+  // are kept and stored into XHitArr nearest first. The scan stops when a ring
+  // can not contain a hit closer than the farthest one kept.
+
+  const LayerOfHits &L = layer_of_hits;
+
+  const int   cap       = HitScanCap();
+  const float q_bin_w   = 1.0f / L.m_fq;
+  const float phi_bin_w = Config::TwoPI / L.m_nphi;
+
+  float best_d [MPlexHitIdxMax];
+  int   best_hi[MPlexHitIdxMax];
+
+  for (int itrack = 0; itrack < N_proc; ++itrack)
+  {
+    if (XWsrResult[itrack].m_wsr == WSR_Outside)
+    {
+      XHitSize[itrack] = -1;
+      continue;
+    }
+
+    ++m_hit_scan_stats.m_n_windows;
+
+    const int qb1 = hw.qb1[itrack];
+    const int qb2 = hw.qb2[itrack];
+    const int pb1 = hw.pb1[itrack];
+    const int pb2 = hw.pb2[itrack];
+
+    const float q    = hw.q   [itrack];
+    const float phi  = hw.phi [itrack];
+    const float dphi = hw.dphi[itrack];
+    const float dq   = hw.dq  [itrack];
+
+    const int qc = std::clamp(L.GetQBinChecked(q), qb1, qb2 - 1);
+    const int pc = std::clamp(L.GetPhiBin(phi),    pb1, pb2 - 1);
+
+    const int n_rings = 1 + std::max(std::max(qc - qb1, qb2 - 1 - qc),
+                                     std::max(pc - pb1, pb2 - 1 - pc));
+
+    int  n_best = 0;
+    bool capped = false;
+
+    for (int r = 0; r < n_rings; ++r)
+    {
+      // Hits in ring r are at least r - 1 bins away in q or in phi.
+      if (n_best == cap && r > 1)
+      {
+        const float dq_min   = (r - 1) * q_bin_w   / dq;
+        const float dphi_min = (r - 1) * phi_bin_w / dphi;
+        if (std::min(dq_min * dq_min, dphi_min * dphi_min) >= best_d[n_best - 1])
+        {
+          ++m_hit_scan_stats.m_n_early_stops;
+          break;
+        }
+      }
+
+      for (int qi = std::max(qc - r, qb1); qi <= std::min(qc + r, qb2 - 1); ++qi)
+      {
+        // Full row at the ring's q edges, only the two side bins in between.
+        const int pstep = (r == 0 || qi == qc - r || qi == qc + r) ? 1 : 2 * r;
+
+        for (int pi = pc - r; pi <= pc + r; pi += pstep)
+        {
+          if (pi < pb1 || pi >= pb2) continue;
+
+          const int pb = pi & L.m_phi_mask;
+
+          for (bin_index_t hi = L.m_phi_bin_infos[qi][pb].first; hi < L.m_phi_bin_infos[qi][pb].second; ++hi)
+          {
+            if (IsHitMasked(L, hi))
+              continue;
+
+            const float ddq = std::abs(q - L.m_hit_qs[hi]);
+            if (ddq >= dq)
+              continue;
+            const float ddphi = cdist(std::abs(phi - L.m_hit_phis[hi]));
+            if (ddphi >= dphi)
+              continue;
+
+            if (L.GetHitMcHitID(hi) == -7)
+            {
+              XWsrResult[itrack].m_in_gap = true;
+              continue;
+            }
+
+            const float d = (ddq * ddq) / (dq * dq) + (ddphi * ddphi) / (dphi * dphi);
+
+            if (n_best == cap)
+            {
+              capped = true;
+              if (d >= best_d[cap - 1])
+                continue;
+              --n_best;
+            }
+
+            int k = n_best++;
+            for ( ; k > 0 && best_d[k - 1] > d; --k)
+            {
+              best_d [k] = best_d [k - 1];
+              best_hi[k] = best_hi[k - 1];
+            }
+            best_d [k] = d;
+            best_hi[k] = hi;
+          }
+        }
+      }
+    }
+
+    if (capped) ++m_hit_scan_stats.m_n_capped;
+
+    XHitSize[itrack] = n_best;
+    for (int k = 0; k < n_best; ++k)
+    {
+      XHitArr.At(itrack, k, 0) = best_hi[k];
+    }
+  }
+}
+
+namespace
+{
+  // Hits of a coalesced range are tested in chunks of up to this many,
+  // aligned to words of the packed iteration hit mask; selected indices are
+  // stored into a buffer with room for one extra SIMD store.
+  constexpr int kScanChunk = 64;
+  constexpr int kScanSlack = 16;
+
+#if defined(__AVX2__) && ! defined(__AVX512F__)
+  // Permutations packing set lanes of an 8-bit mask to the front, AVX2 has
+  // no compress-store.
+  struct CompressLUT
+  {
+    alignas(8) uint8_t m_perm[256][8];
+
+    CompressLUT()
+    {
+      for (int m = 0; m < 256; ++m)
+      {
+        int n = 0;
+        for (int b = 0; b < 8; ++b) if (m & (1 << b)) m_perm[m][n++] = b;
+        for (; n < 8; ++n) m_perm[m][n] = 0;
+      }
+    }
+  };
+
+  const CompressLUT s_compress_lut;
+#endif
+
+  // Stores indices of hits in [beg, end) within dq of q and within dphi of
+  // phi into idcs, returns their number. Comparisons are written as
+  // !(d >= w) to match the scalar loop, also for NaNs. Hit i is only taken if
+  // bit i - base of live is set, [beg, end) must lie within [base, base + 64).
+  inline int scan_hit_range(const float *hqs, const float *hphis, int beg, int end,
+                     float q, float dq, float phi, float dphi,
+                     uint64_t live, int base, int *idcs)
+  {
+    int n = 0;
+    int i = beg;
+
+#if defined(__AVX512F__)
+    const __m512  vq    = _mm512_set1_ps(q),    vdq   = _mm512_set1_ps(dq);
+    const __m512  vphi  = _mm512_set1_ps(phi),  vdphi = _mm512_set1_ps(dphi);
+    const __m512  vpi   = _mm512_set1_ps(Config::PI), v2pi = _mm512_set1_ps(Config::TwoPI);
+    const __m512i iota  = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+    for ( ; i < end; i += 16)
+    {
+      const __mmask16 tail = end - i >= 16 ? 0xffff : (1u << (end - i)) - 1;
+
+      const __m512 ddq   = _mm512_abs_ps(_mm512_sub_ps(vq,   _mm512_maskz_loadu_ps(tail, hqs   + i)));
+      __m512       ddphi = _mm512_abs_ps(_mm512_sub_ps(vphi, _mm512_maskz_loadu_ps(tail, hphis + i)));
+      ddphi = _mm512_mask_sub_ps(ddphi, _mm512_cmp_ps_mask(ddphi, vpi, _CMP_GT_OQ), v2pi, ddphi);
+
+      __mmask16 m = _mm512_mask_cmp_ps_mask(tail & (__mmask16) (live >> (i - base)), ddq, vdq, _CMP_NGE_UQ);
+      m = _mm512_mask_cmp_ps_mask(m, ddphi, vdphi, _CMP_NGE_UQ);
+
+      _mm512_mask_compressstoreu_epi32(idcs + n, m, _mm512_add_epi32(_mm512_set1_epi32(i), iota));
+      n += __builtin_popcount(m);
+    }
+#elif defined(__AVX__)
+    const __m256  vq    = _mm256_set1_ps(q),    vdq   = _mm256_set1_ps(dq);
+    const __m256  vphi  = _mm256_set1_ps(phi),  vdphi = _mm256_set1_ps(dphi);
+    const __m256  vpi   = _mm256_set1_ps(Config::PI), v2pi = _mm256_set1_ps(Config::TwoPI);
+    const __m256  sign  = _mm256_set1_ps(-0.0f);
+#if defined(__AVX2__)
+    const __m256i iota  = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+#endif
+
+    for ( ; i + 8 <= end; i += 8)
+    {
+      const __m256 ddq   = _mm256_andnot_ps(sign, _mm256_sub_ps(vq,   _mm256_loadu_ps(hqs   + i)));
+      __m256       ddphi = _mm256_andnot_ps(sign, _mm256_sub_ps(vphi, _mm256_loadu_ps(hphis + i)));
+      ddphi = _mm256_blendv_ps(ddphi, _mm256_sub_ps(v2pi, ddphi), _mm256_cmp_ps(ddphi, vpi, _CMP_GT_OQ));
+
+      int m = _mm256_movemask_ps(_mm256_and_ps(_mm256_cmp_ps(ddq,   vdq,   _CMP_NGE_UQ),
+                                               _mm256_cmp_ps(ddphi, vdphi, _CMP_NGE_UQ)));
+      m &= (int) (live >> (i - base)) & 0xff;
+#if defined(__AVX2__)
+      const __m256i perm = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) s_compress_lut.m_perm[m]));
+      _mm256_storeu_si256((__m256i*) (idcs + n),
+                          _mm256_permutevar8x32_epi32(_mm256_add_epi32(_mm256_set1_epi32(i), iota), perm));
+      n += __builtin_popcount(m);
+#else
+      while (m)
+      {
+        idcs[n++] = i + __builtin_ctz(m);
+        m &= m - 1;
+      }
+#endif
+    }
+#endif
+
+    // Remainder, branch-free.
+    for ( ; i < end; ++i)
+    {
+      const float ddq   = std::abs(q - hqs[i]);
+      const float ddphi = cdist(std::abs(phi - hphis[i]));
+      idcs[n] = i;
+      n += ! (ddq >= dq) & ! (ddphi >= dphi) & (int) ((live >> (i - base)) & 1);
+    }
+
+    return n;
+  }
+}
+
+void MkFinder::ScanHitWindows(const LayerOfHits &layer_of_hits, const int N_proc,
+                              const HitWindows &hw)
+{
+  // Same selection as ScanHitWindowsScalar(), done in two passes over tracks.
+  //
+  // 1. Phi bins of each q row are coalesced into hit index ranges -- hits are
+  //    sorted in q-bin, phi order and empty bins point to the position where
+  //    their hits would be, see LayerOfHits::position_empty_bins(). A window
+  //    wrapping around phi gives two ranges. Prefetches are issued for the
+  //    start of each range.
+  // 2. Hit q and phi are tested in SIMD chunks aligned to 64-hit words of the
+  //    packed iteration hit mask. Fully masked words are skipped and masked
+  //    hits are dropped from the lane masks. Passing indices are then checked
+  //    for gap hits (and for the iteration mask when it is only given in
+  //    original hit order).
+
+  const LayerOfHits &L = layer_of_hits;
+
+  const int cap = HitScanCap();
+
+  XHitRanges.clear();
+
+  for (int itrack = 0; itrack < N_proc; ++itrack)
+  {
+    XHitRangeBeg[itrack] = XHitRanges.size();
+
+    if (XWsrResult[itrack].m_wsr == WSR_Outside)
+    {
+      XHitSize[itrack] = -1;
+      continue;
+    }
+
+    const int pb1 = hw.pb1[itrack];
+    const int pb2 = hw.pb2[itrack];
+
+    for (int qi = hw.qb1[itrack]; qi < hw.qb2[itrack]; ++qi)
+    {
+      const PhiBinInfo_t *row = L.m_phi_bin_infos[qi];
+
+      for (int pi = pb1; pi < pb2; )
+      {
+        const int pb   = pi & L.m_phi_mask;
+        const int pend = pb + std::min(pb2 - pi, L.m_nphi - pb);
+
+        const int beg = row[pb].first;
+        const int end = row[pend - 1].second;
+        if (beg < end)
+        {
+          _mm_prefetch((const char*) &L.m_hit_qs  [beg], _MM_HINT_T0);
+          _mm_prefetch((const char*) &L.m_hit_phis[beg], _MM_HINT_T0);
+          XHitRanges.emplace_back(beg, end);
+        }
+
+        pi += pend - pb;
+      }
+    }
+  }
+  XHitRangeBeg[N_proc] = XHitRanges.size();
+
+  const float *hqs   = L.m_hit_qs.data();
+  const float *hphis = L.m_hit_phis.data();
+
+  int idcs[kScanChunk + kScanSlack];
+
+  for (int itrack = 0; itrack < N_proc; ++itrack)
+  {
+    if (XHitSize[itrack] < 0) continue;
+
+    ++m_hit_scan_stats.m_n_windows;
+
+    const float q    = hw.q   [itrack];
+    const float phi  = hw.phi [itrack];
+    const float dphi = hw.dphi[itrack];
+    const float dq   = hw.dq  [itrack];
+
+    int &n_sel = XHitSize[itrack];
+
+    for (int ri = XHitRangeBeg[itrack]; ri < XHitRangeBeg[itrack + 1]; ++ri)
+    {
+      for (int c = XHitRanges[ri].first, end = XHitRanges[ri].second; c < end; )
+      {
+        const int base = c & ~(kScanChunk - 1);
+        const int cend = std::min(base + kScanChunk, end);
+
+        uint64_t live = ~(uint64_t) 0;
+        if (m_iteration_hit_bits)
+        {
+          live = ~m_iteration_hit_bits[c >> 6];
+          if ((live & ((~(uint64_t) 0 >> (64 - (cend - c))) << (c - base))) == 0)
+          {
+            c = cend;
+            continue;
+          }
+        }
+
+        const int n = scan_hit_range(hqs, hphis, c, cend, q, dq, phi, dphi, live, base, idcs);
+        c = cend;
+
+        for (int k = 0; k < n; ++k)
+        {
+          const int hi = idcs[k];
+
+          if (m_iteration_hit_mask && (*m_iteration_hit_mask)[L.GetOriginalHitIndex(hi)])
+            continue;
+
+          // As in the scalar loop, once cap hits are taken only one more hit is
+          // looked for and gap hits are ignored.
+          if (L.GetHitMcHitID(hi) == -7)
+          {
+            if (n_sel < cap) XWsrResult[itrack].m_in_gap = true;
+          }
+          else if (n_sel < cap)
+          {
+            XHitArr.At(itrack, n_sel++, 0) = hi;
+          }
+          else
+          {
+            ++m_hit_scan_stats.m_n_capped;
+            goto track_done;
+          }
+        }
+      }
+    }
+  track_done: ;
+  }
+}
+
+
+//==============================================================================
+// LayerHitPacker - fills msErr / msPar from hits of a layer
+//==============================================================================
+
+namespace
+{
+#ifdef COPY_SORTED_HITS
+  // Reads the sorted per-component hit arrays of LayerOfHits, each output
+  // component is filled from a single array.
+  class LayerHitPacker
+  {
+    const LayerOfHits &m_layer;
+    int                m_idx[NN];
+    int                m_pos = 0;
+
+  public:
+    LayerHitPacker(const LayerOfHits &layer) : m_layer(layer) {}
+
+    void Reset() { m_pos = 0; }
+
+    void AddInputAt(int pos, int hit_idx)
+    {
+      while (m_pos < pos) m_idx[m_pos++] = 0;
+      m_idx[m_pos++] = hit_idx;
+    }
+
+    template<typename TMerr, typename TMpar>
+    void Pack(TMerr &err, TMpar &par)
+    {
+      for (int c = 0; c < 3; ++c)
+      {
+        const float *col = m_layer.GetHitPosColumn(c);
+        for (int i = 0; i < m_pos; ++i) par.fArray[c * NN + i] = col[m_idx[i]];
+      }
+      for (int c = 0; c < 6; ++c)
+      {
+        const float *col = m_layer.GetHitErrColumn(c);
+        for (int i = 0; i < m_pos; ++i) err.fArray[c * NN + i] = col[m_idx[i]];
+      }
+    }
+  };
+#else
+  // Gathers from Hit structures in the original hit vector.
+  class LayerHitPacker : public MatriplexHitPacker
+  {
+    const LayerOfHits &m_layer;
+
+  public:
+    LayerHitPacker(const LayerOfHits &layer) :
+      MatriplexHitPacker(* layer.GetHitArray()),
+      m_layer(layer)
+    {}
+
+    void AddInputAt(int pos, int hit_idx)
+    {
+      MatriplexHitPacker::AddInputAt(pos, m_layer.GetHit(hit_idx));
+    }
+  };
+#endif
+}
+
 
 //==============================================================================
 // AddBestHit - Best Hit Track Finding
@@ -452,7 +906,7 @@ void MkFinder::AddBestHit(const LayerOfHits &layer_of_hits, const int N_proc,
 {
   // debug = true;
 
-  MatriplexHitPacker mhp(* layer_of_hits.GetHitArray());
+  LayerHitPacker mhp(layer_of_hits);
 
   float minChi2[NN];
   int   bestHit[NN];
@@ -489,7 +943,7 @@ void MkFinder::AddBestHit(const LayerOfHits &layer_of_hits, const int N_proc,
     {
       if (hit_cnt < XHitSize[itrack])
       {
-        mhp.AddInputAt(itrack, layer_of_hits.GetHit(XHitArr.At(itrack, hit_cnt, 0)));
+        mhp.AddInputAt(itrack, XHitArr.At(itrack, hit_cnt, 0));
       }
     }
 
@@ -589,6 +1043,65 @@ void MkFinder::AddBestHit(const LayerOfHits &layer_of_hits, const int N_proc,
   //std::cout << "Par[iP](0,0,0)=" << Par[iP](0,0,0) << " Par[iC](0,0,0)=" << Par[iC](0,0,0)<< std::endl;
 }
 
+//==============================================================================
+// ComputeChi2AllHits - chi2 of all hits in the search windows
+//==============================================================================
+
+int MkFinder::ComputeChi2AllHits(const LayerOfHits &layer_of_hits, const int N_proc,
+                                 const FindingFoos &fnd_foos)
+{
+  LayerHitPacker mhp(layer_of_hits);
+
+  int maxSize = 0;
+
+  // Determine maximum number of hits for tracks in the collection.
+#pragma omp simd
+  for (int it = 0; it < NN; ++it)
+  {
+    if (it < N_proc)
+    {
+      if (XHitSize[it] > 0)
+      {
+        maxSize = std::max(maxSize, XHitSize[it]);
+      }
+    }
+  }
+
+  for (int hit_cnt = 0; hit_cnt < maxSize; ++hit_cnt)
+  {
+    mhp.Reset();
+
+#pragma omp simd
+    for (int itrack = 0; itrack < N_proc; ++itrack)
+    {
+      if (hit_cnt < XHitSize[itrack])
+      {
+        mhp.AddInputAt(itrack, XHitArr.At(itrack, hit_cnt, 0));
+      }
+    }
+
+    mhp.Pack(XHitErr[hit_cnt], XHitPar[hit_cnt]);
+  }
+
+  if (Config::chi2MultiHit)
+  {
+    // Track side of chi2 (and propagation to hit, if needed) is done once
+    // for all hit slots.
+    (*fnd_foos.m_compute_chi2_multi_foo)(Err[iP], Par[iP], Chg, XHitErr, XHitPar, maxSize,
+                                         XHitChi2, N_proc, Config::finding_intra_layer_pflags);
+  }
+  else
+  {
+    for (int hit_cnt = 0; hit_cnt < maxSize; ++hit_cnt)
+    {
+      (*fnd_foos.m_compute_chi2_foo)(Err[iP], Par[iP], Chg, XHitErr[hit_cnt], XHitPar[hit_cnt],
+                                     XHitChi2[hit_cnt], N_proc, Config::finding_intra_layer_pflags);
+    }
+  }
+
+  return maxSize;
+}
+
 //==============================================================================
 // FindCandidates - Standard Track Finding
 //==============================================================================
@@ -600,7 +1113,7 @@ void MkFinder::FindCandidates(const LayerOfHits                   &layer_of_hits
 {
   // bool debug = true;
 
-  MatriplexHitPacker mhp(* layer_of_hits.GetHitArray());
+  LayerHitPacker mhp(layer_of_hits);
 
   int maxSize = 0;
 
@@ -627,7 +1140,7 @@ void MkFinder::FindCandidates(const LayerOfHits                   &layer_of_hits
     {
       if (hit_cnt < XHitSize[itrack])
       {
-        mhp.AddInputAt(itrack, layer_of_hits.GetHit( XHitArr.At(itrack, hit_cnt, 0) ));
+        mhp.AddInputAt(itrack, XHitArr.At(itrack, hit_cnt, 0));
       }
     }
 
@@ -695,7 +1208,7 @@ void MkFinder::FindCandidates(const LayerOfHits                   &layer_of_hits
             if (chi2 < m_iteration_params->chi2CutOverlap)
             {
               CombCandidate &ccand = * newcand.combCandidate();
-              ccand.considerHitForOverlap(CandIdx(itrack, 0, 0), hit_idx, layer_of_hits.GetHit(hit_idx).detIDinLayer(), chi2);
+              ccand.considerHitForOverlap(CandIdx(itrack, 0, 0), hit_idx, layer_of_hits.GetHitDetIDinLayer(hit_idx), chi2);
             }
 
             dprint("updated track parameters x=" << newcand.parameters()[0] << " y=" << newcand.parameters()[1] << " z=" << newcand.parameters()[2] << " pt=" << 1./newcand.parameters()[3]);
@@ -758,83 +1271,72 @@ void MkFinder::FindCandidatesCloneEngine(const LayerOfHits &layer_of_hits, CandC
 {
   // bool debug = true;
 
-  MatriplexHitPacker mhp(* layer_of_hits.GetHitArray());
+  const int maxSize = ComputeChi2AllHits(layer_of_hits, N_proc, fnd_foos);
 
-  int maxSize = 0;
+  dprintf("FindCandidatesCloneEngine max hits to process=%d\n", maxSize);
 
-  // Determine maximum number of hits for tracks in the collection.
-#pragma omp simd
-  for (int it = 0; it < NN; ++it)
+  // IdxChi2List entries that only depend on the track.
+  int   nFoundPlusOne[NN], nHoles[NN];
+  float absPt[NN];
+  for (int itrack = 0; itrack < N_proc; ++itrack)
   {
-    if (it < N_proc)
-    {
-      if (XHitSize[it] > 0)
-      {
-        maxSize = std::max(maxSize, XHitSize[it]);
-      }
-    }
+    nFoundPlusOne[itrack] = NFoundHits(itrack,0,0) + 1;
+    nHoles       [itrack] = num_all_minus_one_hits(itrack);
+    absPt        [itrack] = std::abs(1.0f / Par[iP].At(itrack,3,0));
   }
 
-  dprintf("FindCandidatesCloneEngine max hits to process=%d\n", maxSize);
+  const float chi2Cut = m_iteration_params->chi2Cut;
 
   for (int hit_cnt = 0; hit_cnt < maxSize; ++hit_cnt)
   {
-    mhp.Reset();
-
-#pragma omp simd
-    for (int itrack = 0; itrack < N_proc; ++itrack)
+    // Chi2 cut for all tracks first, this vectorizes; the bookkeeping below
+    // then only visits tracks with a compatible hit in this slot.
+    float chi2s[NN];
+    int   pass [NN];
+    int   nPass = 0;
+#pragma omp simd reduction(+:nPass)
+    for (int itrack = 0; itrack < NN; ++itrack)
     {
-      if (hit_cnt < XHitSize[itrack])
-      {
-        mhp.AddInputAt(itrack, layer_of_hits.GetHit( XHitArr.At(itrack, hit_cnt, 0) ));
-      }
+      // make sure the hit was in the compatiblity window for the candidate
+      // XXX-NUM-ERR assert(chi2 >= 0);
+      chi2s[itrack] = std::abs(XHitChi2[hit_cnt][itrack]); //fixme negative chi2 sometimes...
+      pass [itrack] = (itrack < N_proc) & (hit_cnt < XHitSize[itrack]) & (chi2s[itrack] < chi2Cut);
+      nPass += pass[itrack];
     }
 
-    mhp.Pack(msErr, msPar);
-
-    //now compute the chi2 of track state vs hit
-    MPlexQF outChi2;
-    (*fnd_foos.m_compute_chi2_foo)(Err[iP], Par[iP], Chg, msErr, msPar, outChi2, N_proc, Config::finding_intra_layer_pflags);
+    if (nPass == 0) continue;
 
-#pragma omp simd // DOES NOT VECTORIZE AS IT IS NOW
     for (int itrack = 0; itrack < N_proc; ++itrack)
     {
-      // make sure the hit was in the compatiblity window for the candidate
-
-      if (hit_cnt < XHitSize[itrack])
-      {
-        // XXX-NUM-ERR assert(chi2 >= 0);
-        const float chi2 = std::abs(outChi2[itrack]); //fixme negative chi2 sometimes...
+      if ( ! pass[itrack]) continue;
 
-        dprint("chi2=" << chi2 << " for trkIdx=" << itrack << " hitIdx=" << XHitArr.At(itrack, hit_cnt, 0));
-        if (chi2 < m_iteration_params->chi2Cut)
-        {
-          const int hit_idx = XHitArr.At(itrack, hit_cnt, 0);
+      const float chi2    = chi2s[itrack];
+      const int   hit_idx = XHitArr.At(itrack, hit_cnt, 0);
 
-          // Register hit for overlap consideration, here we apply chi2 cut
-          if (chi2 < m_iteration_params->chi2CutOverlap)
-          {
-            CombCandidate &ccand = cloner.mp_event_of_comb_candidates->m_candidates[ SeedIdx(itrack, 0, 0) ];
-            ccand.considerHitForOverlap(CandIdx(itrack, 0, 0), hit_idx, layer_of_hits.GetHit(hit_idx).detIDinLayer(), chi2);
-          }
+      dprint("chi2=" << chi2 << " for trkIdx=" << itrack << " hitIdx=" << hit_idx);
 
-          IdxChi2List tmpList;
-          tmpList.trkIdx   = CandIdx(itrack, 0, 0);
-          tmpList.hitIdx   = hit_idx;
-          tmpList.module   = layer_of_hits.GetHit(hit_idx).detIDinLayer();
-          tmpList.nhits    = NFoundHits(itrack,0,0) + 1;
-          tmpList.noverlaps= NOverlapHits(itrack,0,0);
-          tmpList.nholes   = num_all_minus_one_hits(itrack);
-          tmpList.seedtype = SeedType(itrack, 0, 0);
-          tmpList.pt       = std::abs(1.0f / Par[iP].At(itrack,3,0));
-          tmpList.chi2     = Chi2(itrack, 0, 0) + chi2;
-          tmpList.chi2_hit = chi2;
-          tmpList.score    = getScoreStruct(tmpList);
-          cloner.add_cand(SeedIdx(itrack, 0, 0) - offset, tmpList);
-
-          dprint("  adding hit with hit_cnt=" << hit_cnt << " for trkIdx=" << tmpList.trkIdx << " orig Seed=" << Label(itrack, 0, 0));
-        }
+      // Register hit for overlap consideration, here we apply chi2 cut
+      if (chi2 < m_iteration_params->chi2CutOverlap)
+      {
+        CombCandidate &ccand = cloner.mp_event_of_comb_candidates->m_candidates[ SeedIdx(itrack, 0, 0) ];
+        ccand.considerHitForOverlap(CandIdx(itrack, 0, 0), hit_idx, layer_of_hits.GetHitDetIDinLayer(hit_idx), chi2);
       }
+
+      IdxChi2List tmpList;
+      tmpList.trkIdx   = CandIdx(itrack, 0, 0);
+      tmpList.hitIdx   = hit_idx;
+      tmpList.module   = layer_of_hits.GetHitDetIDinLayer(hit_idx);
+      tmpList.nhits    = nFoundPlusOne[itrack];
+      tmpList.noverlaps= NOverlapHits(itrack,0,0);
+      tmpList.nholes   = nHoles[itrack];
+      tmpList.seedtype = SeedType(itrack, 0, 0);
+      tmpList.pt       = absPt[itrack];
+      tmpList.chi2     = Chi2(itrack, 0, 0) + chi2;
+      tmpList.chi2_hit = chi2;
+      tmpList.score    = getScoreStruct(tmpList);
+      cloner.add_cand(SeedIdx(itrack, 0, 0) - offset, tmpList);
+
+      dprint("  adding hit with hit_cnt=" << hit_cnt << " for trkIdx=" << tmpList.trkIdx << " orig Seed=" << Label(itrack, 0, 0));
     }
 
   }//end loop over hits
@@ -918,7 +1420,7 @@ void MkFinder::CopyOutParErr(std::vector<CombCandidate>& seed_cand_vec,
     TrackCand &cand = seed_cand_vec[SeedIdx(i, 0, 0)][CandIdx(i, 0, 0)];
 
     // Set the track state to the updated parameters
-    Err[iO].CopyOut(i, cand.errors_nc().Array());
+    copy_out_cand_err(cand, i, iO);
     Par[iO].CopyOut(i, cand.parameters_nc().Array());
     cand.setCharge(Chg(i,0,0));
 
@@ -968,7 +1470,9 @@ void MkFinder::BkFitInputTracks(EventOfCombCandidates& eocss, int beg, int end)
   // XXXX - shall we assume only TrackCand-zero is needed and that we can freely
   // bork the HoTNode array?
 
+#ifndef COMPACT_CAND_STATE
   MatriplexTrackPacker mtp(eocss[beg][0]);
+#endif
 
   int itrack = 0;
 
@@ -978,18 +1482,25 @@ void MkFinder::BkFitInputTracks(EventOfCombCandidates& eocss, int beg, int end)
 
     Chg(itrack, 0, 0)  = trk.charge();
     CurNode[itrack]    = trk.lastCcIndex();
-    HoTNodeArr[itrack] = trk.combCandidate()->m_hots.data();
+    HoTNodeArr[itrack] = trk.combCandidate()->m_hots;
 
     // XXXX Need TrackCand* to update num-hits. Unless I collect info elsewhere
     // and fix it in BkFitOutputTracks.
     TrkCand[itrack]    = & eocss[i][0];
 
+#ifdef COMPACT_CAND_STATE
+    copy_in_cand_err(trk, itrack, iC);
+    Par[iC].CopyIn(itrack, trk.posArray());
+#else
     mtp.AddInput(trk);
+#endif
   }
 
   Chi2.SetVal(0);
 
+#ifndef COMPACT_CAND_STATE
   mtp.Pack(Err[iC], Par[iC]);
+#endif
 
   Err[iC].Scale(100.0f);
 }
@@ -1027,7 +1538,7 @@ void MkFinder::BkFitOutputTracks(EventOfCombCandidates& eocss, int beg, int end)
   {
     TrackCand &trk = eocss[i][0];
 
-    Err[iP].CopyOut(itrack, trk.errors_nc().Array());
+    copy_out_cand_err(trk, itrack, iP);
     Par[iP].CopyOut(itrack, trk.parameters_nc().Array());
 
     trk.setChi2(Chi2(itrack, 0, 0));
@@ -92,10 +92,43 @@ public:
   MPlexQI     XHitSize;
   MPlexHitIdx XHitArr;
 
+  // Search windows as determined in SelectHitIndices().
+  struct HitWindows
+  {
+    float q  [NN], dq [NN], phi[NN], dphi[NN];
+    int   qb1[NN], qb2[NN], pb1[NN], pb2[NN];
+  };
+
+  // Hit index ranges of coalesced phi bins within the windows, used by the
+  // SIMD hit scan. Ranges of track i are [XHitRangeBeg[i], XHitRangeBeg[i+1]).
+  std::vector<PhiBinInfo_t> XHitRanges;
+  int                       XHitRangeBeg[NN + 1];
+
+  // Hit scan counters, summed over all finders in ExecutionContext::GetHitScanStats().
+  struct HitScanStats
+  {
+    long long m_n_windows     = 0; // windows scanned
+    long long m_n_capped      = 0; // windows with more hits than the hit cap
+    long long m_n_early_stops = 0; // spiral scans that stopped before the last ring
+
+    void add(const HitScanStats &o)
+    {
+      m_n_windows     += o.m_n_windows;
+      m_n_capped      += o.m_n_capped;
+      m_n_early_stops += o.m_n_early_stops;
+    }
+  };
+  HitScanStats m_hit_scan_stats;
+
   // Hit errors / parameters for hit matching, update.
   MPlexHS    msErr;
   MPlexHV    msPar;
 
+  // All hits in XHitArr packed by slot and their chi2, see ComputeChi2AllHits().
+  MPlexHS    XHitErr [MPlexHitIdxMax];
+  MPlexHV    XHitPar [MPlexHitIdxMax];
+  MPlexQF    XHitChi2[MPlexHitIdxMax];
+
   // An idea: Do propagation to hit in FindTracksXYZZ functions.
   // Have some state / functions here that make this short to write.
   // This would simplify KalmanUtils (remove the propagate functions).
@@ -106,12 +139,14 @@ public:
   const IterationParams      *m_iteration_params       = nullptr;
   const IterationLayerConfig *m_iteration_layer_config = nullptr;
   const std::vector<bool>    *m_iteration_hit_mask     = nullptr;
+  const uint64_t             *m_iteration_hit_bits     = nullptr; // LayerOfHits order, used if set
 
   //============================================================================
 
   MkFinder() {}
 
-  void Setup(const IterationParams &ip, const IterationLayerConfig &ilc, const std::vector<bool> *ihm);
+  void Setup(const IterationParams &ip, const IterationLayerConfig &ilc, const std::vector<bool> *ihm,
+             const uint64_t *ihb = nullptr);
   void Release();
 
   //----------------------------------------------------------------------------
@@ -168,11 +203,34 @@ public:
 
   void SelectHitIndices(const LayerOfHits &layer_of_hits, const int N_proc);
 
+  // Fill XHitArr / XHitSize with hits within windows hw. XHitSize and
+  // XWsrResult must be initialized as in SelectHitIndices().
+  void ScanHitWindows      (const LayerOfHits &layer_of_hits, const int N_proc, const HitWindows &hw);
+  void ScanHitWindowsScalar(const LayerOfHits &layer_of_hits, const int N_proc, const HitWindows &hw);
+  void ScanHitWindowsSpiral(const LayerOfHits &layer_of_hits, const int N_proc, const HitWindows &hw);
+
+  static int HitScanCap()
+  {
+    return Config::hitScanCap > 0 ? std::min(Config::hitScanCap, MPlexHitIdxMax) : MPlexHitIdxMax;
+  }
+
+  bool IsHitMasked(const LayerOfHits &L, int hi) const
+  {
+    if (m_iteration_hit_bits) return IterationHitMasks::IsSet(m_iteration_hit_bits, hi);
+    return m_iteration_hit_mask && (*m_iteration_hit_mask)[L.GetOriginalHitIndex(hi)];
+  }
+
   void AddBestHit(const LayerOfHits &layer_of_hits, const int N_proc,
                   const FindingFoos &fnd_foos);
 
   //----------------------------------------------------------------------------
 
+  // Packs hit slots of XHitArr into XHitErr / XHitPar and computes chi2 of
+  // all of them, slot by slot or, with Config::chi2MultiHit, with one call of
+  // the multi-hit kernel. Returns the number of slots used, the largest XHitSize.
+  int  ComputeChi2AllHits(const LayerOfHits &layer_of_hits, const int N_proc,
+                          const FindingFoos &fnd_foos);
+
   void FindCandidates(const LayerOfHits                   &layer_of_hits,
                       std::vector<std::vector<TrackCand>> &tmp_candidates,
 		      const int offset, const int N_proc,
@@ -248,9 +306,34 @@ private:
     std::copy(HoTArrs[mslot], & HoTArrs[mslot][NHits(mslot, 0, 0)], trk.BeginHitsOnTrack_nc());
   }
 
-  void copy_in(const TrackCand& trk, const int mslot, const int tslot)
+  // Candidate covariance to / from Err[tslot]. Expanded from / packed into
+  // CompactSym66 with COMPACT_CAND_STATE, see TrackCand.
+  void copy_in_cand_err(const TrackCand& trk, const int mslot, const int tslot)
   {
+#ifdef COMPACT_CAND_STATE
+    float err[21] = {};
+    trk.state().errors.Unpack(err);
+    Err[tslot].CopyIn(mslot, err);
+#else
     Err[tslot].CopyIn(mslot, trk.errors().Array());
+#endif
+  }
+
+  void copy_out_cand_err(TrackCand& trk, const int mslot, const int tslot) const
+  {
+#ifdef COMPACT_CAND_STATE
+    float err[21] = {};
+    Err[tslot].CopyOut(mslot, err);
+    trk.state_nc().errors.Pack(err);
+#else
+    Err[tslot].CopyOut(mslot, trk.errors_nc().Array());
+    if (Config::emulate_compact_cand_state) CompactSym66::RoundTrip(trk.errors_nc().Array());
+#endif
+  }
+
+  void copy_in(const TrackCand& trk, const int mslot, const int tslot)
+  {
+    copy_in_cand_err(trk, mslot, tslot);
     Par[tslot].CopyIn(mslot, trk.parameters().Array());
 
     Chg  (mslot, 0, 0) = trk.charge();
@@ -271,7 +354,7 @@ private:
 
   void copy_out(TrackCand& trk, const int mslot, const int tslot) const
   {
-    Err[tslot].CopyOut(mslot, trk.errors_nc().Array());
+    copy_out_cand_err(trk, mslot, tslot);
     Par[tslot].CopyOut(mslot, trk.parameters_nc().Array());
 
     trk.setCharge(Chg  (mslot, 0, 0));
@@ -5,8 +5,13 @@
 #include "HitStructures.h"
 #include "SteeringParams.h"
 
+#include "tbb/enumerable_thread_specific.h"
 #include "tbb/parallel_for.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
 namespace mkfit {
 
 namespace StdSeq {
@@ -25,7 +30,7 @@ void LoadHits(Event &ev, EventOfHits &eoh)
                         [&](const tbb::blocked_range<int> &layers) {
                             for (int ilay = layers.begin(); ilay < layers.end(); ++ilay)
                             {
-                                eoh.SuckInHits(ilay, ev.layerHits_[ilay]);
+                                eoh.SuckInHits(ilay, ev.layer_hits(ilay));
                             }
                         });
 }
@@ -104,7 +109,10 @@ void Cmssw_ReMap_TrackHitIndices(const EventOfHits &eoh, TrackVec &out_tracks)
 // Duplicate cleaning
 //=========================================================================
 
-void find_duplicates(TrackVec &tracks)
+namespace
+{
+
+void find_duplicates_all_pairs(TrackVec &tracks)
 {
   const auto ntracks = tracks.size();
   float eta1, phi1, pt1, deta, dphi, dr2;
@@ -182,6 +190,263 @@ void find_duplicates(TrackVec &tracks)
   }       //end of loop over track1
 }
 
+// Duplicate finding over a limited set of candidate pairs. Tracks are binned in
+// eta and phi with cells at least maxdEta x maxdPhi wide, so all pairs passing
+// the dEta and dPhi cuts are in neighbouring cells. Tracks with non-finite eta
+// or phi are compared with all others, as in the all-pairs loop. Hits shared
+// between two tracks are counted from an index of (layer, hit index) -> tracks
+// instead of searching the hits of one track for each hit of the other.
+//
+// A track is marked as duplicate if it loses any pair, independently of the
+// order pairs are checked in, so rows are processed in parallel and the result
+// is the same as that of find_duplicates_all_pairs().
+
+struct DuplicateScratch
+{
+  std::vector<int> m_n_shared; // hits of track j shared with the current row
+  std::vector<int> m_touched;
+  std::vector<int> m_marked;
+};
+
+struct DuplicateFinder
+{
+  const TrackVec    &m_tracks;
+  const int          m_n;
+
+  std::vector<float> m_eta, m_phi, m_pt;
+
+  int                m_neta = 1, m_nphi = 1;
+  float              m_eta_min = 0, m_eta_inv_w = 0, m_phi_inv_w = 0;
+  std::vector<int>   m_cell_of;      // -1 for tracks with non-finite eta or phi
+  std::vector<int>   m_cell_begin;
+  std::vector<int>   m_cell_tracks;  // increasing track index within each cell
+  std::vector<int>   m_odd;
+
+  std::vector<int>                 m_key_begin;
+  std::vector<std::pair<int, int>> m_key_tracks;   // (track, number of times the hit is on it)
+  std::vector<int>                 m_track_begin;
+  std::vector<int>                 m_track_keys;
+
+  DuplicateFinder(const TrackVec &tracks) :
+    m_tracks(tracks), m_n(tracks.size()),
+    m_eta(m_n), m_phi(m_n), m_pt(m_n), m_cell_of(m_n, -1)
+  {
+    for (int i = 0; i < m_n; ++i)
+    {
+      m_eta[i] = m_tracks[i].momEta();
+      m_phi[i] = m_tracks[i].momPhi();
+      m_pt [i] = m_tracks[i].pT();
+    }
+    build_grid();
+    if (Config::useHitsForDuplicates) build_hit_index();
+  }
+
+  bool in_grid(int i) const
+  {
+    return std::isfinite(m_eta[i]) && std::abs(m_phi[i]) <= Config::TwoPI;
+  }
+
+  void build_grid()
+  {
+    float eta_max = 0;
+    bool  first   = true;
+    for (int i = 0; i < m_n; ++i)
+    {
+      if ( ! in_grid(i)) continue;
+      if (first) { m_eta_min = eta_max = m_eta[i]; first = false; }
+      m_eta_min = std::min(m_eta_min, m_eta[i]);
+      eta_max   = std::max(eta_max,   m_eta[i]);
+    }
+
+    // 1% margin on cell sizes covers rounding of cell indices.
+    const double span = (double) eta_max - m_eta_min;
+    const double w    = 1.01 * Config::maxdEta;
+    const double neta = w > 0 ? std::floor(span / w) : m_n;
+    m_neta      = (int) std::max(1.0, std::min(neta, (double) std::max(m_n, 1)));
+    m_eta_inv_w = span > 0 ? m_neta / span : 0;
+
+    const double nphi = std::floor(Config::TwoPI / (1.01 * Config::maxdPhi));
+    m_nphi      = nphi >= 3 && nphi <= 1024 ? (int) nphi : 1;
+    m_phi_inv_w = m_nphi / Config::TwoPI;
+
+    m_cell_begin.assign(m_neta * m_nphi + 1, 0);
+    for (int i = 0; i < m_n; ++i)
+    {
+      if ( ! in_grid(i)) { m_odd.push_back(i); continue; }
+
+      const float phi = squashPhiMinimal(m_phi[i]);
+      const int   ie  = std::min((int) ((m_eta[i] - m_eta_min) * m_eta_inv_w), m_neta - 1);
+      const int   ip  = std::max(std::min((int) ((phi + Config::PI) * m_phi_inv_w), m_nphi - 1), 0);
+      m_cell_of[i] = ie * m_nphi + ip;
+      ++m_cell_begin[m_cell_of[i] + 1];
+    }
+    for (int c = 0; c < m_neta * m_nphi; ++c) m_cell_begin[c + 1] += m_cell_begin[c];
+
+    std::vector<int> pos(m_cell_begin.begin(), m_cell_begin.end() - 1);
+    m_cell_tracks.resize(m_cell_begin.back());
+    for (int i = 0; i < m_n; ++i)
+    {
+      if (m_cell_of[i] >= 0) m_cell_tracks[pos[m_cell_of[i]]++] = i;
+    }
+  }
+
+  void build_hit_index()
+  {
+    std::vector<std::pair<uint64_t, int>> hits;
+    for (int i = 0; i < m_n; ++i)
+    {
+      for (auto h = m_tracks[i].BeginHitsOnTrack(); h != m_tracks[i].EndHitsOnTrack(); ++h)
+      {
+        if (h->index >= 0)
+          hits.emplace_back(((uint64_t) (uint32_t) h->layer << 32) | (uint32_t) h->index, i);
+      }
+    }
+    std::sort(hits.begin(), hits.end());
+
+    m_track_begin.assign(m_n + 1, 0);
+    for (size_t k = 0; k < hits.size(); )
+    {
+      m_key_begin.push_back(m_key_tracks.size());
+      const uint64_t key = hits[k].first;
+      while (k < hits.size() && hits[k].first == key)
+      {
+        const int track = hits[k].second;
+        int       mult  = 0;
+        for ( ; k < hits.size() && hits[k] == std::make_pair(key, track); ++k) ++mult;
+        m_key_tracks.emplace_back(track, mult);
+        ++m_track_begin[track + 1];
+      }
+    }
+    m_key_begin.push_back(m_key_tracks.size());
+
+    for (int i = 0; i < m_n; ++i) m_track_begin[i + 1] += m_track_begin[i];
+    std::vector<int> pos(m_track_begin.begin(), m_track_begin.end() - 1);
+    m_track_keys.resize(m_track_begin.back());
+    for (int g = 0; g < (int) m_key_begin.size() - 1; ++g)
+    {
+      for (int m = m_key_begin[g]; m < m_key_begin[g + 1]; ++m)
+        m_track_keys[pos[m_key_tracks[m].first]++] = g;
+    }
+  }
+
+  // For all j > i, number of hits of track j that are also on track i.
+  void count_shared_hits(int i, DuplicateScratch &s) const
+  {
+    for (int k = m_track_begin[i]; k < m_track_begin[i + 1]; ++k)
+    {
+      const int g = m_track_keys[k];
+      for (int m = m_key_begin[g]; m < m_key_begin[g + 1]; ++m)
+      {
+        const int j = m_key_tracks[m].first;
+        if (j <= i) continue;
+        if (s.m_n_shared[j] == 0) s.m_touched.push_back(j);
+        s.m_n_shared[j] += m_key_tracks[m].second;
+      }
+    }
+  }
+
+  // Cuts as in find_duplicates_all_pairs(), for i < j.
+  bool is_duplicate_pair(int i, int j, const DuplicateScratch &s) const
+  {
+    const Track &track = m_tracks[i], &track2 = m_tracks[j];
+    if (track.label() == track2.label())
+      return false;
+
+    const float deta = std::abs(m_eta[j] - m_eta[i]);
+    if (deta > Config::maxdEta)
+      return false;
+
+    const float dphi = std::abs(squashPhiMinimal(m_phi[i] - m_phi[j]));
+    if (dphi > Config::maxdPhi)
+      return false;
+
+    const float dr2 = dphi * dphi + deta * deta;
+    if (dr2 < Config::maxdRSquared)
+      return true;
+
+    if (m_pt[i] == 0 || m_pt[j] == 0)
+      return false;
+    if ( ! (std::abs((1 / m_pt[j]) - (1 / m_pt[i])) < Config::maxdPt))
+      return false;
+
+    if (Config::useHitsForDuplicates)
+    {
+      const float numHitsShared  = s.m_n_shared[j];
+      const float fracHitsShared = numHitsShared / std::min(track.nFoundHits(), track2.nFoundHits());
+      if (fracHitsShared < Config::minFracHitsShared)
+        return false;
+    }
+    return true;
+  }
+
+  void process_track(int i, DuplicateScratch &s) const
+  {
+    if (Config::useHitsForDuplicates) count_shared_hits(i, s);
+
+    auto check = [&](int j)
+    {
+      if (is_duplicate_pair(i, j, s))
+        s.m_marked.push_back(m_tracks[i].score() > m_tracks[j].score() ? j : i);
+    };
+
+    if (m_cell_of[i] < 0)
+    {
+      for (int j = i + 1; j < m_n; ++j) check(j);
+    }
+    else
+    {
+      const int ie = m_cell_of[i] / m_nphi, ip = m_cell_of[i] % m_nphi;
+      const int dp = m_nphi >= 3 ? 1 : 0;
+      for (int e = std::max(ie - 1, 0); e <= std::min(ie + 1, m_neta - 1); ++e)
+      {
+        for (int p = ip - dp; p <= ip + dp; ++p)
+        {
+          const int c = e * m_nphi + (p + m_nphi) % m_nphi;
+          const int *beg = &m_cell_tracks[0] + m_cell_begin[c];
+          const int *end = &m_cell_tracks[0] + m_cell_begin[c + 1];
+          for (const int *j = std::upper_bound(beg, end, i); j != end; ++j) check(*j);
+        }
+      }
+      for (auto j = std::upper_bound(m_odd.begin(), m_odd.end(), i); j != m_odd.end(); ++j) check(*j);
+    }
+
+    for (int j : s.m_touched) s.m_n_shared[j] = 0;
+    s.m_touched.clear();
+  }
+
+  void find(TrackVec &tracks) const
+  {
+    tbb::enumerable_thread_specific<DuplicateScratch> scratch;
+
+    tbb::parallel_for(tbb::blocked_range<int>(0, m_n, 64),
+      [&](const tbb::blocked_range<int> &r)
+      {
+        DuplicateScratch &s = scratch.local();
+        if ((int) s.m_n_shared.size() < m_n) s.m_n_shared.assign(m_n, 0);
+
+        for (int i = r.begin(); i < r.end(); ++i) process_track(i, s);
+      });
+
+    for (auto &s : scratch)
+    {
+      for (int i : s.m_marked) tracks[i].setDuplicateValue(true);
+    }
+  }
+};
+
+} // end anonymous namespace
+
+void find_duplicates(TrackVec &tracks)
+{
+  if (Config::findDuplicatesBruteForce)
+  {
+    find_duplicates_all_pairs(tracks);
+    return;
+  }
+
+  DuplicateFinder(tracks).find(tracks);
+}
+
 void remove_duplicates(TrackVec & tracks)
 {
   tracks.erase(std::remove_if(tracks.begin(),tracks.end(),
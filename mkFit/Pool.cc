@@ -0,0 +1,73 @@
+#include "Pool.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace mkfit {
+
+namespace
+{
+  struct NumaTopology
+  {
+    int              m_n_nodes = 1;
+    std::vector<int> m_cpu_node;
+
+    // cpulist is a comma separated list of cpus and cpu ranges, e.g. 0-11,24-35.
+    void add_cpus(int node, FILE *f)
+    {
+      int first, last;
+      while (fscanf(f, "%d", &first) == 1)
+      {
+        last = first;
+        int c = fgetc(f);
+        if (c == '-')
+        {
+          if (fscanf(f, "%d", &last) != 1) break;
+          c = fgetc(f);
+        }
+        if (last >= (int) m_cpu_node.size()) m_cpu_node.resize(last + 1, 0);
+        for (int cpu = first; cpu <= last; ++cpu) m_cpu_node[cpu] = node;
+        if (c != ',') break;
+      }
+    }
+
+    NumaTopology()
+    {
+      int node = 0;
+      for ( ; ; ++node)
+      {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if ( ! f) break;
+        add_cpus(node, f);
+        fclose(f);
+      }
+      m_n_nodes = std::max(node, 1);
+    }
+  };
+
+  const NumaTopology& numa_topology()
+  {
+    static const NumaTopology topo;
+    return topo;
+  }
+}
+
+int NumaNodeCount()
+{
+  return numa_topology().m_n_nodes;
+}
+
+int NumaNodeOfCurrentCpu()
+{
+  const NumaTopology &t = numa_topology();
+
+  const int cpu = sched_getcpu();
+  return (cpu >= 0 && cpu < (int) t.m_cpu_node.size()) ? t.m_cpu_node[cpu] : 0;
+}
+
+} // end namespace mkfit
@@ -1,42 +1,99 @@
 #ifndef Pool_h
 #define Pool_h
 #include <functional>
+#include <memory>
+#include <mm_malloc.h>
+
+#include "Config.h"
 
 #include "tbb/concurrent_queue.h"
+#include "tbb/enumerable_thread_specific.h"
 
 namespace mkfit {
 
+//==============================================================================
+// NUMA topology, from /sys/devices/system/node; a single node if unavailable.
+//==============================================================================
+
+int NumaNodeCount();
+int NumaNodeOfCurrentCpu();
+
+//==============================================================================
+// Pool
+//==============================================================================
+
+// Objects are first taken from / returned to a small per-thread cache. When
+// that is empty / full, a shared queue of the NUMA node the calling thread
+// runs on is used, then queues of other nodes. New objects are created on the
+// thread that needs them so their memory is first touched on its node.
+
+struct PoolStats
+{
+  long long m_n_local   = 0; // served from the calling thread's cache
+  long long m_n_shared  = 0; // taken from the shared queue of the same node
+  long long m_n_remote  = 0; // taken from a shared queue of another node
+  long long m_n_created = 0;
+
+  void add(const PoolStats &o)
+  {
+    m_n_local   += o.m_n_local;
+    m_n_shared  += o.m_n_shared;
+    m_n_remote  += o.m_n_remote;
+    m_n_created += o.m_n_created;
+  }
+};
+
 template <typename TT>
 struct Pool
 {
   typedef std::function<TT*()>     CFoo_t;
   typedef std::function<void(TT*)> DFoo_t;
 
+  // Two objects per thread cover an event-level and a nested region-level task.
+  static constexpr int s_local_size = 2;
+
+  struct LocalCache
+  {
+    TT        *m_objs[s_local_size];
+    int        m_n = 0;
+    PoolStats  m_stats;
+  };
+
+  typedef tbb::concurrent_queue<TT*> Queue_t;
+
   CFoo_t m_create_foo  = []()     { return new (_mm_malloc(sizeof(TT), 64)) TT; };
   DFoo_t m_destroy_foo = [](TT* x){ x->~TT(); _mm_free(x); };
 
-  tbb::concurrent_queue<TT*> m_stack;
+  tbb::enumerable_thread_specific<LocalCache, tbb::cache_aligned_allocator<LocalCache>,
+                                  tbb::ets_key_per_instance>  m_local;
+  int                                                         m_n_nodes;
+  std::unique_ptr<Queue_t[]>                                  m_shared;
 
-  size_t size() { return m_stack.unsafe_size(); }
+  // Not thread safe, counts objects in all caches and queues.
+  size_t size()
+  {
+    size_t s = 0;
+    for (int n = 0; n < m_n_nodes; ++n) s += m_shared[n].unsafe_size();
+    for (auto &lc : m_local)            s += lc.m_n;
+    return s;
+  }
 
   void populate(int threads = Config::numThreadsFinder)
   {
+    Queue_t &q = m_shared[node()];
     for (int i = 0; i < threads; ++i)
     {
-      m_stack.push(m_create_foo());
+      ++m_local.local().m_stats.m_n_created;
+      q.push(m_create_foo());
     }
   }
 
-  Pool() {}
-  Pool(CFoo_t cf, DFoo_t df) : m_create_foo(cf), m_destroy_foo(df) {}
+  Pool() : m_n_nodes(NumaNodeCount()), m_shared(new Queue_t[m_n_nodes]) {}
+  Pool(CFoo_t cf, DFoo_t df) : Pool() { m_create_foo = cf; m_destroy_foo = df; }
 
   ~Pool()
   {
-    TT *x;
-    while (m_stack.try_pop(x))
-    {
-      m_destroy_foo(x);
-    }
+    ForEach(m_destroy_foo);
   }
 
   void SetCFoo(CFoo_t cf) { m_create_foo  = cf; }
@@ -44,20 +101,77 @@ struct Pool
 
   TT* GetFromPool()
   {
+    LocalCache &lc = m_local.local();
+    if (lc.m_n > 0)
+    {
+      ++lc.m_stats.m_n_local;
+      return lc.m_objs[--lc.m_n];
+    }
+
     TT *x;
-    if (m_stack.try_pop(x)) {
+    const int nd = node();
+    if (m_shared[nd].try_pop(x))
+    {
+      ++lc.m_stats.m_n_shared;
       return x;
-    } else {
-      return m_create_foo();
     }
+    for (int i = 1; i < m_n_nodes; ++i)
+    {
+      if (m_shared[(nd + i) % m_n_nodes].try_pop(x))
+      {
+        ++lc.m_stats.m_n_remote;
+        return x;
+      }
+    }
+
+    ++lc.m_stats.m_n_created;
+    return m_create_foo();
   }
 
   void ReturnToPool(TT *x)
   {
-    m_stack.push(x);
+    LocalCache &lc = m_local.local();
+    if (lc.m_n < s_local_size)
+    {
+      lc.m_objs[lc.m_n++] = x;
+    }
+    else
+    {
+      m_shared[node()].push(x);
+    }
   }
-};
 
+  // Visit all pooled objects, must not run concurrently with Get/Return.
+  template <typename FF>
+  void ForEach(FF f)
+  {
+    for (int n = 0; n < m_n_nodes; ++n)
+    {
+      for (auto i = m_shared[n].unsafe_begin(); i != m_shared[n].unsafe_end(); ++i)
+      {
+        f(*i);
+      }
+    }
+    for (auto &lc : m_local)
+    {
+      for (int i = 0; i < lc.m_n; ++i)
+      {
+        f(lc.m_objs[i]);
+      }
+    }
+  }
+
+  // Summed over all threads, must not run concurrently with Get/Return.
+  PoolStats GetStats()
+  {
+    PoolStats s;
+    for (auto &lc : m_local) s.add(lc.m_stats);
+    return s;
+  }
+
+private:
+  int node() const { return m_n_nodes > 1 ? NumaNodeOfCurrentCpu() : 0; }
+};
 
 } // end namespace mkfit
 #endif
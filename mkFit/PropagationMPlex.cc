@@ -1,5 +1,6 @@
 #include "MaterialEffects.h"
 #include "PropagationMPlex.h"
+#include "SimdMath.h"
 
 //#define DEBUG
 #include "Debug.h"
@@ -297,8 +298,9 @@ void helixAtRFromIterativeCCSFullJac(const MPlexLV& inPar, const MPlexQI& inChg,
 
       float cosa = 0., sina = 0.;
       //no trig approx here, phi and theta can be large
-            float cosP = std::cos(phiin), sinP = std::sin(phiin);
-      const float cosT = std::cos(theta), sinT = std::sin(theta);
+      float cosP, sinP, cosT, sinT;
+      smath::sincos(phiin, sinP, cosP);
+      smath::sincos(theta, sinT, cosT);
       float pxin = cosP/ipt;
       float pyin = sinP/ipt;
 
@@ -315,8 +317,7 @@ void helixAtRFromIterativeCCSFullJac(const MPlexLV& inPar, const MPlexQI& inChg,
 	if (Config::useTrigApprox) {
 	  sincos4(ialpha, sina, cosa);
 	} else {
-	  cosa=std::cos(ialpha);
-	  sina=std::sin(ialpha);
+	  smath::sincos(ialpha, sina, cosa);
 	}
 
 	//derivatives of alpha
@@ -332,8 +333,7 @@ void helixAtRFromIterativeCCSFullJac(const MPlexLV& inPar, const MPlexQI& inChg,
 
 	//need phi at origin, so this goes before redefining phi
 	//no trig approx here, phi can be large
-	cosP=std::cos(outPar.At(n, 4, 0));
-	sinP=std::sin(outPar.At(n, 4, 0));
+	smath::sincos(outPar.At(n, 4, 0), sinP, cosP);
 
 	outPar.At(n, 2, 0) = outPar.ConstAt(n, 2, 0) + k*ialpha*cosT/(ipt*sinT);
 	outPar.At(n, 3, 0) = ipt;
@@ -399,7 +399,10 @@ void helixAtRFromIterativeCCS(const MPlexLV& inPar,     const MPlexQI& inChg, co
   errorProp  .SetVal(0.f);
   outFailFlag.SetVal(0.f);
 
-  helixAtRFromIterativeCCS_impl(inPar, inChg, msRad, outPar, errorProp, outFailFlag, 0, NN, N_proc, pflags);
+  if (pflags.closed_form_r)
+    helixAtRClosedFormCCS_impl  (inPar, inChg, msRad, outPar, errorProp, outFailFlag, 0, NN, N_proc, pflags);
+  else
+    helixAtRFromIterativeCCS_impl(inPar, inChg, msRad, outPar, errorProp, outFailFlag, 0, NN, N_proc, pflags);
 }
 
 
@@ -542,7 +545,7 @@ void propagateHelixToZMPlex(const MPlexLS &inErr,  const MPlexLV& inPar,
      for (int n = 0; n < NN; ++n) 
      {
        const int zbin = getZbinME(msZ(n, 0, 0));
-       const int rbin = getRbinME(std::hypot(outPar(n, 0, 0), outPar(n, 1, 0)));
+       const int rbin = getRbinME(smath::hypot(outPar(n, 0, 0), outPar(n, 1, 0)));
 
        hitsRl(n, 0, 0) = (zbin>=0 && zbin<Config::nBinsZME && rbin>=0 && rbin<Config::nBinsRME) ? getRlVal(zbin,rbin) : 0.f; // protect against crazy propagations
        hitsXi(n, 0, 0) = (zbin>=0 && zbin<Config::nBinsZME && rbin>=0 && rbin<Config::nBinsRME) ? getXiVal(zbin,rbin) : 0.f; // protect against crazy propagations
@@ -597,6 +600,9 @@ void helixAtZ(const MPlexLV& inPar,  const MPlexQI& inChg, const MPlexQF &msZ,
 {
   errorProp.SetVal(0.f);
 
+  // Bitfield access in the loop prevents vectorization.
+  const bool use_param_b_field = pflags.use_param_b_field;
+
 #pragma omp simd
   for (int n = 0; n < NN; ++n)
     {
@@ -614,7 +620,8 @@ void helixAtZ(const MPlexLV& inPar,  const MPlexQI& inChg, const MPlexQF &msZ,
       const float phiin = inPar.ConstAt(n, 4, 0);
       const float theta = inPar.ConstAt(n, 5, 0);
 
-      const float k = inChg.ConstAt(n, 0, 0) * 100.f / (-Config::sol*(pflags.use_param_b_field?Config::BfieldFromZR(zin,hipo(inPar.ConstAt(n,0,0),inPar.ConstAt(n,1,0))):Config::Bfield));
+      const float bf = smath::select(use_param_b_field, Config::BfieldFromZR(zin,hipo(inPar.ConstAt(n,0,0),inPar.ConstAt(n,1,0))), Config::Bfield);
+      const float k = inChg.ConstAt(n, 0, 0) * 100.f / (-Config::sol*bf);
 
       dprint_np(n, std::endl << "input parameters"
             << " inPar.ConstAt(n, 0, 0)=" << std::setprecision(9) << inPar.ConstAt(n, 0, 0)
@@ -629,8 +636,9 @@ void helixAtZ(const MPlexLV& inPar,  const MPlexQI& inChg, const MPlexQF &msZ,
 
       float cosaTmp = 0., sinaTmp = 0.;
       //no trig approx here, phi can be large
-      const float cosP = std::cos(phiin), sinP = std::sin(phiin);
-      const float cosT = std::cos(theta), sinT = std::sin(theta);
+      float cosP, sinP, cosT, sinT;
+      smath::sincos(phiin, sinP, cosP);
+      smath::sincos(theta, sinT, cosT);
       const float pxin = cosP*pt;
       const float pyin = sinP*pt;
 
@@ -645,8 +653,7 @@ void helixAtZ(const MPlexLV& inPar,  const MPlexQI& inChg, const MPlexQF &msZ,
       if (Config::useTrigApprox) {
 	sincos4(alpha, sinaTmp, cosaTmp);
       } else {
-	cosaTmp=std::cos(alpha);
-	sinaTmp=std::sin(alpha);
+	smath::sincos(alpha, sinaTmp, cosaTmp);
       }
       const float cosa = cosaTmp;
       const float sina = sinaTmp;
@@ -660,8 +667,8 @@ void helixAtZ(const MPlexLV& inPar,  const MPlexQI& inChg, const MPlexQF &msZ,
       dprint_np(n, std::endl << "outPar.At(n, 0, 0)=" << outPar.At(n, 0, 0) << " outPar.At(n, 1, 0)=" << outPar.At(n, 1, 0)
 		<< " pxin=" << pxin << " pyin=" << pyin);
 
-      const float sCosPsina = std::sin(cosP*sina);
-      const float cCosPsina = std::cos(cosP*sina);
+      float sCosPsina, cCosPsina;
+      smath::sincos(cosP*sina, sCosPsina, cCosPsina);
 
       errorProp(n,0,2) = cosP*sinT*(sinP*cosa*sCosPsina - cosa)/cosT;
       errorProp(n,0,3) = cosP*sinT*deltaZ*cosa*( 1.f - sinP*sCosPsina )/(cosT*ipt) - k*(cosP*sina - sinP*(1.f-cCosPsina))/(ipt*ipt);
@@ -706,27 +713,33 @@ void applyMaterialEffects(const MPlexQF &hitsRl, const MPlexQF& hitsXi, const MP
 #pragma omp simd
   for (int n = 0; n < NN; ++n)
     {
-      float radL = hitsRl.ConstAt(n,0,0);
-      if (radL < 1e-13f) continue;//ugly, please fixme
-      const float theta = outPar.ConstAt(n,5,0);
-      const float pt = 1.f/outPar.ConstAt(n,3,0);//fixme, make sure it is positive?
-      const float p = pt/std::sin(theta);
+      // Lanes without material are left unchanged through selects instead of
+      // the former 'continue' statements so that the loop vectorizes. Both
+      // sides of a select get evaluated, so those lanes compute with inputs
+      // that cannot raise FP exceptions (e.g. 1/pt of an unused lane).
+      const float radL0 = hitsRl.ConstAt(n,0,0);
+      const bool  has_rl = radL0 >= 1e-13f;
+      const float theta = smath::select(has_rl, outPar.ConstAt(n,5,0), 1.f);
+      float sinT, cosT;
+      smath::sincos(theta, sinT, cosT);
+      const float pt = 1.f/smath::select(has_rl, outPar.ConstAt(n,3,0), 1.f);//fixme, make sure it is positive?
+      const float p = pt/sinT;
       const float p2 = p*p;
       constexpr float mpi = 0.140; // m=140 MeV, pion
       constexpr float mpi2 = mpi*mpi; // m=140 MeV, pion
       const float beta2 = p2/(p2+mpi2);
       const float beta = std::sqrt(beta2);
       //radiation lenght, corrected for the crossing angle (cos alpha from dot product of radius vector and momentum)
-      const float invCos = (isBarrel ? p/pt : 1./std::abs(std::cos(theta)) );
-      radL = radL * invCos; //fixme works only for barrel geom
+      const float invCos = smath::select(isBarrel, p/pt, 1.f/std::abs(smath::select(isBarrel, 1.f, cosT)));
+      // XXX-KMD radL < 0, see your fixme above! Repeating bailout
+      const bool  has_mat = has_rl & (radL0 * invCos >= 1e-13f);//ugly, please fixme
+      const float radL = smath::select(has_mat, radL0 * invCos, 1.f); //fixme works only for barrel geom
       // multiple scattering
       //vary independently phi and theta by the rms of the planar multiple scattering angle
-      // XXX-KMD radL < 0, see your fixme above! Repeating bailout
-      if (radL < 1e-13f) continue;
       // const float thetaMSC = 0.0136f*std::sqrt(radL)*(1.f+0.038f*std::log(radL))/(beta*p);// eq 32.15
       // const float thetaMSC2 = thetaMSC*thetaMSC;
-      const float thetaMSC = 0.0136f*(1.f+0.038f*std::log(radL))/(beta*p);// eq 32.15
-      const float thetaMSC2 = thetaMSC*thetaMSC*radL;
+      const float thetaMSC = 0.0136f*(1.f+0.038f*smath::log(radL))/(beta*p);// eq 32.15
+      const float thetaMSC2 = smath::select(has_mat, thetaMSC*thetaMSC*radL, 0.f);
       outErr.At(n, 4, 4) += thetaMSC2;
       // outErr.At(n, 4, 5) += thetaMSC2;
       outErr.At(n, 5, 5) += thetaMSC2;
@@ -741,14 +754,14 @@ void applyMaterialEffects(const MPlexQF &hitsRl, const MPlexQF& hitsXi, const MP
       constexpr float me = 0.0005; // m=0.5 MeV, electron
       const float wmax = 2.f*me*beta2*gamma2 / ( 1.f + 2.f*gamma*me/mpi + me*me/(mpi*mpi) );
       constexpr float I = 16.0e-9 * 10.75;
-      const float deltahalf = std::log(28.816e-9f * std::sqrt(2.33f*0.498f)/I) + std::log(beta*gamma) - 0.5f;
-      const float dEdx = beta<1.f ? (2.f*(hitsXi.ConstAt(n,0,0) * invCos * (0.5f*std::log(2.f*me*beta2*gamma2*wmax/(I*I)) - beta2 - deltahalf) / beta2)) : 0.f;//protect against infs and nans
+      const float deltahalf = std::log(28.816e-9f * std::sqrt(2.33f*0.498f)/I) + smath::log(beta*gamma) - 0.5f;
+      const float dEdx = smath::select(beta<1.f, (2.f*(hitsXi.ConstAt(n,0,0) * invCos * (0.5f*smath::log(2.f*me*beta2*gamma2*wmax/(I*I)) - beta2 - deltahalf) / beta2)), 0.f);//protect against infs and nans
       // dEdx = dEdx*2.;//xi in cmssw is defined with an extra factor 0.5 with respect to formula 27.1 in pdg
       //std::cout << "dEdx=" << dEdx << " delta=" << deltahalf << " wmax=" << wmax << " Xi=" << hitsXi.ConstAt(n,0,0) << std::endl;
       const float dP = propSign.ConstAt(n,0,0)*dEdx/beta;
-      outPar.At(n, 3, 0) = p/((p+dP)*pt);
+      outPar.At(n, 3, 0) = smath::select(has_mat, p/((p+dP)*pt), outPar.ConstAt(n, 3, 0));
       //assume 100% uncertainty
-      outErr.At(n, 3, 3) += dP*dP/(p2*pt*pt);
+      outErr.At(n, 3, 3) += smath::select(has_mat, dP*dP/(p2*pt*pt), 0.f);
     }
 }
 
@@ -2,6 +2,7 @@
 #define _propagation_mplex_
 
 #include "Matrix.h"
+#include "SimdMath.h"
 
 namespace mkfit {
 
@@ -9,8 +10,9 @@ inline void squashPhiMPlex(MPlexLV& par, const int N_proc)
 {
   #pragma omp simd
   for (int n = 0; n < NN; ++n) {
-    if (par(n, 4, 0) >= Config::PI) par(n, 4, 0) -= Config::TwoPI;
-    if (par(n, 4, 0) < -Config::PI) par(n, 4, 0) += Config::TwoPI;
+    const float phi = par(n, 4, 0);
+    par(n, 4, 0) = phi - smath::select(phi >= Config::PI, Config::TwoPI, 0.f)
+                       + smath::select(phi < -Config::PI, Config::TwoPI, 0.f);
   }
 }
 
@@ -19,6 +19,10 @@ class EventOfHits;
                           const MPlexHS &,  const MPlexHV &, \
                           MPlexQF &,  const int, const PropagationFlags
 
+#define COMPUTE_CHI2_MULTI_HIT_ARGS const MPlexLS &,  const MPlexLV &, const MPlexQI &, \
+                                    const MPlexHS *,  const MPlexHV *, const int, \
+                                    MPlexQF *,  const int, const PropagationFlags
+
 #define UPDATE_PARAM_ARGS const MPlexLS &,  const MPlexLV &, MPlexQI &, \
                           const MPlexHS &,  const MPlexHV &, \
                                 MPlexLS &,        MPlexLV &, const int, const PropagationFlags
@@ -27,15 +31,18 @@ class FindingFoos
 {
 public:
   void (*m_compute_chi2_foo)      (COMPUTE_CHI2_ARGS);
+  void (*m_compute_chi2_multi_foo)(COMPUTE_CHI2_MULTI_HIT_ARGS);
   void (*m_update_param_foo)      (UPDATE_PARAM_ARGS);
   void (MkBase::*m_propagate_foo) (float, const int, const PropagationFlags);
 
   FindingFoos() {}
 
   FindingFoos(void (*cch2_f)      (COMPUTE_CHI2_ARGS),
+              void (*cch2m_f)     (COMPUTE_CHI2_MULTI_HIT_ARGS),
               void (*updp_f)      (UPDATE_PARAM_ARGS),
               void (MkBase::*p_f) (float, const int, const PropagationFlags)) :
     m_compute_chi2_foo(cch2_f),
+    m_compute_chi2_multi_foo(cch2m_f),
     m_update_param_foo(updp_f),
     m_propagate_foo(p_f)
   {}
@@ -72,14 +79,19 @@ struct IterationMaskIfcBase
 {
   virtual ~IterationMaskIfcBase() {}
 
+  // Masks in original hit order.
   virtual const std::vector<bool>* get_mask_for_layer(int layer) const { return nullptr; }
+
+  // Packed masks in LayerOfHits order, see IterationHitMasks. Used instead of
+  // the above when not null.
+  virtual const uint64_t* get_packed_mask_for_layer(int layer) const { return nullptr; }
 };
 
 struct IterationMaskIfc : public IterationMaskIfcBase
 {
-  std::vector<std::vector<bool>> m_mask_vector;
+  std::vector<const uint64_t*> m_packed_masks;
 
-  const std::vector<bool>* get_mask_for_layer(int layer) const { return & m_mask_vector[layer]; }
+  const uint64_t* get_packed_mask_for_layer(int layer) const { return m_packed_masks[layer]; }
 };
 
 
@@ -309,6 +321,7 @@ public:
   IterationsInfo() {}
 
   void resize(int ni) { m_iterations.resize(ni); }
+  int  size() const   { return m_iterations.size(); }
 
   IterationConfig& operator[](int i) { return m_iterations[i]; }
   const IterationConfig& operator[](int i) const { return m_iterations[i]; }
@@ -372,24 +372,51 @@ double runBtbCe_MultiIter(Event& ev, const EventOfHits &eoh, MkBuilder& builder)
     ev.relabel_bad_seedtracks();//necessary for the validation - PrepareSeeds
   }
   
-  IterationMaskIfc mask_ifc;
+  IterationHitMasks hit_masks;
+  hit_masks.Fill(eoh, ev.layerHitMasks_, Config::ItrInfo);
 
-  for (int it = 0; it <= 2; ++it)
+  // Iterations only read the event and the hits, masks come from the file.
+  // Each one runs on its own builder and collects its output, which is then
+  // appended to the event in iteration order -- the result does not depend
+  // on whether iterations run concurrently.
+  constexpr int n_iters = 3;
+
+  struct IterationOutput
+  {
+    TrackVec seeds;
+    TrackVec cand_tracks;
+    TrackVec fit_tracks;
+    double   time = 0;
+  };
+  IterationOutput outs[n_iters];
+
+  MkBuilder *iter_builders[n_iters];
+  for (int it = 0; it < n_iters; ++it)
   {
+    iter_builders[it] = Config::concurrentIterations ? &builder.iteration_builder(it) : &builder;
+  }
+
+  auto run_iteration = [&](int it)
+  {
+    MkBuilder       &bldr = *iter_builders[it];
+    IterationOutput &out  = outs[it];
+
     // MIMI - to disable hit-masks, pass nullptr in place of &mask_ifc to job
-    // and optionally comment out ev.fill_hitmask_bool_vectors() call.
+    // and optionally comment out hit_masks.Fill() call above.
 
-    ev.fill_hitmask_bool_vectors(Config::ItrInfo[it].m_track_algorithm, mask_ifc.m_mask_vector);
+    IterationMaskIfc mask_ifc;
+    mask_ifc.m_packed_masks.resize(eoh.m_n_layers);
+    for (int l = 0; l < eoh.m_n_layers; ++l) mask_ifc.m_packed_masks[l] = hit_masks.GetLayerMask(it, l);
 
     MkJob job( { Config::TrkInfo, Config::ItrInfo[it], eoh, &mask_ifc } );
 
-    builder.begin_event(&job, &ev, __func__);
+    bldr.begin_event(&job, &ev, __func__);
 
     // Some of what happens here, should really happen somewhere else, if it needs to.
     // builder.PrepareSeeds();
     // Specific cleaning / mapping done below for extracted seeds.
 
-    TrackVec seeds;
+    TrackVec &seeds = out.seeds;
     { // We could partition seeds once, store beg, end for each iteration in a map or vector.
       int nc = 0;
       for (auto &s : ev.seedTracks_)
@@ -405,39 +432,76 @@ double runBtbCe_MultiIter(Event& ev, const EventOfHits &eoh, MkBuilder& builder)
     // MIMI -- using Iter0 function / tuning for all iterations.
     ev.clean_cms_seedtracks_iter(&seeds, Config::ItrInfo[it]);
 
-    builder.seed_post_cleaning(seeds, true, true);
-    builder.map_track_hits(seeds);
+    bldr.seed_post_cleaning(seeds, true, true);
+    bldr.map_track_hits(seeds);
     for (auto &s : seeds) assignSeedTypeForRanking(s);
 
-    builder.find_tracks_load_seeds(seeds);
+    bldr.find_tracks_load_seeds(seeds);
 
     double time = dtime();
 
-    builder.FindTracksCloneEngine();
+    bldr.FindTracksCloneEngine();
 
-    ttime += dtime() - time;
+    out.time = dtime() - time;
 
-    if (validation_on)  seeds_used.insert(seeds_used.end(), seeds.begin(), seeds.end());//cleaned seeds need to be stored somehow
-    
     // first store candidate tracks - needed for BH backward fit and root_validation
-    // XXXX to builder m_tracks ... or do we do this for validation anyway ?    
-    builder.export_best_comb_cands(ev.candidateTracks_);
+    // XXXX to builder m_tracks ... or do we do this for validation anyway ?
+    bldr.export_best_comb_cands(out.cand_tracks);
 
     // now do backwards fit... do we want to time this section?
     if (Config::backwardFit)
     {
       // a) TrackVec version:
-      builder.select_best_comb_cands();
-      builder.BackwardFitBH();
-      builder.export_tracks(ev.fitTracks_);
+      bldr.select_best_comb_cands();
+      bldr.BackwardFitBH();
+      bldr.export_tracks(out.fit_tracks);
 
       // b) Version that runs on CombCand / TrackCand
       // builder.BackwardFit();
       // builder.quality_store_tracks(ev.fitTracks_);
+    }
+
+    bldr.end_event();
+  };
+
+  // Reported time is the sum of building times of all iterations in both
+  // modes. Wall time of concurrent iterations also includes seed cleaning,
+  // backward fit and export and is printed separately.
+  double wall_time = 0;
+  if (Config::concurrentIterations)
+  {
+    double time = dtime();
 
+    tbb::parallel_for(0, n_iters, run_iteration);
+
+    wall_time = dtime() - time;
+  }
+  else
+  {
+    for (int it = 0; it < n_iters; ++it)
+    {
+      run_iteration(it);
     }
-    
-    builder.end_event();
+  }
+
+  for (auto &out : outs) ttime += out.time;
+
+  if (!Config::silent)
+  {
+    std::lock_guard<std::mutex> printlock(Event::printmutex);
+    printf("MIMI building time per iteration:");
+    for (auto &out : outs) printf(" %.5f", out.time);
+    if (Config::concurrentIterations) printf("  concurrent wall time = %.5f", wall_time);
+    printf("\n");
+  }
+
+  for (auto &out : outs)
+  {
+    //cleaned seeds need to be stored somehow
+    if (validation_on) seeds_used.insert(seeds_used.end(), out.seeds.begin(), out.seeds.end());
+
+    ev.candidateTracks_.insert(ev.candidateTracks_.end(), out.cand_tracks.begin(), out.cand_tracks.end());
+    ev.fitTracks_      .insert(ev.fitTracks_      .end(), out.fit_tracks .begin(), out.fit_tracks .end());
   }
 
   // MIMI - Fake back event pointer for final processing (that should be done elsewhere)
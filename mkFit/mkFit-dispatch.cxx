@@ -0,0 +1,144 @@
+// Launcher that runs the mkFit executable built for the best instruction set
+// the CPU supports. Matriplex width (NN) and intrinsics are fixed at compile
+// time all through the code so each ISA is a complete build of libMicCore,
+// libMkFit and mkFit; these are produced by 'make multi-isa' in the top
+// directory as mkFit/mkFit-<isa> and lib/<isa>/*.so.
+//
+// The variant is chosen from CPUID; it can be forced with --isa, which is
+// removed from the arguments passed on to mkFit:
+//
+//   ./mkFit-dispatch [--isa avx|avx2|avx512] [mkFit options ...]
+//
+// Variant libraries are found through LD_LIBRARY_PATH, which takes precedence
+// over the runpath of the executables.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+  bool has_avx512()
+  {
+    return __builtin_cpu_supports("avx512f")  && __builtin_cpu_supports("avx512cd") &&
+           __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq") &&
+           __builtin_cpu_supports("avx512vl");
+  }
+  bool has_avx2() { return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"); }
+  bool has_avx()  { return __builtin_cpu_supports("avx"); }
+
+  struct Isa
+  {
+    const char *m_name;
+    bool      (*m_supported)();
+  };
+
+  // Best first.
+  const Isa s_isas[] =
+  {
+    { "avx512", has_avx512 },
+    { "avx2",   has_avx2   },
+    { "avx",    has_avx    }
+  };
+
+  std::string exe_dir()
+  {
+    char buf[4096];
+    ssize_t n = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+    if (n <= 0) return ".";
+    buf[n] = 0;
+    std::string p(buf);
+    return p.substr(0, p.rfind('/'));
+  }
+
+  bool exists(const std::string &path)
+  {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  __builtin_cpu_init();
+
+  std::string       forced;
+  std::vector<char*> args(1);
+  for (int i = 1; i < argc; ++i)
+  {
+    if (strcmp(argv[i], "--isa") == 0)
+    {
+      if (++i == argc)
+      {
+        fprintf(stderr, "mkFit-dispatch: option --isa requires an argument.\n");
+        exit(1);
+      }
+      forced = argv[i];
+    }
+    else
+    {
+      args.push_back(argv[i]);
+    }
+  }
+
+  const std::string dir = exe_dir();
+  const Isa        *isa = nullptr;
+
+  for (const Isa &x : s_isas)
+  {
+    if ( ! forced.empty())
+    {
+      if (forced != x.m_name) continue;
+      if ( ! x.m_supported())
+      {
+        fprintf(stderr, "mkFit-dispatch: requested ISA '%s' is not supported by this CPU.\n", x.m_name);
+        exit(1);
+      }
+      isa = &x;
+      break;
+    }
+    if (x.m_supported() && exists(dir + "/mkFit-" + x.m_name))
+    {
+      isa = &x;
+      break;
+    }
+  }
+
+  if (isa == nullptr)
+  {
+    if ( ! forced.empty())
+      fprintf(stderr, "mkFit-dispatch: unknown ISA '%s', use one of avx, avx2, avx512.\n", forced.c_str());
+    else
+      fprintf(stderr, "mkFit-dispatch: no mkFit-<isa> executable usable on this CPU in %s, run 'make multi-isa'.\n", dir.c_str());
+    exit(1);
+  }
+
+  const std::string exe = dir + "/mkFit-" + isa->m_name;
+  if ( ! exists(exe))
+  {
+    fprintf(stderr, "mkFit-dispatch: %s not found, run 'make multi-isa'.\n", exe.c_str());
+    exit(1);
+  }
+
+  std::string ld_path = dir + "/../lib/" + isa->m_name;
+  if (const char *old = getenv("LD_LIBRARY_PATH"))
+  {
+    if (*old) { ld_path += ":"; ld_path += old; }
+  }
+  setenv("LD_LIBRARY_PATH", ld_path.c_str(), 1);
+
+  printf("mkFit-dispatch: running %s variant\n", isa->m_name);
+  fflush(stdout);
+
+  args[0] = const_cast<char*>(exe.c_str());
+  args.push_back(nullptr);
+  execv(exe.c_str(), args.data());
+
+  perror("mkFit-dispatch: execv failed");
+  return 1;
+}
@@ -0,0 +1,61 @@
+// Checks that the CPU supports all features the mkFit executable and its
+// libraries were compiled for, see CpuFeatures.h.
+//
+// This file is built without VEC_HOST flags and the check runs from
+// .preinit_array, before initializers of the executable and of the shared
+// libraries it loads. A check in main() is too late: static initializers
+// compiled for the build ISA would crash with SIGILL first.
+
+#include "CpuFeatures.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+  using namespace mkfit;
+
+  void check_cpu_features(int, char**, char**)
+  {
+    __builtin_cpu_init();
+
+    struct Feature { unsigned m_bit; const char *m_name; bool m_supported; };
+
+    const Feature features[] =
+    {
+      { CF_avx,      "avx",      (bool) __builtin_cpu_supports("avx")      },
+      { CF_fma,      "fma",      (bool) __builtin_cpu_supports("fma")      },
+      { CF_avx2,     "avx2",     (bool) __builtin_cpu_supports("avx2")     },
+      { CF_avx512f,  "avx512f",  (bool) __builtin_cpu_supports("avx512f")  },
+      { CF_avx512cd, "avx512cd", (bool) __builtin_cpu_supports("avx512cd") },
+      { CF_avx512bw, "avx512bw", (bool) __builtin_cpu_supports("avx512bw") },
+      { CF_avx512dq, "avx512dq", (bool) __builtin_cpu_supports("avx512dq") },
+      { CF_avx512vl, "avx512vl", (bool) __builtin_cpu_supports("avx512vl") }
+    };
+
+    bool ok = true;
+    for (const Feature &f : features)
+    {
+      if ((g_build_cpu_features & f.m_bit) && ! f.m_supported)
+      {
+        if (ok) fprintf(stderr, "Error: mkFit was built for CPU features this CPU does not support:");
+        fprintf(stderr, " %s", f.m_name);
+        ok = false;
+      }
+    }
+    if ( ! ok)
+    {
+      fprintf(stderr, "; use mkFit-dispatch.\n");
+      exit(1);
+    }
+  }
+}
+
+#if defined(__linux__)
+__attribute__((section(".preinit_array"), used))
+static void (*s_check_cpu_features)(int, char**, char**) = check_cpu_features;
+#else
+// No .preinit_array, run before other constructors of the executable at least.
+__attribute__((constructor(101)))
+static void check_cpu_features_ctor() { check_cpu_features(0, nullptr, nullptr); }
+#endif
@@ -7,6 +7,7 @@
 #include "MkBuilder.h"
 #include "MkFitter.h"
 #include "MkStdSeqs.h"
+#include "CpuFeatures.h"
 
 #include "Config.h"
 
@@ -16,6 +17,9 @@
 #include <list>
 #include <sstream>
 #include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
 
 #include "Event.h"
 
@@ -31,6 +35,10 @@
 
 #include "tbb/task_arena.h"
 #include "tbb/parallel_for.h"
+#include "tbb/concurrent_queue.h"
+#include "tbb/parallel_pipeline.h"
+
+#include <thread>
 
 #if defined(USE_VTUNE_PAUSE)
 #include "ittnotify.h"
@@ -50,6 +58,16 @@ void initGeom()
 
   TrackerInfo::ExecTrackerInfoCreatorPlugin(Config::geomPlugin, Config::TrkInfo, Config::ItrInfo);
 
+  if (Config::closedFormPropR)
+  {
+    for (PropagationFlags *pf : { &Config::finding_inter_layer_pflags, &Config::finding_intra_layer_pflags,
+                                  &Config::backward_fit_pflags,        &Config::forward_fit_pflags,
+                                  &Config::seed_fit_pflags,            &Config::pca_prop_pflags })
+    {
+      pf->closed_form_r = true;
+    }
+  }
+
   /*
   if ( ! Config::useCMSGeom)
   {
@@ -74,6 +92,12 @@ void initGeom()
 namespace
 {
   int   g_start_event   = 1;
+  bool  g_mmap_input    = false;
+  bool  g_compress_hits = false;
+  int   g_prefetch_depth = 0;
+  int   g_throughput_in_flight = 0;
+  float g_suggest_phi_bins = 0;
+  bool  g_compact_cand_cmp = false;
 
   bool  g_run_fit_std   = false;
 
@@ -114,6 +138,73 @@ namespace
   }
 
   const char* b2a(bool b) { return b ? "true" : "false"; }
+
+  // Differences between tracks built with full and with compact candidate
+  // covariances (Config::emulate_compact_cand_state), for --compact-cand-cmp.
+  // Tracks are matched by label.
+  struct CompactCandComparison
+  {
+    int       m_n_events    = 0;
+    long long m_n_full      = 0, m_n_compact    = 0, m_n_matched = 0;
+    long long m_n_same_hits = 0, m_n_more_found = 0, m_n_fewer_found = 0;
+    long long m_found_full  = 0, m_found_compact = 0;
+    double    m_sum_dpt     = 0, m_max_dpt      = 0;
+
+    void Fill(const TrackVec& full, const TrackVec& compact)
+    {
+      std::unordered_map<int, int> compact_by_label;
+      for (int i = 0; i < (int) compact.size(); ++i)
+      {
+        compact_by_label.insert({ compact[i].label(), i });
+        m_found_compact += compact[i].nFoundHits();
+      }
+
+      for (const Track &a : full)
+      {
+        m_found_full += a.nFoundHits();
+
+        auto it = compact_by_label.find(a.label());
+        if (it == compact_by_label.end()) continue;
+        const Track &b = compact[it->second];
+        ++m_n_matched;
+
+        if      (b.nFoundHits() > a.nFoundHits()) ++m_n_more_found;
+        else if (b.nFoundHits() < a.nFoundHits()) ++m_n_fewer_found;
+
+        m_n_same_hits += a.nTotalHits() == b.nTotalHits() &&
+                         std::equal(a.BeginHitsOnTrack(), a.EndHitsOnTrack(), b.BeginHitsOnTrack(),
+                                    [](const HitOnTrack &x, const HitOnTrack &y)
+                                    { return x.index == y.index && x.layer == y.layer; });
+
+        const double dpt = std::abs(b.pT() - a.pT()) / a.pT();
+        if (std::isfinite(dpt))
+        {
+          m_sum_dpt += dpt;
+          m_max_dpt  = std::max(m_max_dpt, dpt);
+        }
+      }
+
+      m_n_full    += full.size();
+      m_n_compact += compact.size();
+      ++m_n_events;
+    }
+
+    void Print() const
+    {
+      const double nm = std::max(m_n_matched, 1LL);
+      printf("Compact candidate state comparison, %d events; per candidate state %zu bytes full, %zu compact"
+             " (sizeof(TrackCand) in this build %zu)\n",
+             m_n_events, sizeof(TrackState), sizeof(TrackStateCompact), sizeof(TrackCand));
+      printf("  tracks full %lld, compact %lld, matched by label %lld: identical hits %.3f%%,"
+             " more found hits %.3f%%, fewer %.3f%%\n",
+             m_n_full, m_n_compact, m_n_matched,
+             100 * m_n_same_hits / nm, 100 * m_n_more_found / nm, 100 * m_n_fewer_found / nm);
+      printf("  found hits full %lld, compact %lld (%+.4f%%); matched tracks |dpT|/pT mean %.3e, max %.3e\n",
+             m_found_full, m_found_compact,
+             m_found_full > 0 ? 100.0 * (m_found_compact - m_found_full) / m_found_full : 0.0,
+             m_sum_dpt / nm, m_max_dpt);
+    }
+  };
 }
 
 //==============================================================================
@@ -160,8 +251,16 @@ void read_and_save_tracks()
   DataFile in;
   const int Nevents = in.OpenRead(g_input_file, true);
 
+  // Carry over all extra sections present in the input and add the event index.
+  if (in.HasSeeds())       Config::seedInput       = cmsswSeeds;
+  if (in.HasCmsswTracks()) Config::readCmsswTracks = true;
+
+  int extra_sections = in.f_header.f_extra_sections | DataFile::ES_EventIndex;
+  if (g_compress_hits) extra_sections |=  DataFile::ES_CompressedHits;
+  else                 extra_sections &= ~DataFile::ES_CompressedHits;
+
   DataFile out;
-  out.OpenWrite(g_output_file, Nevents);
+  out.OpenWrite(g_output_file, Nevents, extra_sections);
 
   printf("writing %i events\n", Nevents);
 
@@ -173,17 +272,95 @@ void read_and_save_tracks()
     ev.write_out(out);
   }
 
-  out.Close();
+  out.CloseWrite(Nevents);
   in .Close();
 }
 
 //==============================================================================
 
+// Constant-initialized, it is read before any code of this file runs.
+const unsigned mkfit::g_build_cpu_features = 0
+#if defined(__AVX__)
+  | CF_avx
+#endif
+#if defined(__FMA__)
+  | CF_fma
+#endif
+#if defined(__AVX2__)
+  | CF_avx2
+#endif
+#if defined(__AVX512F__)
+  | CF_avx512f
+#endif
+#if defined(__AVX512CD__)
+  | CF_avx512cd
+#endif
+#if defined(__AVX512BW__)
+  | CF_avx512bw
+#endif
+#if defined(__AVX512DQ__)
+  | CF_avx512dq
+#endif
+#if defined(__AVX512VL__)
+  | CF_avx512vl
+#endif
+  ;
+
+namespace
+{
+  // Instruction set this binary was built for, see mkFit-dispatch.cxx.
+  const char* build_isa()
+  {
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#elif defined(__AVX__)
+    return "avx";
+#else
+    return "generic";
+#endif
+  }
+
+  // Event with its hits and a builder, one for each event in flight in
+  // throughput mode.
+  struct EventContext
+  {
+    std::unique_ptr<Validation>  m_val;
+    std::unique_ptr<EventOfHits> m_eoh;
+    std::unique_ptr<MkBuilder>   m_mkb;
+    std::unique_ptr<Event>       m_ev;
+
+    EventContext(int id = 0) :
+      m_val(Validation::make_validation("valtree_tp_" + std::to_string(id) + ".root")),
+      m_eoh(new EventOfHits(Config::TrkInfo)),
+      m_mkb(MkBuilder::make_builder()),
+      m_ev (new Event(*m_val, 0))
+    {}
+  };
+
+  // Event as it passes from the serial read stage to the parallel build stage.
+  struct EventInFlight
+  {
+    EventContext *m_ctx = nullptr;
+    int           m_idx = 0;
+    double        m_t0  = 0;
+  };
+
+  // Nearest-rank percentile of sorted values.
+  double percentile(const std::vector<double> &sorted, double q)
+  {
+    if (sorted.empty()) return 0;
+    int i = (int) std::ceil(q * sorted.size()) - 1;
+    return sorted[std::max(0, std::min(i, (int) sorted.size() - 1))];
+  }
+}
+
 void test_standard()
 {
   printf("Running test_standard(), operation=\"%s\"\n", g_operation.c_str());
-  printf("  vusize=%d, num_th_sim=%d, num_th_finder=%d\n",
-         MPT_SIZE, Config::numThreadsSimulation, Config::numThreadsFinder);
+  printf("  isa=%s, vusize=%d, num_th_sim=%d, num_th_finder=%d\n",
+         build_isa(), MPT_SIZE, Config::numThreadsSimulation, Config::numThreadsFinder);
   printf("  sizeof(Track)=%zu, sizeof(Hit)=%zu, sizeof(SVector3)=%zu, sizeof(SMatrixSym33)=%zu, sizeof(MCHitInfo)=%zu\n",
          sizeof(Track), sizeof(Hit), sizeof(SVector3), sizeof(SMatrixSym33), sizeof(MCHitInfo));
 
@@ -200,7 +377,7 @@ void test_standard()
   DataFile data_file;
   if (g_operation == "read")
   {
-    int evs_in_file   = data_file.OpenRead(g_input_file);
+    int evs_in_file   = data_file.OpenRead(g_input_file, false, g_mmap_input);
     int evs_available = evs_in_file - g_start_event + 1;
     if (Config::nEvents == -1)
     {
@@ -230,25 +407,39 @@ void test_standard()
   std::atomic<int> seedstot{0}, simtrackstot{0}, candstot{0};
   std::atomic<int> maxHits_all{0}, maxLayer_all{0};
 
+  PhiBinAdvisor phi_bin_advisor;
+  CompactCandComparison compact_cand_cmp;
+
   MkBuilder::populate();
 
-  std::vector<std::unique_ptr<Event>>       evs(Config::numThreadsEvents);
-  std::vector<std::unique_ptr<Validation>>  vals(Config::numThreadsEvents);
-  std::vector<std::unique_ptr<MkBuilder>>   mkbs(Config::numThreadsEvents);
-  std::vector<std::shared_ptr<EventOfHits>> eohs(Config::numThreadsEvents);
+  // With prefetching, events are read into a ring of slots (Event + EventOfHits)
+  // by a dedicated reader thread, the event threads pick them up when ready.
+  // In throughput mode events are instead claimed one by one by a pipeline
+  // whose serial first stage reads them, each into a free per-event context.
+  const bool throughput = g_operation == "read" && g_throughput_in_flight > 0;
+  const bool prefetch   = g_operation == "read" && g_prefetch_depth > 0 && ! throughput;
+  const int  n_slots    = throughput ? 0 : Config::numThreadsEvents + (prefetch ? g_prefetch_depth : 0);
+  const int  n_builders = throughput ? 0 : Config::numThreadsEvents;
+
+  std::vector<std::unique_ptr<Event>>       evs(n_slots);
+  std::vector<std::unique_ptr<Validation>>  vals(n_slots);
+  std::vector<std::unique_ptr<MkBuilder>>   mkbs(n_builders);
+  std::vector<std::shared_ptr<EventOfHits>> eohs(n_slots);
   std::vector<std::shared_ptr<FILE>>        fps;
   fps.reserve(Config::numThreadsEvents);
 
   const std::string valfile("valtree");
 
-  for (int i = 0; i < Config::numThreadsEvents; ++i) {
+  for (int i = 0; i < n_slots; ++i) {
     std::ostringstream serial;
-    if (Config::numThreadsEvents > 1) { serial << "_" << i; }
+    if (n_slots > 1) { serial << "_" << i; }
     vals[i].reset(Validation::make_validation(valfile + serial.str() + ".root"));
-    mkbs[i].reset(MkBuilder::make_builder());
     eohs[i].reset(new EventOfHits(Config::TrkInfo));
     evs[i].reset(new Event(*vals[i], 0));
-    if (g_operation == "read") {
+  }
+  for (int i = 0; i < n_builders; ++i) {
+    mkbs[i].reset(MkBuilder::make_builder());
+    if (g_operation == "read" && ! prefetch && ! data_file.IsMapped()) {
       fps.emplace_back(fopen(g_input_file.c_str(), "r"), [](FILE* fp) { if (fp) fclose(fp); });
     }
   }
@@ -261,7 +452,200 @@ void test_standard()
 
   int events_per_thread = (Config::nEvents+Config::numThreadsEvents-1)/Config::numThreadsEvents;
 
-  arena.execute([&]() {
+  auto print_event_start = [](const Event &ev)
+  {
+    if (!Config::silent)
+    {
+      std::lock_guard<std::mutex> printlock(Event::printmutex);
+      printf("\n");
+      printf("Processing event %d\n", ev.evtID());
+    }
+  };
+
+  // Runs the requested building tests on an event with hits already loaded.
+  auto build_event = [&](Event &ev, EventOfHits &eoh, MkBuilder &mkb, int evt)
+  {
+    double t_best[NT] = {0}, t_cur[NT];
+    simtrackstot += ev.simTracks_.size();
+    seedstot     += ev.seedTracks_.size();
+
+    if (g_suggest_phi_bins > 0) phi_bin_advisor.Fill(eoh);
+
+    if (!Config::silent)
+    {
+      const HitStorageStats hss = eoh.GetStorageStats();
+      std::lock_guard<std::mutex> printlock(Event::printmutex);
+      printf("Hit storage: %d allocations this event, %d total; %.1f kB used of %.1f kB reserved\n",
+             hss.m_n_allocs, hss.m_n_allocs_total, hss.m_bytes_used / 1024.0, hss.m_bytes_reserved / 1024.0);
+    }
+
+    auto run_builds = [&](double *t)
+    {
+      // t[0] = (g_run_fit_std) ? runFittingTestPlex(ev, plex_tracks) : 0;
+      t[1] = (g_run_build_all || g_run_build_bh)  ? runBuildingTestPlexBestHit(ev, eoh, mkb) : 0;
+      t[3] = (g_run_build_all || g_run_build_ce)  ? runBuildingTestPlexCloneEngine(ev, eoh, mkb) : 0;
+      t[4] = (g_run_build_all || g_run_build_mimi)? runBtbCe_MultiIter(ev, eoh, mkb) : 0;
+      if (g_run_build_all || g_run_build_cmssw) runBuildingTestPlexDumbCMSSW(ev, eoh, mkb);
+      t[2] = (g_run_build_all || g_run_build_std) ? runBuildingTestPlexStandard(ev, eoh, mkb) : 0;
+    };
+
+    int ncands_thisthread = 0;
+    int maxHits_thisthread = 0;
+    int maxLayer_thisthread = 0;
+    for (int b = 0; b < Config::finderReportBestOutOfN; ++b)
+    {
+      run_builds(t_cur);
+      if (g_run_build_ce){
+        ncands_thisthread = mkb.total_cands();
+        auto const& ln = mkb.max_hits_layer(eoh);
+        maxHits_thisthread = ln.first;
+        maxLayer_thisthread = ln.second;
+      }
+      for (int i = 0; i < NT; ++i) t_best[i] = (b == 0) ? t_cur[i] : std::min(t_cur[i], t_best[i]);
+
+      if (!Config::silent) {
+        std::lock_guard<std::mutex> printlock(Event::printmutex);
+        if (Config::finderReportBestOutOfN > 1)
+        {
+          printf("----------------------------------------------------------------\n");
+          printf("Best-of-times:");
+          for (int i = 0; i < NT; ++i) printf("  %.5f/%.5f", t_cur[i], t_best[i]);
+          printf("\n");
+        }
+        printf("----------------------------------------------------------------\n");
+      }
+    }
+
+    if (g_compact_cand_cmp)
+    {
+      // Build again with compact candidate covariances, keep the tracks of
+      // the first pass as event output. Only one event thread, checked in main().
+      TrackVec full_tracks;
+      full_tracks.swap(ev.candidateTracks_);
+      Config::emulate_compact_cand_state = true;
+      double t_cmp[NT];
+      run_builds(t_cmp);
+      Config::emulate_compact_cand_state = false;
+      compact_cand_cmp.Fill(full_tracks, ev.candidateTracks_);
+      ev.candidateTracks_.swap(full_tracks);
+    }
+
+    candstot += ncands_thisthread;
+    if (maxHits_thisthread > maxHits_all){
+      maxHits_all = maxHits_thisthread;
+      maxLayer_all = maxLayer_thisthread;
+    }
+    if (!Config::silent) {
+      std::lock_guard<std::mutex> printlock(Event::printmutex);
+      printf("Matriplex fit = %.5f  --- Build  BHMX = %.5f  STDMX = %.5f  CEMX = %.5f  MIMI = %.5f\n",
+             t_best[0], t_best[1], t_best[2], t_best[3], t_best[4]);
+    }
+
+    {
+      static std::mutex sum_up_lock;
+      std::lock_guard<std::mutex> locker(sum_up_lock);
+
+      for (int i = 0; i < NT; ++i) t_sum[i] += t_best[i];
+      if (evt > 0) for (int i = 0; i < NT; ++i) t_skip[i] += t_best[i];
+    }
+  };
+
+  double t_read = 0;
+  std::vector<double> t_stall(Config::numThreadsEvents, 0);
+
+  tbb::concurrent_bounded_queue<int> free_slots, ready_slots;
+  std::thread reader;
+
+  // Contexts are taken in the serial stage and returned from whichever thread
+  // runs the parallel one; a Pool would strand them in per-thread caches.
+  std::vector<std::unique_ptr<EventContext>> contexts;
+  tbb::concurrent_bounded_queue<EventContext*> free_contexts;
+  std::vector<double> latency;
+  const int max_in_flight = g_throughput_in_flight;
+
+  if (throughput)
+  {
+    for (int i = 0; i < max_in_flight; ++i)
+    {
+      contexts.emplace_back(new EventContext(i));
+      free_contexts.push(contexts.back().get());
+    }
+    latency.resize(Config::nEvents);
+    int n_claimed = 0;
+
+    arena.execute([&]() {
+      tbb::parallel_pipeline(max_in_flight,
+        tbb::make_filter<void, EventInFlight>(tbb::filter_mode::serial_in_order,
+          [&](tbb::flow_control &fc)
+        {
+          EventInFlight f;
+          if (n_claimed >= Config::nEvents)
+          {
+            fc.stop();
+            return f;
+          }
+          f.m_idx = n_claimed++;
+          f.m_t0  = dtime();
+          free_contexts.pop(f.m_ctx);
+
+          Event &ev = *f.m_ctx->m_ev;
+          ev.Reset(nevt++);
+          print_event_start(ev);
+          ev.read_in(data_file);
+          return f;
+        }) &
+        tbb::make_filter<EventInFlight, void>(tbb::filter_mode::parallel,
+          [&](EventInFlight f)
+        {
+          Event       &ev  = *f.m_ctx->m_ev;
+          EventOfHits &eoh = *f.m_ctx->m_eoh;
+
+          // skip events with zero seed tracks!
+          if ( ! ev.seedTracks_.empty())
+          {
+            StdSeq::LoadHits(ev, eoh);
+            build_event(ev, eoh, *f.m_ctx->m_mkb, ev.evtID() - g_start_event);
+          }
+
+          latency[f.m_idx] = dtime() - f.m_t0;
+          free_contexts.push(f.m_ctx);
+        }));
+    });
+  }
+
+  if (prefetch)
+  {
+    for (int i = 0; i < n_slots; ++i) free_slots.push(i);
+
+    reader = std::thread([&]()
+    {
+      // Hits are loaded on this thread only, outside of the finding arena.
+      tbb::task_arena io_arena(1);
+
+      for (int evt = 0; evt < Config::nEvents; ++evt)
+      {
+        int slot = -1;
+        free_slots.pop(slot);
+
+        double t0 = dtime();
+
+        auto &ev = *evs[slot].get();
+        ev.Reset(nevt++);
+        ev.read_in(data_file);
+        if ( ! ev.seedTracks_.empty())
+        {
+          io_arena.execute([&]() { StdSeq::LoadHits(ev, *eohs[slot].get()); });
+        }
+
+        t_read += dtime() - t0;
+
+        ready_slots.push(slot);
+      }
+      for (int i = 0; i < Config::numThreadsEvents; ++i) ready_slots.push(-1);
+    });
+  }
+
+  if ( ! throughput) arena.execute([&]() {
     tbb::parallel_for(tbb::blocked_range<int>(0, Config::numThreadsEvents, 1),
       [&](const tbb::blocked_range<int>& threads)
     {
@@ -269,11 +653,39 @@ void test_standard()
 
       assert(threads.begin() == threads.end()-1 && thisthread < Config::numThreadsEvents);
 
+      auto& mkb    = *mkbs[thisthread].get();
+
+      if (prefetch)
+      {
+        while (true)
+        {
+          double t0 = dtime();
+          int slot = -1;
+          ready_slots.pop(slot);
+          t_stall[thisthread] += dtime() - t0;
+
+          if (slot < 0) break;
+
+          auto& ev  = *evs[slot].get();
+          auto& eoh = *eohs[slot].get();
+
+          print_event_start(ev);
+
+          // skip events with zero seed tracks!
+          if ( ! ev.seedTracks_.empty())
+          {
+            build_event(ev, eoh, mkb, ev.evtID() - g_start_event);
+          }
+
+          free_slots.push(slot);
+        }
+        return;
+      }
+
       // std::vector<Track> plex_tracks;
       auto& ev     = *evs[thisthread].get();
-      auto& mkb    = *mkbs[thisthread].get();
       auto& eoh    = *eohs[thisthread].get();
-      auto  fp     =  fps[thisthread].get();
+      auto  fp     =  fps.empty() ? nullptr : fps[thisthread].get();
 
       int evstart = thisthread*events_per_thread;
       int evend   = std::min(Config::nEvents, evstart+events_per_thread);
@@ -285,12 +697,7 @@ void test_standard()
       {
         ev.Reset(nevt++);
 
-        if (!Config::silent)
-        {
-          std::lock_guard<std::mutex> printlock(Event::printmutex);
-          printf("\n");
-          printf("Processing event %d\n", ev.evtID());
-        }
+        print_event_start(ev);
 
         ev.read_in(data_file, fp);
 
@@ -301,64 +708,13 @@ void test_standard()
 
         StdSeq::LoadHits(ev, eoh);
 
-        double t_best[NT] = {0}, t_cur[NT];
-        simtrackstot += ev.simTracks_.size();
-        seedstot     += ev.seedTracks_.size();
-
-        int ncands_thisthread = 0;
-        int maxHits_thisthread = 0;
-        int maxLayer_thisthread = 0;
-        for (int b = 0; b < Config::finderReportBestOutOfN; ++b)
-        {
-          // t_cur[0] = (g_run_fit_std) ? runFittingTestPlex(ev, plex_tracks) : 0;
-          t_cur[1] = (g_run_build_all || g_run_build_bh)  ? runBuildingTestPlexBestHit(ev, eoh, mkb) : 0;
-          t_cur[3] = (g_run_build_all || g_run_build_ce)  ? runBuildingTestPlexCloneEngine(ev, eoh, mkb) : 0;
-          t_cur[4] = (g_run_build_all || g_run_build_mimi)? runBtbCe_MultiIter(ev, eoh, mkb) : 0;
-          if (g_run_build_all || g_run_build_cmssw) runBuildingTestPlexDumbCMSSW(ev, eoh, mkb);
-          t_cur[2] = (g_run_build_all || g_run_build_std) ? runBuildingTestPlexStandard(ev, eoh, mkb) : 0;
-          if (g_run_build_ce){
-            ncands_thisthread = mkb.total_cands();
-            auto const& ln = mkb.max_hits_layer(eoh);
-            maxHits_thisthread = ln.first;
-            maxLayer_thisthread = ln.second;
-          }
-          for (int i = 0; i < NT; ++i) t_best[i] = (b == 0) ? t_cur[i] : std::min(t_cur[i], t_best[i]);
-
-          if (!Config::silent) {
-            std::lock_guard<std::mutex> printlock(Event::printmutex);
-            if (Config::finderReportBestOutOfN > 1)
-            {
-              printf("----------------------------------------------------------------\n");
-              printf("Best-of-times:");
-              for (int i = 0; i < NT; ++i) printf("  %.5f/%.5f", t_cur[i], t_best[i]);
-              printf("\n");
-            }
-            printf("----------------------------------------------------------------\n");
-          }
-        }
-
-        candstot += ncands_thisthread;
-        if (maxHits_thisthread > maxHits_all){
-          maxHits_all = maxHits_thisthread;
-          maxLayer_all = maxLayer_thisthread;
-        }
-        if (!Config::silent) {
-          std::lock_guard<std::mutex> printlock(Event::printmutex);
-          printf("Matriplex fit = %.5f  --- Build  BHMX = %.5f  STDMX = %.5f  CEMX = %.5f  MIMI = %.5f\n",
-                 t_best[0], t_best[1], t_best[2], t_best[3], t_best[4]);
-        }
-
-        {
-          static std::mutex sum_up_lock;
-          std::lock_guard<std::mutex> locker(sum_up_lock);
-
-          for (int i = 0; i < NT; ++i) t_sum[i] += t_best[i];
-          if (evt > 0) for (int i = 0; i < NT; ++i) t_skip[i] += t_best[i];
-        }
+        build_event(ev, eoh, mkb, evt);
       }
     }, tbb::simple_partitioner());
   });
 
+  if (prefetch) reader.join();
+
   time = dtime() - time;
 
   printf("\n");
@@ -372,6 +728,48 @@ void test_standard()
          t_skip[0], t_skip[1], t_skip[2], t_skip[3], t_skip[4]);
   printf("Total event loop time %.5f simtracks %d seedtracks %d builtcands %d maxhits %d on lay %d\n", time,
          simtrackstot.load(), seedstot.load(), candstot.load(), maxHits_all.load(), maxLayer_all.load());
+  if (prefetch)
+  {
+    double t_stall_sum = 0;
+    for (auto t : t_stall) t_stall_sum += t;
+    printf("Total prefetch read+load time %.5f, event threads I/O stall time %.5f (depth %d)\n",
+           t_read, t_stall_sum, g_prefetch_depth);
+  }
+  if (throughput)
+  {
+    std::sort(latency.begin(), latency.end());
+    printf("Throughput %.3f events/s, up to %d events in flight\n",
+           time > 0 ? Config::nEvents / time : 0.0, max_in_flight);
+    printf("Event latency [s] (read to end of building): p50 %.5f  p90 %.5f  p99 %.5f  max %.5f\n",
+           percentile(latency, 0.5), percentile(latency, 0.9), percentile(latency, 0.99),
+           percentile(latency, 1.0));
+  }
+  {
+    const MkFinder::HitScanStats hss = g_exe_ctx.GetHitScanStats();
+    printf("Total hit scan windows %lld, with more than the cap of %d hits %lld (%.3f%%), spiral scans stopped early %lld\n",
+           hss.m_n_windows, MkFinder::HitScanCap(), hss.m_n_capped,
+           hss.m_n_windows > 0 ? 100.0 * hss.m_n_capped / hss.m_n_windows : 0.0, hss.m_n_early_stops);
+  }
+  {
+    PoolStats ps[3];
+    g_exe_ctx.GetPoolStats(ps[0], ps[1], ps[2]);
+    const char *names[3] = { "cloners", "fitters", "finders" };
+    printf("Pool usage (gets: thread-local / same-node / other-node / created), %d NUMA node(s):", NumaNodeCount());
+    for (int i = 0; i < 3; ++i)
+    {
+      printf("%s %s %lld / %lld / %lld / %lld", i ? "," : "", names[i],
+             ps[i].m_n_local, ps[i].m_n_shared, ps[i].m_n_remote, ps[i].m_n_created);
+    }
+    printf("\n");
+  }
+  if (g_suggest_phi_bins > 0)
+  {
+    phi_bin_advisor.Print(g_suggest_phi_bins);
+  }
+  if (g_compact_cand_cmp)
+  {
+    compact_cand_cmp.Print();
+  }
   //fflush(stdout);
 
   if (g_operation == "read")
@@ -383,6 +781,10 @@ void test_standard()
     val->fillConfigTree();
     val->saveTTrees();
   }
+  for (auto& c : contexts) {
+    c->m_val->fillConfigTree();
+    c->m_val->saveTTrees();
+  }
 }
 
 //==============================================================================
@@ -459,12 +861,15 @@ int main(int argc, const char *argv[])
         "  --silent                 suppress printouts inside event loop (def: %s)\n"
         "  --best-out-of    <int>   run test num times, report best time (def: %d)\n"
         "  --input-file             file name for reading (def: %s)\n"
+        "  --mmap-input             memory-map the input file, hits are not copied unless validation needs them (def: %s)\n"
         "  --output-file            file name for writitng (def: %s)\n"
+        "  --compress-hits          store hits column-wise compressed when converting input to output file (def: %s)\n"
         "  --read-cmssw-tracks      read external cmssw reco tracks if available (def: %s)\n"
 	"  --read-simtrack-states   read in simTrackStates for pulls in validation (def: %s)\n"
         "  --num-events     <int>   number of events to run over or simulate (def: %d)\n"
         "                             if using --input-file, must be enabled AFTER on command line\n"
         "  --start-event    <int>   event number to start at when reading from a file (def: %d)\n"
+        "                             direct seek for files with an event index; add one by giving both input and output file\n"
         "  --loop-over-file         after reaching the end of the file, start over from the beginning until <num-events> events have been processed\n"
 	"\n"
 	"If no --input-file is specified, will trigger simulation\n"
@@ -474,8 +879,16 @@ int main(int argc, const char *argv[])
         "  --num-thr-sim    <int>   number of threads for simulation (def: %d)\n"
         "  --num-thr        <int>   number of threads for track finding (def: %d)\n"
         "  --num-thr-ev     <int>   number of threads to run the event loop (def: %d)\n"
+        "  --prefetch-depth <int>   read and load hits of up to this many events ahead on a separate reader thread (def: %d)\n"
+        "                             0 disables prefetching; I/O stall time of event threads is reported at the end\n"
+        "  --throughput     <int>   claim events one by one from a shared queue with up to this many in flight,\n"
+        "                             at most one per finder thread is useful; reports events/s and latency percentiles;\n"
+        "                             0 gives each event thread a fixed range of events; overrides prefetching (def: %d)\n"
         "  --seeds-per-task <int>   number of seeds to process in a tbb task (def: %d)\n"
         "  --hits-per-task  <int>   number of layer1 hits per task when using find seeds (def: %d)\n"
+        "  --adaptive-spt           split each eta region into blocks of adaptive size instead of cost-balanced tasks (def: %s)\n"
+        "  --cost-hit-density       weight layers by hit occupancy when estimating task cost (def: %s)\n"
+        "  --log-region-times       print per-region task counts, estimated costs and times (def: %s)\n"
 	"\n----------------------------------------------------------------------------------------------------------\n\n"
 	"FittingTestMPlex options\n\n"
         "  --fit-std                run standard fitting test (def: %s)\n"
@@ -490,18 +903,36 @@ int main(int argc, const char *argv[])
         "  --build-std              run standard combinatorial building test (def: %s)\n"
         "  --build-ce               run clone engine combinatorial building test (def: %s)\n"
         "  --build-ce-mimi          run clone engine on multiple-iteration test (def: %s)\n"
+        "  --mimi-concurrent        run iterations of the multiple-iteration test concurrently, each with its own builder (def: %s)\n"
+        "  --mimi-sequential        run iterations of the multiple-iteration test one after another (def: %s)\n"
 	"\n"
 	" **Seeding options\n"
         "  --seed-input     <str>   which seed collecion used for building (def: %s)\n"
         "  --seed-cleaning  <str>   which seed cleaning to apply if using cmssw seeds (def: %s)\n"
+        "  --seed-cleaning-brute-force  compare all seed pairs in seed cleaning instead of eta-phi grid neighbours (def: %s)\n"
         "  --cf-seeding             enable conformal fit over seeds (def: %s)\n"
         "\n"
 	" **Duplicate removal options\n"
 	"  --remove-dup            run duplicate removal after building, using both hit and kinematic criteria (def: %s)\n"
 	"  --remove-dup-no-hit     run duplicate removal after building, using kinematic criteria only (def: %s)\n"
+	"  --remove-dup-brute-force  compare all track pairs in duplicate removal instead of eta-phi neighbours and tracks sharing hits (def: %s)\n"
 	"\n"
 	" **Additional options for building\n"
         "  --use-phiq-arr           use phi-Q arrays in select hit indices (def: %s)\n"
+        "  --scalar-hit-scan        test hits in select hit indices one by one instead of in SIMD chunks (def: %s)\n"
+        "  --spiral-hit-scan        visit bins outward from the predicted position and keep closest hits (def: %s)\n"
+        "  --hit-scan-cap   <int>   max number of hits taken from a search window, <= 0 for %d (def: %d)\n"
+        "  --radix-hit-sort         sort hits into layer bins with radix sort instead of counting sort (def: %s)\n"
+        "  --fold-extras            select new candidates and those passing through missed layers together in clone engine (def: %s)\n"
+        "  --closed-form-prop       propagate to barrel layers with the closed-form helix-cylinder solution (def: %s)\n"
+        "  --chi2-multi-hit         compute chi2 of all hits in the search window in one call, approximating propagation\n"
+        "                             to each hit at the first order; clone engine only (def: %s)\n"
+        "  --suggest-phi-bins <flt> print per-layer numbers of phi bins giving about this many hits per bin,\n"
+        "                             based on hit occupancy of processed events; 0 disables (def: %.2f)\n"
+        "  --compact-cand-emul      round candidate covariances as if stored in compact form (16-bit correlations),\n"
+        "                             to compare validation results with a normal run; see COMPACT_CAND_STATE (def: %s)\n"
+        "  --compact-cand-cmp       build each event a second time with --compact-cand-emul and report differences\n"
+        "                             of the found tracks; needs one event thread and no validation (def: %s)\n"
         "  --kludge-cms-hit-errors  make sure err(xy) > 15 mum, err(z) > 30 mum (def: %s)\n"
         "  --backward-fit           perform backward fit during building (def: %s)\n"
         "  --include-pca            do the backward fit to point of closest approach, does not imply '--backward-fit' (def: %s)\n"
@@ -576,7 +1007,9 @@ int main(int argc, const char *argv[])
         b2a(Config::silent),
         Config::finderReportBestOutOfN,
       	g_input_file.c_str(),
+        b2a(g_mmap_input),
       	g_output_file.c_str(),
+        b2a(g_compress_hits),
 	b2a(Config::readCmsswTracks),
         b2a(Config::readSimTrackStates),
 	Config::nEvents,
@@ -586,8 +1019,13 @@ int main(int argc, const char *argv[])
         Config::numThreadsSimulation,
 	Config::numThreadsFinder,
 	Config::numThreadsEvents,
+        g_prefetch_depth,
+        g_throughput_in_flight,
         Config::numSeedsPerTask,
 	Config::numHitsPerTask,
+        b2a(!Config::costPartitioning),
+        b2a(Config::costModelHitDensity),
+        b2a(Config::logRegionTaskTimes),
 
 	b2a(g_run_fit_std),
 	b2a(g_run_fit_std && !(g_run_build_all || g_run_build_cmssw || g_run_build_bh || g_run_build_std || g_run_build_ce)),
@@ -599,15 +1037,29 @@ int main(int argc, const char *argv[])
 	b2a(g_run_build_all || g_run_build_std),
 	b2a(g_run_build_all || g_run_build_ce),
   b2a(g_run_build_all || g_run_build_mimi),
+  b2a(Config::concurrentIterations),
+  b2a(!Config::concurrentIterations),
 
 	getOpt(Config::seedInput, g_seed_opts).c_str(),
 	getOpt(Config::seedCleaning, g_clean_opts).c_str(),
+	b2a(Config::seedCleaningBruteForce),
         b2a(Config::cf_seeding),
 
 	b2a(Config::removeDuplicates && Config::useHitsForDuplicates),
 	b2a(Config::removeDuplicates && !Config::useHitsForDuplicates),
+	b2a(Config::findDuplicatesBruteForce),
 
 	b2a(Config::usePhiQArrays),
+	b2a(!Config::useSimdHitScan),
+	b2a(Config::useSpiralHitScan),
+	MkFinder::MPlexHitIdxMax, Config::hitScanCap,
+	b2a(Config::useRadixHitSort),
+	b2a(Config::foldExtrasIntoTopK),
+	b2a(Config::closedFormPropR),
+	b2a(Config::chi2MultiHit),
+	g_suggest_phi_bins,
+	b2a(Config::emulate_compact_cand_state),
+	b2a(g_compact_cand_cmp),
         b2a(Config::kludgeCmsHitErrors),
         b2a(Config::backwardFit),
         b2a(Config::includePCA),
@@ -682,12 +1134,20 @@ int main(int argc, const char *argv[])
       g_operation = "read";
       Config::nEvents = -1;
     }
+    else if (*i == "--mmap-input")
+    {
+      g_mmap_input = true;
+    }
     else if (*i == "--output-file")
     {
       next_arg_or_die(mArgs, i);
       g_output_file = *i;
       g_operation = "write";
     }
+    else if (*i == "--compress-hits")
+    {
+      g_compress_hits = true;
+    }
     else if(*i == "--read-cmssw-tracks")
     {
       Config::readCmsswTracks = true;
@@ -735,6 +1195,16 @@ int main(int argc, const char *argv[])
       next_arg_or_die(mArgs, i);
       Config::numThreadsEvents = atoi(i->c_str());
     }
+    else if (*i == "--prefetch-depth")
+    {
+      next_arg_or_die(mArgs, i);
+      g_prefetch_depth = atoi(i->c_str());
+    }
+    else if (*i == "--throughput")
+    {
+      next_arg_or_die(mArgs, i);
+      g_throughput_in_flight = atoi(i->c_str());
+    }
     else if (*i == "--seeds-per-task")
     {
       next_arg_or_die(mArgs, i);
@@ -745,6 +1215,18 @@ int main(int argc, const char *argv[])
       next_arg_or_die(mArgs, i);
       Config::numHitsPerTask = atoi(i->c_str());
     }
+    else if (*i == "--adaptive-spt")
+    {
+      Config::costPartitioning = false;
+    }
+    else if (*i == "--cost-hit-density")
+    {
+      Config::costModelHitDensity = true;
+    }
+    else if (*i == "--log-region-times")
+    {
+      Config::logRegionTaskTimes = true;
+    }
     else if(*i == "--fit-std")
     {
       g_run_fit_std = true;
@@ -778,6 +1260,14 @@ int main(int argc, const char *argv[])
     {
       g_run_build_all = false; g_run_build_cmssw = false; g_run_build_bh = false; g_run_build_std = false; g_run_build_ce = true;
     }
+    else if(*i == "--mimi-concurrent")
+    {
+      Config::concurrentIterations = true;
+    }
+    else if(*i == "--mimi-sequential")
+    {
+      Config::concurrentIterations = false;
+    }
     else if(*i == "--build-mimi")
     {
       g_run_build_all = false; g_run_build_cmssw = false; g_run_build_bh = false; g_run_build_std = false; g_run_build_ce = false; g_run_build_mimi = true;
@@ -792,6 +1282,10 @@ int main(int argc, const char *argv[])
       next_arg_or_die(mArgs, i);
       setOpt(*i,Config::seedCleaning,g_clean_opts,"seed cleaning");
     }
+    else if (*i == "--seed-cleaning-brute-force")
+    {
+      Config::seedCleaningBruteForce = true;
+    }
     else if (*i == "--cf-seeding")
     {
       Config::cf_seeding = true;
@@ -804,6 +1298,48 @@ int main(int argc, const char *argv[])
       printf("--use-phiq-arr has no effect: recompile with CONFIG_PhiQArrays\n");
 #endif
     }
+    else if (*i == "--scalar-hit-scan")
+    {
+      Config::useSimdHitScan = false;
+    }
+    else if (*i == "--spiral-hit-scan")
+    {
+      Config::useSpiralHitScan = true;
+    }
+    else if (*i == "--hit-scan-cap")
+    {
+      next_arg_or_die(mArgs, i);
+      Config::hitScanCap = atoi(i->c_str());
+    }
+    else if (*i == "--radix-hit-sort")
+    {
+      Config::useRadixHitSort = true;
+    }
+    else if (*i == "--fold-extras")
+    {
+      Config::foldExtrasIntoTopK = true;
+    }
+    else if (*i == "--closed-form-prop")
+    {
+      Config::closedFormPropR = true;
+    }
+    else if (*i == "--chi2-multi-hit")
+    {
+      Config::chi2MultiHit = true;
+    }
+    else if (*i == "--suggest-phi-bins")
+    {
+      next_arg_or_die(mArgs, i);
+      g_suggest_phi_bins = atof(i->c_str());
+    }
+    else if (*i == "--compact-cand-emul")
+    {
+      Config::emulate_compact_cand_state = true;
+    }
+    else if (*i == "--compact-cand-cmp")
+    {
+      g_compact_cand_cmp = true;
+    }
     else if(*i == "--remove-dup")
     {
       Config::removeDuplicates = true;
@@ -814,6 +1350,10 @@ int main(int argc, const char *argv[])
       Config::removeDuplicates = true;
       Config::useHitsForDuplicates = false;
     }
+    else if(*i == "--remove-dup-brute-force")
+    {
+      Config::findDuplicatesBruteForce = true;
+    }
     else if(*i == "--kludge-cms-hit-errors")
     {
       Config::kludgeCmsHitErrors = true;
@@ -972,6 +1512,15 @@ int main(int argc, const char *argv[])
     exit(1);
   }
 
+  else if (g_compact_cand_cmp && (Config::numThreadsEvents > 1 || g_throughput_in_flight > 0 ||
+                                  Config::emulate_compact_cand_state || Config::quality_val || Config::sim_val ||
+                                  Config::cmssw_val || Config::sim_val_for_cmssw || Config::cmssw_export))
+  {
+    std::cerr << "--compact-cand-cmp needs a single event thread and no validation, export or --compact-cand-emul;"
+              << " compare validation of runs with and without --compact-cand-emul instead. Exiting..." << std::endl;
+    exit(1);
+  }
+
   // set to convert if I/O files both set!
   if (g_input_file != "" && g_output_file != "")
   {
@@ -0,0 +1,207 @@
+// c++ -std=c++1z -O3 -mavx -I.. -I../mkFit -DUSE_MATRIPLEX -DMPLEX_USE_INTRINSICS -DTBB -DNO_ROOT -I../from-root chi2_bench.cxx -o chi2_bench -L../lib -lMkFit -lMicCore -ltbb -Wl,-rpath,../lib
+
+#include "KalmanUtilsMPlex.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace mkfit;
+
+namespace
+{
+  const int s_max_hits = 16;
+
+  struct Batch
+  {
+    MPlexLS err;
+    MPlexLV par;
+    MPlexQI chg;
+    MPlexHS hit_err[s_max_hits];
+    MPlexHV hit_par[s_max_hits];
+  };
+
+  void make_batch(std::mt19937 &rnd, bool endcap, int n_hits, Batch &b)
+  {
+    std::uniform_real_distribution<float> u01(0, 1);
+    std::normal_distribution<float>       gaus(0, 1);
+
+    for (int n = 0; n < NN; ++n)
+    {
+      // 1/pt in [0.01, 1.6], eta within the layer acceptance.
+      const float ipt = 0.01f + 1.59f * u01(rnd);
+      const float phi = Config::TwoPI * u01(rnd) - Config::PI;
+      const float eta = endcap ? 1.6f + 0.9f * u01(rnd) : 2.4f * u01(rnd) - 1.2f;
+      const float theta = 2 * std::atan(std::exp(-eta));
+
+      float x, y, z;
+      if (endcap)
+      {
+        const float r = 30.f + 70.f * u01(rnd);
+        z = 130.f;
+        x = r * std::cos(phi + 0.1f * gaus(rnd));
+        y = r * std::sin(phi + 0.1f * gaus(rnd));
+      }
+      else
+      {
+        const float r = 25.5f, pos_phi = phi + 0.05f * gaus(rnd);
+        x = r * std::cos(pos_phi);
+        y = r * std::sin(pos_phi);
+        z = 25.5f / std::tan(theta);
+      }
+      const float p[6] = { x, y, z, ipt, phi, theta };
+      for (int i = 0; i < 6; ++i) b.par(n, i, 0) = p[i];
+      b.chg(n, 0, 0) = u01(rnd) < 0.5f ? -1 : 1;
+
+      // C = S L L^T S with unit diagonal L L^T up to small correlations.
+      const float sig[6] = { 0.01f, 0.01f, 0.05f, 0.02f * ipt, 2e-3f, 2e-3f };
+      float L[6][6] = {};
+      for (int i = 0; i < 6; ++i)
+      {
+        L[i][i] = 1;
+        for (int j = 0; j < i; ++j) L[i][j] = 0.3f * gaus(rnd);
+      }
+      for (int i = 0; i < 6; ++i)
+      {
+        for (int j = 0; j <= i; ++j)
+        {
+          float s = 0, ni = 0, nj = 0;
+          for (int k = 0; k < 6; ++k) { s += L[i][k] * L[j][k]; ni += L[i][k] * L[i][k]; nj += L[j][k] * L[j][k]; }
+          b.err(n, i, j) = sig[i] * sig[j] * s / std::sqrt(ni * nj);
+        }
+      }
+
+      // Hits around the straight line extrapolation, off the surface.
+      for (int h = 0; h < n_hits; ++h)
+      {
+        const float off = 0.5f * (2 * u01(rnd) - 1);
+        float hx, hy, hz;
+        if (endcap)
+        {
+          hz = z + off;
+          const float d = off * std::tan(theta);
+          hx = x + d * std::cos(phi) + 0.02f * gaus(rnd);
+          hy = y + d * std::sin(phi) + 0.02f * gaus(rnd);
+          b.hit_err[h](n, 0, 0) = b.hit_err[h](n, 1, 1) = 4e-4f;
+          b.hit_err[h](n, 1, 0) = 0;
+          b.hit_err[h](n, 2, 0) = b.hit_err[h](n, 2, 1) = 0;
+          b.hit_err[h](n, 2, 2) = 1e-6f;
+        }
+        else
+        {
+          const float ux = std::cos(phi), uy = std::sin(phi);
+          const float d  = off / std::max(0.2f, (x * ux + y * uy) / 25.5f);
+          const float sp = 0.02f * gaus(rnd);
+          hx = x + d * ux - sp * y / 25.5f;
+          hy = y + d * uy + sp * x / 25.5f;
+          hz = z + d / std::tan(theta) + 0.05f * gaus(rnd);
+          // r-phi error 20 um, z error 100 um.
+          const float hr = std::hypot(hx, hy), sn = hy / hr, cs = hx / hr;
+          b.hit_err[h](n, 0, 0) =  4e-4f * sn * sn;
+          b.hit_err[h](n, 1, 0) = -4e-4f * sn * cs;
+          b.hit_err[h](n, 1, 1) =  4e-4f * cs * cs;
+          b.hit_err[h](n, 2, 0) = b.hit_err[h](n, 2, 1) = 0;
+          b.hit_err[h](n, 2, 2) = 2.5e-3f;
+        }
+        b.hit_par[h](n, 0, 0) = hx;
+        b.hit_par[h](n, 1, 0) = hy;
+        b.hit_par[h](n, 2, 0) = hz;
+      }
+    }
+  }
+
+  void chi2_per_slot(const Batch &b, bool endcap, int n_hits, MPlexQF *out)
+  {
+    const PropagationFlags pf(PF_none);
+    for (int h = 0; h < n_hits; ++h)
+    {
+      if (endcap)
+        kalmanPropagateAndComputeChi2Endcap(b.err, b.par, b.chg, b.hit_err[h], b.hit_par[h], out[h], NN, pf);
+      else
+        kalmanPropagateAndComputeChi2      (b.err, b.par, b.chg, b.hit_err[h], b.hit_par[h], out[h], NN, pf);
+    }
+  }
+
+  void chi2_multi(const Batch &b, bool endcap, int n_hits, MPlexQF *out)
+  {
+    const PropagationFlags pf(PF_none);
+    if (endcap)
+      kalmanPropagateAndComputeChi2MultiHitEndcap(b.err, b.par, b.chg, b.hit_err, b.hit_par, n_hits, out, NN, pf);
+    else
+      kalmanPropagateAndComputeChi2MultiHit      (b.err, b.par, b.chg, b.hit_err, b.hit_par, n_hits, out, NN, pf);
+  }
+
+  void run(const std::vector<Batch> &batches, bool endcap, bool prop_to_hit, int n_hits, int n_reps)
+  {
+    Config::finding_requires_propagation_to_hit_pos = prop_to_hit;
+
+    const float cut = 30.f;
+    MPlexQF o1[s_max_hits], o2[s_max_hits];
+    std::vector<double> diffs;
+    int n_flip = 0, n_pass = 0, n_ident = 0;
+
+    for (auto &b : batches)
+    {
+      chi2_per_slot(b, endcap, n_hits, o1);
+      chi2_multi   (b, endcap, n_hits, o2);
+      for (int h = 0; h < n_hits; ++h)
+      {
+        for (int n = 0; n < NN; ++n)
+        {
+          const float c1 = std::abs(o1[h](n, 0, 0)), c2 = std::abs(o2[h](n, 0, 0));
+          diffs.push_back(std::abs(c1 - c2) / std::max(1.f, c1));
+          n_ident += c1 == c2;
+          n_pass  += c1 < cut;
+          n_flip  += (c1 < cut) != (c2 < cut);
+        }
+      }
+    }
+    std::sort(diffs.begin(), diffs.end());
+    const size_t nd = diffs.size();
+
+    float sink = 0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < n_reps; ++r)
+      for (auto &b : batches) { chi2_per_slot(b, endcap, n_hits, o1); sink += o1[0](0, 0, 0); }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < n_reps; ++r)
+      for (auto &b : batches) { chi2_multi(b, endcap, n_hits, o2); sink += o2[0](0, 0, 0); }
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    const double nn = (double) batches.size() * NN * n_hits * n_reps;
+    const double ts = 1e9 * std::chrono::duration<double>(t1 - t0).count() / nn;
+    const double tm = 1e9 * std::chrono::duration<double>(t2 - t1).count() / nn;
+
+    printf("%-7s prop-to-hit %d:  |dchi2|/max(1,chi2) median %.2e  99%% %.2e  max %.2e  identical %5.1f%%  "
+           "cut %g flips %d of %d passing\n"
+           "                         time per hit: per slot %.2f ns, multi-hit %.2f ns, speedup %.2f  (sink %g)\n",
+           endcap ? "endcap" : "barrel", prop_to_hit, diffs[nd / 2], diffs[nd * 99 / 100], diffs[nd - 1],
+           100.0 * n_ident / nd, cut, n_flip, n_pass, ts, tm, ts / tm, sink);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const int n_batches = argc > 1 ? atoi(argv[1]) : 1024;
+  const int n_hits    = argc > 2 ? std::min(atoi(argv[2]), s_max_hits) : 8;
+  const int n_reps    = argc > 3 ? atoi(argv[3]) : 20;
+
+  std::mt19937 rnd(4357);
+
+  printf("Chi2 of %d x %d tracks against %d hits each, NN=%d\n", n_batches, NN, n_hits, NN);
+
+  for (bool endcap : { false, true })
+  {
+    std::vector<Batch> batches(n_batches);
+    for (auto &b : batches) make_batch(rnd, endcap, n_hits, b);
+
+    run(batches, endcap, true,  n_hits, n_reps);
+    run(batches, endcap, false, n_hits, n_reps);
+  }
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+// c++ -std=c++1z -O3 -mavx -I.. -I../mkFit -DUSE_MATRIPLEX -DMPLEX_USE_INTRINSICS -DTBB -DNO_ROOT -I../from-root dupfind_bench.cxx -o dupfind_bench -L../lib -lMkFit -lMicCore -ltbb -Wl,-rpath,../lib
+
+#include "Track.h"
+#include "mkFit/MkStdSeqs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace mkfit;
+
+namespace
+{
+  const int N_LAYERS        = 13;
+  const int HITS_PER_LAYER  = 20000;
+
+  TrackVec generate_tracks(int n_tracks, std::mt19937 &rnd)
+  {
+    std::uniform_real_distribution<float> u01(0, 1);
+    std::normal_distribution<float>       gaus(0, 1);
+
+    const SMatrixSym66 err = ROOT::Math::SMatrixIdentity();
+
+    TrackVec tracks;
+    for (int i = 0; i < n_tracks; ++i)
+    {
+      const int   charge = u01(rnd) < 0.5f ? -1 : 1;
+      const float pt     = 0.5f / (1.0f - 0.99f * u01(rnd));
+      const float eta    = 5.0f * u01(rnd) - 2.5f;
+      const float phi    = Config::TwoPI * u01(rnd) - Config::PI;
+
+      int hits[N_LAYERS];
+      for (int l = 0; l < N_LAYERS; ++l) hits[l] = u01(rnd) < 0.1f ? -1 : (int) (HITS_PER_LAYER * u01(rnd));
+
+      const int n_copies = u01(rnd) < 0.3f ? 2 + (int) (3 * u01(rnd)) : 1;
+      for (int c = 0; c < n_copies; ++c)
+      {
+        const float s    = c > 0 && u01(rnd) < 0.8f ? 1.0f : 0.0f;
+        const float cpt  = pt  * (1.0f + s * 0.05f * gaus(rnd));
+        const float ceta = eta +         s * 0.01f * gaus(rnd);
+        const float cphi = phi +         s * 0.01f * gaus(rnd);
+
+        TrackState state(charge, SVector3(0, 0, 0),
+                         SVector3(cpt * std::cos(cphi), cpt * std::sin(cphi), cpt * std::sinh(ceta)),
+                         err);
+        state.convertFromCartesianToCCS();
+        tracks.emplace_back(state, 0, u01(rnd) < 0.02f ? i : (int) tracks.size(), 0, nullptr);
+        Track &t = tracks.back();
+        t.setScore(100 * u01(rnd));
+
+        const float f_keep = c > 0 ? u01(rnd) : 1.0f;
+        for (int l = 0; l < N_LAYERS; ++l)
+        {
+          const int idx = u01(rnd) < f_keep ? hits[l] : (int) (HITS_PER_LAYER * u01(rnd));
+          t.addHitIdx(idx, l, 0);
+        }
+      }
+    }
+    std::shuffle(tracks.begin(), tracks.end(), rnd);
+    return tracks;
+  }
+
+  double find(TrackVec &tracks, bool brute_force)
+  {
+    Config::findDuplicatesBruteForce = brute_force;
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    StdSeq::find_duplicates(tracks);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const int n_tracks = argc > 1 ? atoi(argv[1]) : 5000;
+  const int n_events = argc > 2 ? atoi(argv[2]) : 10;
+
+  std::mt19937 rnd(4357);
+
+  int n_diff = 0;
+  for (int mode = 0; mode < 2; ++mode)
+  {
+    Config::useHitsForDuplicates = mode == 0;
+
+    double t_bf = 0, t_grid = 0;
+    long long n_in = 0, n_dup = 0;
+    for (int e = 0; e < n_events; ++e)
+    {
+      TrackVec tracks_bf = generate_tracks(n_tracks, rnd), tracks_grid = tracks_bf;
+      n_in += tracks_bf.size();
+
+      t_bf   += find(tracks_bf,   true);
+      t_grid += find(tracks_grid, false);
+
+      for (int i = 0; i < (int) tracks_bf.size(); ++i)
+      {
+        if (tracks_bf[i].getDuplicateValue() != tracks_grid[i].getDuplicateValue()) ++n_diff;
+        if (tracks_grid[i].getDuplicateValue()) ++n_dup;
+      }
+    }
+
+    printf("%s: %.0f tracks/event, %.0f marked as duplicates, tracks marked differently: %d\n",
+           mode ? "kinematic only" : "hits and kinematic",
+           (double) n_in / n_events, (double) n_dup / n_events, n_diff);
+    printf("  all pairs: %9.3f ms/event   grid: %9.3f ms/event   speedup %.1f\n",
+           1e3 * t_bf / n_events, 1e3 * t_grid / n_events, t_bf / t_grid);
+  }
+
+  return n_diff != 0;
+}
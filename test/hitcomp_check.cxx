@@ -0,0 +1,76 @@
+// c++ -std=c++1z -O2 -mavx -I.. -I../mkFit -DUSE_MATRIPLEX -DMPLEX_USE_INTRINSICS -DTBB -DNO_ROOT -I../from-root hitcomp_check.cxx -o hitcomp_check -L../lib -lMkFit -lMicCore -ltbb -Wl,-rpath,../lib
+
+#include "HitCompression.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace mkfit;
+
+namespace
+{
+  // Hits on a barrel layer sorted in phi, as they are written by Event::write_out().
+  void make_hits(std::mt19937 &rnd, int n, std::vector<Hit> &hits, std::vector<uint64_t> &masks)
+  {
+    std::uniform_real_distribution<float> u01(0, 1);
+    hits.clear();
+    masks.clear();
+    for (int i = 0; i < n; ++i)
+    {
+      const float phi = Config::TwoPI * i / std::max(n, 1) - Config::PI;
+      const float r   = 25.5f + 0.5f * u01(rnd);
+      SMatrixSym33 err;
+      err(0, 0) = err(1, 1) = 4e-4f;
+      err(2, 2) = 2.5e-3f;
+      hits.emplace_back(SVector3(r * std::cos(phi), r * std::sin(phi), 60 * u01(rnd) - 30), err, i);
+      masks.push_back(u01(rnd) < 0.3f ? (1ull << (int) (64 * u01(rnd))) : 0);
+    }
+  }
+
+  bool round_trip(const std::vector<Hit> &hits, const std::vector<uint64_t> &masks, bool use_masks)
+  {
+    const int n = hits.size();
+
+    std::vector<char> buf;
+    const int size = compress_hits(hits.data(), use_masks ? masks.data() : nullptr, n, buf);
+
+    std::vector<Hit>      h(n);
+    std::vector<uint64_t> m(n, 0);
+    const char *end = decompress_hits(buf.data(), h.data(), use_masks ? m.data() : nullptr, n);
+
+    bool ok = size == (int) buf.size() && end == buf.data() + buf.size() &&
+              compressed_block_size(buf.data()) == size;
+    ok = ok && (n == 0 || memcmp(h.data(), hits.data(), n * sizeof(Hit)) == 0);
+    if (use_masks) ok = ok && (n == 0 || memcmp(m.data(), masks.data(), n * sizeof(uint64_t)) == 0);
+
+    printf("  %6d hits, masks %d: %8zu -> %8d bytes  %s\n", n, use_masks,
+           n * (sizeof(Hit) + (use_masks ? sizeof(uint64_t) : 0)), size, ok ? "ok" : "FAIL");
+    return ok;
+  }
+}
+
+int main()
+{
+  std::mt19937 rnd(4357);
+  std::vector<Hit>      hits;
+  std::vector<uint64_t> masks;
+
+  bool ok = true;
+  for (int n : { 0, 1, 7, 100, 5000, 100000 })
+  {
+    make_hits(rnd, n, hits, masks);
+    ok = round_trip(hits, masks, false) && ok;
+    ok = round_trip(hits, masks, true)  && ok;
+  }
+
+  // Runs of identical hits exercise long, overlapping matches.
+  hits.assign(20000, hits[0]);
+  masks.assign(20000, 0);
+  ok = round_trip(hits, masks, true) && ok;
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,149 @@
+// c++ -std=c++1z -O3 -mavx -I.. -I../mkFit -DUSE_MATRIPLEX -DMPLEX_USE_INTRINSICS -DTBB -DNO_ROOT -I../from-root hitscan_bench.cxx ../mkFit/MkFinder.cc -o hitscan_bench -L../lib -lMkFit -lMicCore -ltbb -Wl,-rpath,../lib
+
+#include "MkFinder.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace mkfit;
+
+namespace
+{
+  const int   N_BATCHES = 1024;
+  const float R_LAYER   = 50;
+  const float Z_MAX     = 100;
+
+  struct Batch
+  {
+    MkFinder::HitWindows hw;
+    WSR_Result           wsr[NN];
+  };
+
+  void setup_finder(MkFinder &f, const Batch &b)
+  {
+    for (int i = 0; i < NN; ++i)
+    {
+      f.XHitSize[i]   = 0;
+      f.XWsrResult[i] = b.wsr[i];
+    }
+  }
+
+  double run(MkFinder &f, const LayerOfHits &L, const std::vector<Batch> &batches, int n_reps, bool simd,
+             long long &n_sel)
+  {
+    n_sel = 0;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < n_reps; ++r)
+    {
+      for (auto &b : batches)
+      {
+        setup_finder(f, b);
+        if (simd) f.ScanHitWindows(L, NN, b.hw);
+        else      f.ScanHitWindowsScalar(L, NN, b.hw);
+        for (int i = 0; i < NN; ++i) n_sel += std::max(0, (int) f.XHitSize[i]);
+      }
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const int n_hits = argc > 1 ? atoi(argv[1]) : 20000;
+  const int   n_reps      = argc > 2 ? atoi(argv[2]) : 20;
+  const float masked_frac = argc > 3 ? atof(argv[3]) : 0.05f;
+
+  std::mt19937 rnd(4357);
+  std::uniform_real_distribution<float> u01(0, 1);
+
+  LayerInfo li(0, LayerInfo::Barrel);
+  li.set_limits(R_LAYER - 0.5f, R_LAYER + 0.5f, -Z_MAX, Z_MAX);
+  li.m_q_bin = 2;
+
+  LayerOfHits L;
+  L.SetupLayer(li);
+
+  HitVec hits(n_hits);
+  std::vector<bool> hit_mask(n_hits);
+  SMatrixSym33 err = ROOT::Math::SMatrixIdentity();
+  for (int i = 0; i < n_hits; ++i)
+  {
+    const float phi = Config::TwoPI * u01(rnd) - Config::PI;
+    const float z   = Z_MAX * (2 * u01(rnd) - 1);
+    // A few percent of gap hits and masked hits to exercise those branches.
+    const int   mc  = u01(rnd) < 0.02f ? -7 : i;
+    hits[i] = Hit(SVector3(R_LAYER * std::cos(phi), R_LAYER * std::sin(phi), z), err, mc);
+    hit_mask[i] = u01(rnd) < masked_frac;
+  }
+  L.SuckInHits(hits);
+
+  std::vector<uint64_t> hit_bits((n_hits + 63) / 64);
+  for (int hi = 0; hi < n_hits; ++hi)
+  {
+    if (hit_mask[L.GetOriginalHitIndex(hi)]) hit_bits[hi >> 6] |= (uint64_t) 1 << (hi & 63);
+  }
+
+  std::vector<Batch> batches(N_BATCHES);
+  for (auto &b : batches)
+  {
+    for (int i = 0; i < NN; ++i)
+    {
+      const float q    = Z_MAX * (2 * u01(rnd) - 1);
+      const float phi  = Config::TwoPI * u01(rnd) - Config::PI;
+      const float dq   = 0.5f + 4.0f  * u01(rnd);
+      const float dphi = 0.005f + 0.1f * u01(rnd);
+
+      b.hw.q[i] = q;  b.hw.dq[i] = dq;  b.hw.phi[i] = phi;  b.hw.dphi[i] = dphi;
+      b.hw.qb1[i] = L.GetQBinChecked(q - dq);
+      b.hw.qb2[i] = L.GetQBinChecked(q + dq) + 1;
+      b.hw.pb1[i] = L.GetPhiBin(phi - dphi);
+      b.hw.pb2[i] = L.GetPhiBin(phi + dphi) + 1;
+      b.wsr[i] = WSR_Result(u01(rnd) < 0.05f ? WSR_Outside : WSR_Inside, false);
+    }
+  }
+
+  std::unique_ptr<MkFinder> fs(new MkFinder), fv(new MkFinder), fp(new MkFinder);
+  fs->m_iteration_hit_mask = &hit_mask;
+  fv->m_iteration_hit_mask = &hit_mask;
+  fp->m_iteration_hit_bits = hit_bits.data();
+
+  // Check that the scans agree, also on the number of windows with more hits
+  // than the cap.
+  int n_diff = 0;
+  for (auto &b : batches)
+  {
+    fs->m_hit_scan_stats = MkFinder::HitScanStats();
+    setup_finder(*fs, b);  fs->ScanHitWindowsScalar(L, NN, b.hw);
+    for (MkFinder *f : { fv.get(), fp.get() })
+    {
+      f->m_hit_scan_stats = MkFinder::HitScanStats();
+      setup_finder(*f, b);  f->ScanHitWindows(L, NN, b.hw);
+      if (f->m_hit_scan_stats.m_n_capped != fs->m_hit_scan_stats.m_n_capped) ++n_diff;
+      for (int i = 0; i < NN; ++i)
+      {
+        bool same = fs->XHitSize[i] == f->XHitSize[i] &&
+                    fs->XWsrResult[i].m_in_gap == f->XWsrResult[i].m_in_gap;
+        for (int j = 0; same && j < fs->XHitSize[i]; ++j)
+          same = fs->XHitArr.At(i, j, 0) == f->XHitArr.At(i, j, 0);
+        if ( ! same) ++n_diff;
+      }
+    }
+  }
+  printf("n_hits=%d, NN=%d, batches=%d, reps=%d, masked=%.2f -- tracks with different selection: %d\n",
+         n_hits, NN, N_BATCHES, n_reps, masked_frac, n_diff);
+
+  long long n_sel_s, n_sel_v, n_sel_p;
+  const double t_s = run(*fs, L, batches, n_reps, false, n_sel_s);
+  const double t_v = run(*fv, L, batches, n_reps, true,  n_sel_v);
+  const double t_p = run(*fp, L, batches, n_reps, true,  n_sel_p);
+
+  const double n_trk = (double) N_BATCHES * NN * n_reps;
+  printf("scalar: %8.3f ns/track   simd: %8.3f ns/track   simd, packed mask: %8.3f ns/track   (%.2f hits/track)\n",
+         1e9 * t_s / n_trk, 1e9 * t_v / n_trk, 1e9 * t_p / n_trk, n_sel_s / n_trk);
+
+  return n_diff != 0 || n_sel_s != n_sel_v || n_sel_s != n_sel_p;
+}
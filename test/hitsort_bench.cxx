@@ -0,0 +1,163 @@
+// c++ -std=c++1z -O3 -mavx -I.. -I../mkFit -DUSE_MATRIPLEX -DMPLEX_USE_INTRINSICS -DTBB -DNO_ROOT -I../from-root hitsort_bench.cxx -o hitsort_bench -L../lib -lMkFit -lMicCore -ltbb -Wl,-rpath,../lib
+
+#include "Event.h"
+#include "HitStructures.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace mkfit;
+
+namespace
+{
+  const int HITS_PER_PU_BRL = 60;
+  const int HITS_PER_PU_EC  = 25;
+
+  std::vector<HitVec> generate_event(const TrackerInfo &ti, int pu, std::mt19937 &rnd)
+  {
+    std::uniform_real_distribution<float> u01(0, 1);
+    SMatrixSym33 err = ROOT::Math::SMatrixIdentity();
+
+    std::vector<HitVec> layers(ti.m_layers.size());
+    for (int l = 0; l < (int) ti.m_layers.size(); ++l)
+    {
+      const LayerInfo &li = ti.m_layers[l];
+      const int n = pu * (li.is_barrel() ? HITS_PER_PU_BRL : HITS_PER_PU_EC);
+
+      layers[l].resize(n);
+      for (int i = 0; i < n; ++i)
+      {
+        const float phi = Config::TwoPI * u01(rnd) - Config::PI;
+        float r, z;
+        if (li.is_barrel())
+        {
+          r = 0.5f * (li.m_rin + li.m_rout);
+          z = li.m_zmin + (li.m_zmax - li.m_zmin) * u01(rnd);
+        }
+        else
+        {
+          r = li.m_rin + (li.m_rout - li.m_rin) * u01(rnd);
+          z = 0.5f * (li.m_zmin + li.m_zmax);
+        }
+        layers[l][i] = Hit(SVector3(r * std::cos(phi), r * std::sin(phi), z), err, i);
+      }
+    }
+    return layers;
+  }
+
+  double suck_in(std::vector<std::unique_ptr<LayerOfHits>> &loh, const std::vector<HitVec> &hits,
+                 bool radix, int n_reps)
+  {
+    Config::useRadixHitSort = radix;
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < n_reps; ++r)
+    {
+      for (int l = 0; l < (int) hits.size(); ++l)
+      {
+        loh[l]->Reset();
+        loh[l]->SuckInHits(hits[l]);
+      }
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+  }
+
+  int compare(const LayerOfHits &a, const LayerOfHits &b, int n_hits)
+  {
+    int n_diff = 0;
+    for (int i = 0; i < n_hits; ++i)
+    {
+      if (a.GetOriginalHitIndex(i) != b.GetOriginalHitIndex(i)) ++n_diff;
+    }
+    for (int i = 0; i < a.m_nq * a.m_nphi; ++i)
+    {
+      if (a[i] != b[i]) ++n_diff;
+    }
+    return n_diff;
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  int         pu       = 50;
+  int         n_events = 10;
+  int         n_reps   = 20;
+  std::string file;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    if      ( ! strcmp(argv[i], "-pu")     && i + 1 < argc) pu       = atoi(argv[++i]);
+    else if ( ! strcmp(argv[i], "-file")   && i + 1 < argc) file     = argv[++i];
+    else if ( ! strcmp(argv[i], "-events") && i + 1 < argc) n_events = atoi(argv[++i]);
+    else if ( ! strcmp(argv[i], "-reps")   && i + 1 < argc) n_reps   = atoi(argv[++i]);
+    else { fprintf(stderr, "Unknown argument '%s'\n", argv[i]); exit(1); }
+  }
+
+  TrackerInfo    ti;
+  IterationsInfo ii;
+  TrackerInfo::ExecTrackerInfoCreatorPlugin("CMS-2017", ti, ii);
+
+  const int n_layers = ti.m_layers.size();
+
+  std::vector<std::unique_ptr<LayerOfHits>> loh_radix, loh_count;
+  for (int l = 0; l < n_layers; ++l)
+  {
+    loh_radix.emplace_back(new LayerOfHits);  loh_radix.back()->SetupLayer(ti.m_layers[l]);
+    loh_count.emplace_back(new LayerOfHits);  loh_count.back()->SetupLayer(ti.m_layers[l]);
+  }
+
+  std::vector<std::vector<HitVec>> events;
+  if ( ! file.empty())
+  {
+    DataFile data_file;
+    n_events = std::min(n_events, data_file.OpenRead(file, true));
+    Event ev(0);
+    for (int e = 0; e < n_events; ++e)
+    {
+      ev.Reset(e);
+      ev.read_in(data_file);
+      events.emplace_back(n_layers);
+      for (int l = 0; l < n_layers; ++l)
+      {
+        HitSpan hs = ev.layer_hits(l);
+        events.back()[l].assign(hs.begin(), hs.end());
+      }
+    }
+    data_file.Close();
+    printf("%d events from %s\n", n_events, file.c_str());
+  }
+  else
+  {
+    std::mt19937 rnd(4357);
+    for (int e = 0; e < n_events; ++e) events.emplace_back(generate_event(ti, pu, rnd));
+    printf("%d generated events, pile-up %d\n", n_events, pu);
+  }
+
+  double t_radix = 0, t_count = 0;
+  long long n_hits = 0;
+  int n_diff = 0;
+  for (auto &ev : events)
+  {
+    t_radix += suck_in(loh_radix, ev, true,  n_reps);
+    t_count += suck_in(loh_count, ev, false, n_reps);
+    for (int l = 0; l < n_layers; ++l)
+    {
+      n_hits += ev[l].size();
+      n_diff += compare(*loh_radix[l], *loh_count[l], ev[l].size());
+    }
+  }
+
+  const double n_layer_evs = (double) n_events * n_layers * n_reps;
+  printf("%.0f hits/layer on average, %d differences in hit order or bins\n",
+         (double) n_hits / n_events / n_layers, n_diff);
+  printf("radix: %8.3f us/layer   counting: %8.3f us/layer   speedup %.2f\n",
+         1e6 * t_radix / n_layer_evs, 1e6 * t_count / n_layer_evs, t_radix / t_count);
+
+  return n_diff != 0;
+}
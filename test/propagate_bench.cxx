@@ -0,0 +1,214 @@
+// c++ -std=c++1z -O3 -mavx -I.. -I../mkFit -DUSE_MATRIPLEX -DMPLEX_USE_INTRINSICS -DTBB -DNO_ROOT -I../from-root propagate_bench.cxx -o propagate_bench -L../lib -lMkFit -lMicCore -ltbb -Wl,-rpath,../lib
+
+#include "PropagationMPlex.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace mkfit;
+
+namespace
+{
+  // Approximate CMS-2017 barrel layer radii, PXB then TIB and TOB.
+  const double s_radii[] = { 2.9, 6.8, 10.9, 16.0, 25.5, 34.0, 42.0, 50.0, 60.8, 69.2, 78.0, 86.8, 96.5, 108.0 };
+  const int    s_n_radii = sizeof(s_radii) / sizeof(s_radii[0]);
+
+  struct Batch
+  {
+    MPlexLV par;
+    MPlexQI chg;
+    MPlexQF rad;
+  };
+
+  typedef double State[6];
+
+  // Exact helix from p0 in the transverse plane, see helixAtRClosedFormCCS_impl().
+  void ref_at_alpha(const State &in, double k, double alpha, State &out)
+  {
+    const double rho = k / in[3];
+    out[0] = in[0] + rho * (std::sin(in[4] + alpha) - std::sin(in[4]));
+    out[1] = in[1] + rho * (std::cos(in[4]) - std::cos(in[4] + alpha));
+    out[2] = in[2] + rho * alpha / std::tan(in[5]);
+    out[3] = in[3];
+    out[4] = in[4] + alpha;
+    out[5] = in[5];
+  }
+
+  bool ref_propagate(const State &in, double k, double r, State &out)
+  {
+    const double rho = k / in[3];
+    // Straight line guess, then Newton on |p(alpha)|^2 - r^2.
+    const double pu = in[0] * std::cos(in[4]) + in[1] * std::sin(in[4]);
+    const double r0sq = in[0] * in[0] + in[1] * in[1];
+    const double disc = pu * pu - (r0sq - r * r);
+    if (disc < 0) return false;
+    double alpha = (-pu + std::sqrt(disc)) / rho;
+    for (int i = 0; i < 50; ++i)
+    {
+      ref_at_alpha(in, k, alpha, out);
+      const double f  = out[0] * out[0] + out[1] * out[1] - r * r;
+      const double fp = 2 * rho * (out[0] * std::cos(out[4]) + out[1] * std::sin(out[4]));
+      const double da = f / fp;
+      alpha -= da;
+      if (std::abs(da) < 1e-15) break;
+    }
+    ref_at_alpha(in, k, alpha, out);
+    return true;
+  }
+
+  void ref_jacobian(const State &in, double k, double r, double jac[6][6])
+  {
+    for (int j = 0; j < 6; ++j)
+    {
+      const double h = 1e-6 * std::max(1.0, std::abs(in[j]));
+      State ip, im, op, om;
+      for (int l = 0; l < 6; ++l) ip[l] = im[l] = in[l];
+      ip[j] += h; im[j] -= h;
+      ref_propagate(ip, k, r, op);
+      ref_propagate(im, k, r, om);
+      for (int i = 0; i < 6; ++i) jac[i][j] = (op[i] - om[i]) / (2 * h);
+    }
+  }
+
+  struct Stats
+  {
+    double max_dr = 0, sum_dr = 0, max_dpar = 0, max_djac = 0;
+    int    n = 0, n_fail = 0;
+
+    void print(const char *name) const
+    {
+      printf("  %-10s  fails %6d   |r - R| mean %.3e max %.3e cm   max |dpar| %.3e   max |djac| %.3e\n",
+             name, n_fail, sum_dr / std::max(n, 1), max_dr, max_dpar, max_djac);
+    }
+  };
+
+  void compare(const Batch &b, const MPlexLV &out, const MPlexLL &jac, const MPlexQI &fail, int n, Stats &s)
+  {
+    State in, ref;
+    for (int l = 0; l < 6; ++l) in[l] = b.par.ConstAt(n, l, 0);
+    const double k = b.chg.ConstAt(n, 0, 0) * 100.0 / (-Config::sol * Config::Bfield);
+    const double r = b.rad.ConstAt(n, 0, 0);
+
+    if (fail.ConstAt(n, 0, 0)) { ++s.n_fail; return; }
+    if ( ! ref_propagate(in, k, r, ref)) return;
+
+    double refjac[6][6];
+    ref_jacobian(in, k, r, refjac);
+
+    const double dr = std::abs(std::hypot(out.ConstAt(n, 0, 0), out.ConstAt(n, 1, 0)) - r);
+    ++s.n;
+    s.sum_dr += dr;
+    s.max_dr  = std::max(s.max_dr, dr);
+    for (int i = 0; i < 6; ++i)
+    {
+      s.max_dpar = std::max(s.max_dpar, std::abs(out.ConstAt(n, i, 0) - ref[i]) / std::max(1.0, std::abs(ref[i])));
+      for (int j = 0; j < 6; ++j)
+      {
+        s.max_djac = std::max(s.max_djac, std::abs(jac.ConstAt(n, i, j) - refjac[i][j]) / std::max(1.0, std::abs(refjac[i][j])));
+      }
+    }
+  }
+
+  double run(const std::vector<Batch> &batches, int n_reps, PropagationFlags pf, float &sink)
+  {
+    MPlexLV out;
+    MPlexLL jac;
+    MPlexQI fail;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < n_reps; ++r)
+    {
+      for (auto &b : batches)
+      {
+        out = b.par;
+        helixAtRFromIterativeCCS(b.par, b.chg, b.rad, out, jac, fail, NN, pf);
+        sink += out.ConstAt(0, 0, 0) + jac.ConstAt(NN - 1, 0, 3);
+      }
+    }
+    auto t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const int n_batches = argc > 1 ? atoi(argv[1]) : 4096;
+  const int n_reps    = argc > 2 ? atoi(argv[2]) : 50;
+
+  std::mt19937 rnd(4357);
+  std::uniform_real_distribution<double> u01(0, 1);
+
+  std::vector<Batch> batches(n_batches);
+  for (auto &b : batches)
+  {
+    for (int n = 0; n < NN; ++n)
+    {
+      // 1/pt flat in [0.01, 1.6] (0.6 - 100 GeV), |eta| < 1.5, small d0.
+      const int    q     = u01(rnd) < 0.5 ? -1 : 1;
+      const double ipt   = 0.01 + 1.59 * u01(rnd);
+      const double phi   = Config::TwoPI * u01(rnd) - Config::PI;
+      const double eta   = 3.0 * u01(rnd) - 1.5;
+      const double theta = 2 * std::atan(std::exp(-eta));
+      const double d0    = 0.05 * (2 * u01(rnd) - 1);
+      const double k     = q * 100.0 / (-Config::sol * Config::Bfield);
+
+      int l0 = std::min((int) (u01(rnd) * (s_n_radii - 1)), s_n_radii - 2);
+      int l1 = l0 + 1;
+      if (l0 > 0 && u01(rnd) < 0.1) std::swap(l0, l1);
+
+      State beam = { -d0 * std::sin(phi), d0 * std::cos(phi), 10 * (2 * u01(rnd) - 1), ipt, phi, theta };
+      State at0;
+      if ( ! ref_propagate(beam, k, s_radii[l0], at0))
+      {
+        // Looper that does not reach the layer, use a stiff track instead.
+        beam[3] = 0.01;
+        ref_propagate(beam, k, s_radii[l0], at0);
+      }
+      // Smear position off the layer surface a bit, as for a hit position.
+      at0[0] += 0.01 * (2 * u01(rnd) - 1);
+      at0[1] += 0.01 * (2 * u01(rnd) - 1);
+
+      for (int l = 0; l < 6; ++l) b.par(n, l, 0) = at0[l];
+      b.chg(n, 0, 0) = q;
+      b.rad(n, 0, 0) = s_radii[l1];
+    }
+  }
+
+  printf("Propagating %d x %d tracks between CMS-2017 barrel radii, NN=%d\n", n_batches, NN, NN);
+
+  const PropagationFlags pf_iter(PF_none);
+  const PropagationFlags pf_cf  (PF_closed_form_r);
+
+  Stats s_iter, s_cf;
+  for (auto &b : batches)
+  {
+    MPlexLV out;
+    MPlexLL jac;
+    MPlexQI fail;
+
+    out = b.par;
+    helixAtRFromIterativeCCS(b.par, b.chg, b.rad, out, jac, fail, NN, pf_iter);
+    for (int n = 0; n < NN; ++n) compare(b, out, jac, fail, n, s_iter);
+
+    out = b.par;
+    helixAtRFromIterativeCCS(b.par, b.chg, b.rad, out, jac, fail, NN, pf_cf);
+    for (int n = 0; n < NN; ++n) compare(b, out, jac, fail, n, s_cf);
+  }
+  printf("Accuracy against double precision reference (dpar, djac relative to max(1, |ref|)):\n");
+  s_iter.print("iterative");
+  s_cf  .print("closed");
+
+  float sink = 0;
+  run(batches, 1, pf_iter, sink);
+  const double t_iter = run(batches, n_reps, pf_iter, sink);
+  const double t_cf   = run(batches, n_reps, pf_cf,   sink);
+  const double n_trk  = (double) n_batches * NN * n_reps;
+
+  printf("Time per track: iterative %.2f ns, closed %.2f ns, speedup %.2f  (sink %g)\n",
+         1e9 * t_iter / n_trk, 1e9 * t_cf / n_trk, t_iter / t_cf, sink);
+
+  return 0;
+}
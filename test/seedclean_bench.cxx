@@ -0,0 +1,109 @@
+// c++ -std=c++1z -O3 -mavx -I.. -I../mkFit -DUSE_MATRIPLEX -DMPLEX_USE_INTRINSICS -DTBB -DNO_ROOT -I../from-root seedclean_bench.cxx -o seedclean_bench -L../lib -lMkFit -lMicCore -ltbb -Wl,-rpath,../lib
+
+#include "Event.h"
+#include "mkFit/SteeringParams.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+using namespace mkfit;
+
+namespace
+{
+  TrackVec generate_seeds(int n_tracks, std::mt19937 &rnd)
+  {
+    std::uniform_real_distribution<float> u01(0, 1);
+    std::normal_distribution<float>       gaus(0, 1);
+
+    const SMatrixSym66 err = ROOT::Math::SMatrixIdentity();
+
+    TrackVec seeds;
+    for (int i = 0; i < n_tracks; ++i)
+    {
+      const int   charge = u01(rnd) < 0.5f ? -1 : 1;
+      const float pt     = 0.3f / (1.0f - 0.99f * u01(rnd));
+      const float eta    = 6.0f * u01(rnd) - 3.0f;
+      const float phi    = Config::TwoPI * u01(rnd) - Config::PI;
+      const float r      = u01(rnd) < 0.5f ? 0.1f * u01(rnd) : 2.9f;
+      const float z      = 5.0f * gaus(rnd) + r * std::sinh(eta);
+
+      const int n_copies = u01(rnd) < 0.3f ? 2 + (int) (3 * u01(rnd)) : 1;
+      for (int c = 0; c < n_copies; ++c)
+      {
+        const float s    = c > 0 ? 1.0f : 0.0f;
+        const float cpt  = pt  * (1.0f + s * 0.01f  * gaus(rnd));
+        const float ceta = eta +         s * 0.003f * gaus(rnd);
+        const float cphi = phi +         s * 0.003f * gaus(rnd);
+        const float cz   = z   +         s * 0.002f * gaus(rnd);
+
+        TrackState state(charge,
+                         SVector3(r * std::cos(cphi), r * std::sin(cphi), cz),
+                         SVector3(cpt * std::cos(cphi), cpt * std::sin(cphi), cpt * std::sinh(ceta)),
+                         err);
+        state.convertFromCartesianToCCS();
+        seeds.emplace_back(state, 0, seeds.size(), 0, nullptr);
+      }
+    }
+    std::shuffle(seeds.begin(), seeds.end(), rnd);
+    return seeds;
+  }
+
+  double clean(Event &ev, TrackVec &seeds, const IterationConfig *itrcfg, bool brute_force)
+  {
+    Config::seedCleaningBruteForce = brute_force;
+
+    auto t0 = std::chrono::high_resolution_clock::now();
+    if (itrcfg) ev.clean_cms_seedtracks_iter(&seeds, *itrcfg);
+    else        ev.clean_cms_seedtracks(&seeds);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const int n_tracks = argc > 1 ? atoi(argv[1]) : 5000;
+  const int n_events = argc > 2 ? atoi(argv[2]) : 10;
+
+  TrackerInfo    ti;
+  IterationsInfo ii;
+  TrackerInfo::ExecTrackerInfoCreatorPlugin("CMS-2017", ti, ii);
+
+  Event ev(0);
+  std::mt19937 rnd(4357);
+
+  int n_diff = 0;
+  for (int mode = 0; mode < 2; ++mode)
+  {
+    const IterationConfig *itrcfg = mode ? &ii[0] : nullptr;
+
+    double t_bf = 0, t_grid = 0;
+    long long n_in = 0, n_out = 0;
+    for (int e = 0; e < n_events; ++e)
+    {
+      TrackVec seeds_bf = generate_seeds(n_tracks, rnd), seeds_grid = seeds_bf;
+      n_in += seeds_bf.size();
+
+      t_bf   += clean(ev, seeds_bf,   itrcfg, true);
+      t_grid += clean(ev, seeds_grid, itrcfg, false);
+      n_out  += seeds_grid.size();
+
+      if (seeds_bf.size() != seeds_grid.size()) ++n_diff;
+      else
+      {
+        for (int i = 0; i < (int) seeds_bf.size(); ++i)
+          if (seeds_bf[i].label() != seeds_grid[i].label()) { ++n_diff; break; }
+      }
+    }
+
+    printf("%s: %.0f -> %.0f seeds/event, events with different result: %d\n",
+           mode ? "clean_cms_seedtracks_iter" : "clean_cms_seedtracks",
+           (double) n_in / n_events, (double) n_out / n_events, n_diff);
+    printf("  all pairs: %9.3f ms/event   grid: %9.3f ms/event   speedup %.1f\n",
+           1e3 * t_bf / n_events, 1e3 * t_grid / n_events, t_bf / t_grid);
+  }
+
+  return n_diff != 0;
+}
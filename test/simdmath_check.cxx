@@ -0,0 +1,205 @@
+// c++ -std=c++1z -O3 -mavx -fopenmp-simd -fno-math-errno -I.. simdmath_check.cxx -o simdmath_check
+
+#include "SimdMath.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace mkfit;
+
+namespace
+{
+  struct Check
+  {
+    const char *m_name;
+    double      m_bound[3]; // MA_Fast, MA_Medium, MA_Full
+    double      m_max[3] = { 0, 0, 0 };
+
+    void update(int a, double err) { m_max[a] = std::max(m_max[a], err); }
+
+    bool report() const
+    {
+      bool ok = true;
+      printf("  %-10s", m_name);
+      for (int a = 2; a >= 0; --a)
+      {
+        const bool pass = m_max[a] <= m_bound[a];
+        ok = ok && pass;
+        printf("  %9.2e / %7.1e %s", m_max[a], m_bound[a], pass ? "ok  " : "FAIL");
+      }
+      printf("\n");
+      return ok;
+    }
+  };
+
+  double rel_err(double v, double ref) { return std::abs(v - ref) / std::max(std::abs(ref), 1e-30); }
+  // Absolute for |ref| < 1, relative above.
+  double mix_err(double v, double ref) { return std::abs(v - ref) / std::max(std::abs(ref), 1.0); }
+
+  template<int A>
+  void check_level(const std::vector<float> &xs, const std::vector<float> &ys, const std::vector<float> &ps,
+                   Check &c_sin, Check &c_cos, Check &c_atan2, Check &c_atan, Check &c_log, Check &c_rsqrt, Check &c_eta)
+  {
+    for (size_t i = 0; i < xs.size(); ++i)
+    {
+      float s, c;
+      smath::sincos<A>(xs[i], s, c);
+      c_sin.update(A, std::abs(s - std::sin((double) xs[i])));
+      c_cos.update(A, std::abs(c - std::cos((double) xs[i])));
+
+      c_atan2.update(A, std::abs(smath::atan2<A>(ys[i], xs[i]) - std::atan2((double) ys[i], (double) xs[i])));
+      c_atan .update(A, std::abs(smath::atan<A>(ys[i] / 100) - std::atan((double) (ys[i] / 100))));
+
+      c_log  .update(A, mix_err(smath::log<A>(ps[i]), std::log((double) ps[i])));
+      c_rsqrt.update(A, rel_err(smath::rsqrt<A>(ps[i]), 1.0 / std::sqrt((double) ps[i])));
+
+      // r in CMS tracker range, z up to |eta| ~ 5.
+      const float r = 1.f + std::abs(xs[i]) * 0.012f;
+      const float z = ys[i] * 0.1f * r;
+      c_eta.update(A, mix_err(smath::eta<A>(r, z), std::asinh((double) z / r)));
+    }
+  }
+
+  template<typename F>
+  double time_it(int n_reps, F &&f)
+  {
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < n_reps; ++r) f();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  const int n_samples = argc > 1 ? atoi(argv[1]) : 2000000;
+  const int n_reps    = argc > 2 ? atoi(argv[2]) : 20;
+
+  std::mt19937 rnd(4357);
+  std::uniform_real_distribution<float> u01(0, 1);
+
+  // xs: half in [-2pi, 2pi], half in [-1e4, 1e4]; ys in [-1000, 1000] with a
+  // spread of magnitudes; ps positive normal numbers over a wide range.
+  std::vector<float> xs(n_samples), ys(n_samples), ps(n_samples);
+  for (int i = 0; i < n_samples; ++i)
+  {
+    xs[i] = (i & 1) ? 2e4f * (u01(rnd) - 0.5f) : 12.566371f * (u01(rnd) - 0.5f);
+    ys[i] = (2 * u01(rnd) - 1) * std::pow(10.f, 3 * u01(rnd));
+    ps[i] = std::pow(2.f, 200 * u01(rnd) - 100) * (1 + u01(rnd));
+  }
+
+  //                     Fast    Medium  Full
+  Check c_sin   { "sin",   { 4.5e-4, 1.6e-6, 1.0e-7 } };
+  Check c_cos   { "cos",   { 4.5e-4, 1.6e-6, 1.0e-7 } };
+  Check c_atan2 { "atan2", { 1.0e-5, 5.0e-7, 3.0e-7 } };
+  Check c_atan  { "atan",  { 1.0e-5, 5.0e-7, 3.0e-7 } };
+  Check c_log   { "log",   { 3.0e-5, 5.0e-7, 1.0e-7 } };
+  Check c_rsqrt { "rsqrt", { 1.8e-3, 5.0e-6, 1.0e-7 } };
+  Check c_eta   { "eta",   { 3.0e-5, 6.0e-7, 2.5e-7 } };
+
+  check_level<smath::MA_Fast>  (xs, ys, ps, c_sin, c_cos, c_atan2, c_atan, c_log, c_rsqrt, c_eta);
+  check_level<smath::MA_Medium>(xs, ys, ps, c_sin, c_cos, c_atan2, c_atan, c_log, c_rsqrt, c_eta);
+  check_level<smath::MA_Full>  (xs, ys, ps, c_sin, c_cos, c_atan2, c_atan, c_log, c_rsqrt, c_eta);
+
+  // libm in float, for reference.
+  Check f_sin { "std sin", { 0, 0, 1 } }, f_atan2 { "std atan2", { 0, 0, 1 } }, f_log { "std log", { 0, 0, 1 } };
+  for (int i = 0; i < n_samples; ++i)
+  {
+    f_sin  .update(2, std::abs(std::sin(xs[i]) - std::sin((double) xs[i])));
+    f_atan2.update(2, std::abs(std::atan2(ys[i], xs[i]) - std::atan2((double) ys[i], (double) xs[i])));
+    f_log  .update(2, mix_err(std::log(ps[i]), std::log((double) ps[i])));
+  }
+
+  printf("Max error (measured / bound) against double libm, %d samples:\n", n_samples);
+  printf("  %-10s  %-24s  %-24s  %-24s\n", "", "Full", "Medium", "Fast");
+  bool ok = true;
+  for (const Check *c : { &c_sin, &c_cos, &c_atan2, &c_atan, &c_log, &c_rsqrt, &c_eta })
+    ok = c->report() && ok;
+  printf("Float libm: sin %.2e, atan2 %.2e, log %.2e\n", f_sin.m_max[2], f_atan2.m_max[2], f_log.m_max[2]);
+
+  // Timing, on the [-2pi, 2pi] / [-1000, 1000] inputs.
+  std::vector<float> o1(n_samples), o2(n_samples);
+  float *__restrict__ px = xs.data(), *__restrict__ py = ys.data(), *__restrict__ pp = ps.data();
+  float *__restrict__ q1 = o1.data(), *__restrict__ q2 = o2.data();
+  const int n = n_samples;
+  const double nn = (double) n * n_reps;
+
+  struct Timing { const char *m_name; double m_std, m_full, m_fast; };
+  std::vector<Timing> ts;
+
+  ts.push_back({ "sincos",
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) { q1[i] = std::sin(px[i]); q2[i] = std::cos(px[i]); } }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) smath::sincos<smath::MA_Full>(px[i], q1[i], q2[i]); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) smath::sincos<smath::MA_Fast>(px[i], q1[i], q2[i]); })
+  });
+  ts.push_back({ "atan2",
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = std::atan2(py[i], px[i]); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = smath::atan2<smath::MA_Full>(py[i], px[i]); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = smath::atan2<smath::MA_Fast>(py[i], px[i]); })
+  });
+  ts.push_back({ "log",
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = std::log(pp[i]); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = smath::log<smath::MA_Full>(pp[i]); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = smath::log<smath::MA_Fast>(pp[i]); })
+  });
+  ts.push_back({ "hypot",
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = std::hypot(px[i], py[i]); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = smath::hypot(px[i], py[i]); }),
+    0
+  });
+  ts.push_back({ "rsqrt",
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = 1.f / std::sqrt(pp[i]); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = smath::rsqrt<smath::MA_Full>(pp[i]); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = smath::rsqrt<smath::MA_Fast>(pp[i]); })
+  });
+  ts.push_back({ "eta",
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = -std::log(std::tan(0.5f * std::atan2(1.f + std::abs(py[i]), px[i]))); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = smath::eta<smath::MA_Full>(1.f + std::abs(py[i]), px[i]); }),
+    time_it(n_reps, [&]{
+#pragma omp simd
+      for (int i = 0; i < n; ++i) q1[i] = smath::eta<smath::MA_Fast>(1.f + std::abs(py[i]), px[i]); })
+  });
+
+  printf("Time per call [ns]:\n  %-10s  %8s  %8s  %8s\n", "", "std", "Full", "Fast");
+  for (auto &t : ts)
+    printf("  %-10s  %8.3f  %8.3f  %8.3f\n", t.m_name, 1e9 * t.m_std / nn, 1e9 * t.m_full / nn, 1e9 * t.m_fast / nn);
+  printf("(checksum %g)\n", o1[n / 2] + o2[n / 3]);
+
+  return ok ? 0 : 1;
+}
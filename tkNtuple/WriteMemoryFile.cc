@@ -501,7 +501,7 @@ int main(int argc, char *argv[])
   long long savedEvents = 0;
 
   DataFile data_file;
-  int outOptions = DataFile::ES_Seeds;
+  int outOptions = DataFile::ES_Seeds | DataFile::ES_EventIndex;
   if (writeRecTracks) outOptions |= DataFile::ES_CmsswTracks;
   if (writeHitIterMasks) outOptions |= DataFile::ES_HitIterMasks;
   if (maxevt < 0) maxevt = totentries;